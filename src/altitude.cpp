@@ -0,0 +1,159 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200215
+
+#include "altitude.hpp"
+
+namespace altitude
+{
+
+// ratio p / p0 in Q24
+#define RATIO_SHIFT		24
+#define RATIO_MIN		(1 << (RATIO_SHIFT - 2))			// 0.25
+#define STEP_SHIFT		(RATIO_SHIFT - 9)				// table step 1/512
+#define TABLE_SIZE		513								// 0.25 .. 1.25
+
+// h(0.25 + i / 512) in mm, generated with:
+// [round(44330 * (1 - (0.25 + i / 512) ** (1 / 5.255)) * 1000) for i in range(513)]
+static const int32_t table[TABLE_SIZE] = {
+	10279088, 10228624, 10178477, 10128640, 10079111, 10029885, 9980957, 9932325,
+	9883983, 9835928, 9788156, 9740664, 9693447, 9646503, 9599828, 9553418,
+	9507270, 9461381, 9415747, 9370366, 9325234, 9280348, 9235706, 9191304,
+	9147139, 9103209, 9059511, 9016042, 8972799, 8929781, 8886984, 8844405,
+	8802043, 8759894, 8717957, 8676229, 8634708, 8593392, 8552277, 8511363,
+	8470647, 8430126, 8389799, 8349664, 8309718, 8269960, 8230387, 8190998,
+	8151792, 8112765, 8073916, 8035243, 7996745, 7958420, 7920266, 7882281,
+	7844464, 7806813, 7769326, 7732003, 7694840, 7657837, 7620993, 7584305,
+	7547772, 7511393, 7475167, 7439091, 7403165, 7367386, 7331755, 7296269,
+	7260927, 7225728, 7190670, 7155753, 7120975, 7086334, 7051830, 7017461,
+	6983227, 6949125, 6915156, 6881317, 6847608, 6814027, 6780573, 6747246,
+	6714045, 6680967, 6648013, 6615181, 6582470, 6549879, 6517407, 6485054,
+	6452818, 6420698, 6388693, 6356803, 6325027, 6293363, 6261811, 6230370,
+	6199039, 6167817, 6136703, 6105697, 6074797, 6044004, 6013315, 5982730,
+	5952249, 5921871, 5891595, 5861419, 5831344, 5801369, 5771493, 5741714,
+	5712034, 5682450, 5652962, 5623569, 5594271, 5565067, 5535956, 5506938,
+	5478012, 5449178, 5420434, 5391780, 5363215, 5334740, 5306352, 5278053,
+	5249840, 5221713, 5193673, 5165717, 5137847, 5110060, 5082357, 5054737,
+	5027199, 4999743, 4972368, 4945074, 4917861, 4890727, 4863672, 4836696,
+	4809798, 4782978, 4756235, 4729569, 4702979, 4676464, 4650025, 4623661,
+	4597370, 4571154, 4545011, 4518941, 4492943, 4467018, 4441163, 4415380,
+	4389668, 4364026, 4338454, 4312951, 4287517, 4262151, 4236854, 4211625,
+	4186462, 4161367, 4136338, 4111376, 4086479, 4061647, 4036881, 4012179,
+	3987541, 3962968, 3938457, 3914010, 3889626, 3865304, 3841044, 3816845,
+	3792708, 3768633, 3744617, 3720662, 3696767, 3672932, 3649156, 3625439,
+	3601780, 3578180, 3554638, 3531154, 3507727, 3484357, 3461044, 3437787,
+	3414586, 3391442, 3368353, 3345319, 3322340, 3299415, 3276545, 3253729,
+	3230967, 3208259, 3185603, 3163001, 3140451, 3117954, 3095509, 3073116,
+	3050774, 3028483, 3006244, 2984056, 2961918, 2939830, 2917793, 2895805,
+	2873866, 2851977, 2830137, 2808346, 2786604, 2764909, 2743263, 2721665,
+	2700114, 2678611, 2657154, 2635745, 2614382, 2593066, 2571796, 2550572,
+	2529394, 2508261, 2487174, 2466131, 2445134, 2424181, 2403273, 2382409,
+	2361590, 2340814, 2320081, 2299392, 2278747, 2258144, 2237585, 2217067,
+	2196593, 2176160, 2155770, 2135421, 2115115, 2094849, 2074625, 2054442,
+	2034300, 2014199, 1994138, 1974118, 1954138, 1934197, 1914297, 1894436,
+	1874615, 1854833, 1835090, 1815386, 1795721, 1776095, 1756507, 1736957,
+	1717445, 1697971, 1678535, 1659137, 1639776, 1620453, 1601166, 1581917,
+	1562704, 1543528, 1524388, 1505285, 1486218, 1467187, 1448192, 1429233,
+	1410309, 1391421, 1372568, 1353750, 1334967, 1316219, 1297505, 1278827,
+	1260182, 1241572, 1222996, 1204454, 1185946, 1167472, 1149031, 1130624,
+	1112250, 1093909, 1075601, 1057326, 1039084, 1020875, 1002698, 984553,
+	966441, 948361, 930313, 912296, 894312, 876359, 858437, 840547,
+	822689, 804861, 787065, 769299, 751564, 733860, 716186, 698543,
+	680930, 663347, 645794, 628271, 610778, 593315, 575882, 558478,
+	541103, 523758, 506441, 489154, 471896, 454667, 437466, 420294,
+	403151, 386036, 368949, 351890, 334860, 317858, 300883, 283936,
+	267017, 250126, 233262, 216426, 199617, 182835, 166080, 149352,
+	132651, 115977, 99329, 82708, 66114, 49546, 33004, 16489,
+	0, -16463, -32900, -49312, -65697, -82057, -98391, -114700,
+	-130983, -147241, -163474, -179681, -195864, -212021, -228154, -244261,
+	-260344, -276403, -292436, -308446, -324431, -340391, -356328, -372240,
+	-388128, -403992, -419833, -435649, -451442, -467211, -482957, -498679,
+	-514377, -530052, -545704, -561333, -576939, -592521, -608081, -623618,
+	-639131, -654623, -670091, -685537, -700960, -716361, -731740, -747096,
+	-762430, -777742, -793032, -808300, -823546, -838770, -853972, -869152,
+	-884311, -899448, -914564, -929658, -944731, -959783, -974813, -989822,
+	-1004810, -1019777, -1034723, -1049648, -1064552, -1079435, -1094298, -1109140,
+	-1123961, -1138762, -1153542, -1168302, -1183042, -1197761, -1212460, -1227139,
+	-1241798, -1256436, -1271055, -1285654, -1300233, -1314792, -1329332, -1343852,
+	-1358352, -1372833, -1387294, -1401736, -1416158, -1430561, -1444945, -1459309,
+	-1473655, -1487981, -1502288, -1516577, -1530846, -1545097, -1559328, -1573541,
+	-1587736, -1601911, -1616068, -1630207, -1644327, -1658428, -1672511, -1686576,
+	-1700623, -1714651, -1728662, -1742654, -1756628, -1770584, -1784522, -1798442,
+	-1812344, -1826229, -1840096, -1853945, -1867776, -1881590, -1895386, -1909165,
+	-1922927,
+};
+
+// (a << 24) / b without 64 bit division, a < 2^17
+// two 32 bit divisions: 14 bits of quotient, then 10 more from remainder
+static uint32_t ratio(uint32_t a, uint32_t b)
+{
+	const uint32_t q = (a << 14) / b;
+	const uint32_t r = (a << 14) % b;
+	return (q << 10) | ((r << 10) / b);
+}
+
+int32_t altitude(int32_t pressure, int32_t sea_level)
+{
+	if ((pressure < 0) || (sea_level <= 0))
+	{
+		return ALTITUDE_ERROR;
+	}
+
+	const uint32_t r = ratio(pressure, sea_level);
+	const uint32_t max = RATIO_MIN + ((uint32_t)(TABLE_SIZE - 1) << STEP_SHIFT);
+
+	if (r <= RATIO_MIN)
+	{
+		return table[0];
+	}
+	if (r >= max)
+	{
+		return table[TABLE_SIZE - 1];
+	}
+
+	const uint32_t offset = r - RATIO_MIN;
+	const uint32_t i      = offset >> STEP_SHIFT;
+	const int32_t  frac   = offset & ((1 << STEP_SHIFT) - 1);
+	// difference of 2 entries is < 2^16 mm, frac < 2^15: fits to int32_t
+	return table[i] + (((table[i + 1] - table[i]) * frac) >> STEP_SHIFT);
+}
+
+int32_t sea_level(int32_t pressure, int32_t altitude_mm)
+{
+	// table is decreasing: find i with table[i] >= h > table[i + 1]
+	uint16_t lo = 0;
+	uint16_t hi = TABLE_SIZE - 1;
+
+	if (altitude_mm >= table[0])
+	{
+		hi = 1;
+		altitude_mm = table[0];
+	}
+	else if (altitude_mm <= table[TABLE_SIZE - 1])
+	{
+		lo = TABLE_SIZE - 2;
+		altitude_mm = table[TABLE_SIZE - 1];
+	}
+
+	while ((hi - lo) > 1)
+	{
+		const uint16_t mid = (lo + hi) / 2;
+		if (table[mid] >= altitude_mm)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	// linear interpolation of ratio between lo and lo + 1
+	const uint32_t span = table[lo] - table[lo + 1];
+	const uint32_t frac = ((uint32_t)(table[lo] - altitude_mm) << STEP_SHIFT) / span;
+	const uint32_t r    = RATIO_MIN + ((uint32_t)lo << STEP_SHIFT) + frac;
+
+	// p0 = p / r, rounded
+	return (((uint64_t)pressure << RATIO_SHIFT) + r / 2) / r;
+}
+
+} // namespace
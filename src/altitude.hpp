@@ -0,0 +1,31 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200215
+// barometric altitude without float and libm
+//
+// h = 44330 * (1 - (p / p0)^(1 / 5.255)), international standard atmosphere
+// table of h over ratio p / p0 with linear interpolation: error < 0.05 m
+// in whole BMP180 range (300 .. 1100 hPa). altitude() needs 2 32 bit
+// divisions and about 30 other instructions, sea_level() is a binary search
+// in table (9 steps) and one 64 bit division
+
+#ifndef ALTITUDE_H
+#define ALTITUDE_H
+
+#include <stdint.h>
+
+#define ALTITUDE_SEA_LEVEL_PA	101325	// standard pressure at sea level
+#define ALTITUDE_ERROR			INT32_MIN	// pressure < 0 or sea level <= 0
+
+namespace altitude
+{
+// altitude in mm for pressure and sea level pressure in Pa
+// ratio is limited to 0.25 .. 1.25 (about 10 km .. -1.8 km)
+// ALTITUDE_ERROR for pressures which are not physical
+int32_t altitude(int32_t pressure, int32_t sea_level);
+
+// inverse: sea level pressure in Pa from pressure at known altitude in mm
+int32_t sea_level(int32_t pressure, int32_t altitude_mm);
+
+} // namespace
+
+#endif // ALTITUDE_H
@@ -8,7 +8,10 @@
 #endif // DEBUG_BARO
 
 #include "baro.hpp"
+#include "i2c-bus.hpp"
 #include "debug.h"
+#include "delay.h"		// delay_us_to_ticks()
+#include "n200_func.h"	// get_timer_value()
 // #include "gd32vf103_i2c.h"
 #ifdef SHELL
 #include "shell-cmd.hpp"
@@ -17,19 +20,23 @@
 namespace baro
 {
 	static void write_reg(uint8_t reg, uint8_t data);
+	static i2c::Error read_regs(uint8_t reg, uint8_t* data, uint8_t n);
 	static uint16_t read_reg(uint8_t reg);
-	static void calibration(void);
+	static bool calibration(void);
 	static uint16_t get_ut(void);
-	static uint16_t get_up(void);
+	static int32_t get_up(void);
 
 	using namespace i2c;
-	static i2c::Device dev = i2c::Device::wrong;
 	static bool bmp_initialized = 0;
 
 #define BARO_ADDR	0xEE
+
+	static i2c_bus::Client client = {i2c::Device::wrong, BARO_ADDR, i2c::Speed::Speed400kHz, i2c::DutyCycle::Duty2};
 #define REG_ID		0xD0
 #define REG_RESET	0xE0	// WO register
 
+#define REG_CALIB				0xAA	// 22 bytes: AC1 .. MD, MSB first
+#define CALIB_SIZE				22
 #define REG_MSB					0xF6
 #define REG_CONTROL				0xF4
 #define CMD_GET_TEMPERATURE		0x2E
@@ -38,14 +45,17 @@ namespace baro
 #define CMD_GET_PRESSURE_OSS2	0xB4
 #define CMD_GET_PRESSURE_OSS3	0xF4
 
-// #define OSS						1
-// #define CMD_OSS					CMD_GET_PRESSURE_OSS1
-#define OSS						0
-#define CMD_OSS					CMD_GET_PRESSURE_OSS0
+#define CMD_OSS(oss)			(CMD_GET_PRESSURE_OSS0 | ((oss) << 6))
+
+// max conversion time from datasheet, in us
+#define CONVERSION_TEMPERATURE_US	4500
+static const uint16_t conversion_pressure_us[BARO_OSS_MAX + 1] = {4500, 7500, 13500, 25500};
+
+static uint8_t oss = 0;		// oversampling setting: 2^oss internal samples
+static Filter filter_type = Filter::None;
+static uint8_t filter_n = 1;
 
-// no need (nor support, for now) for pow()
-// TODO: 2^15 = 1 << 15
-#define pow(base,exp)	(1 << (exp+1))
+// no need (nor support) for pow(), see altitude.hpp for altitude
 #define pow2_4  16		// pow(2,4)
 #define pow2_11 2048	// pow(2,11)
 #define pow2_12 4096	// pow(2,12)
@@ -70,54 +80,65 @@ static int16_t  MD;
 // ----------------------------------------------------------------------------
 static void write_reg(uint8_t reg, uint8_t data)
 {
-	ack(dev);
-	start(dev);
-	send_addr(dev, BARO_ADDR, Mode::Write);
-	write(dev, reg);
-	write(dev, data);
-	stop(dev);
+	i2c_bus::write(&client, &reg, 1, &data, 1);
 }
 // ------------------------------------------------------------------------ }}}
 // read																		{{{
 // ----------------------------------------------------------------------------
-static uint16_t read_reg(uint8_t reg)
+// n consecutive registers in one transaction, register address is
+// incremented by the sensor
+static i2c::Error read_regs(uint8_t reg, uint8_t* data, uint8_t n)
 {
-	uint16_t received = 0;
-	uint8_t receivedH = 0;
-	uint8_t receivedL = 0;
+	return i2c_bus::read(&client, &reg, 1, data, n);
+}
 
-	start(dev);
-	send_addr(dev, BARO_ADDR, Mode::Write);
-	write(dev, reg);
+static uint16_t read_reg(uint8_t reg)
+{
+	uint8_t received[2] = {0};
 
-	restart(dev);
-	send_addr(dev, BARO_ADDR, Mode::Read);
-	ack(dev);
-	receivedH = read(dev);
-	nack(dev);
-	nack_position(dev, NackPosition::Current);
-	receivedL = read(dev);
-	stop(dev);
+	read_regs(reg, received, 2);
 
-	received = (receivedH << 8) | receivedL;
-	return received;
+	return (received[0] << 8) | received[1];
 }
 // ------------------------------------------------------------------------ }}}
 // calibration																{{{
 // ----------------------------------------------------------------------------
-static void calibration(void)
-{
-	AC1 = read_reg(0xAA);
-	AC2 = read_reg(0xAC);
-	AC3 = read_reg(0xAE);
-	AC4 = read_reg(0xB0);
-	AC5 = read_reg(0xB2);
-	AC6 = read_reg(0xB4);
-	B1  = read_reg(0xB6);
-	B2  = read_reg(0xB8);
-	MB  = read_reg(0xBA);
-	MC  = read_reg(0xBC);
-	MD  = read_reg(0xBE);
+static uint16_t calib_word(const uint8_t* data, uint8_t i)
+{
+	return (data[2 * i] << 8) | data[2 * i + 1];
+}
+
+// one burst of 22 bytes, returns 0 if sensor doesn't respond or data
+// is not valid (datasheet: no word is 0x0000 or 0xFFFF)
+static bool calibration(void)
+{
+	uint8_t data[CALIB_SIZE] = {0};
+
+	if (read_regs(REG_CALIB, data, CALIB_SIZE) != Error::Ok)
+	{
+		return 0;
+	}
+
+	for (uint8_t i = 0; i < CALIB_SIZE / 2; i++)
+	{
+		const uint16_t word = calib_word(data, i);
+		if ((word == 0x0000) || (word == 0xFFFF))
+		{
+			return 0;
+		}
+	}
+
+	AC1 = calib_word(data, 0);
+	AC2 = calib_word(data, 1);
+	AC3 = calib_word(data, 2);
+	AC4 = calib_word(data, 3);
+	AC5 = calib_word(data, 4);
+	AC6 = calib_word(data, 5);
+	B1  = calib_word(data, 6);
+	B2  = calib_word(data, 7);
+	MB  = calib_word(data, 8);
+	MC  = calib_word(data, 9);
+	MD  = calib_word(data, 10);
 
 	dprintf("AC1: %d\r\n", AC1);
 	dprintf("AC2: %d\r\n", AC2);
@@ -130,6 +151,7 @@ static void calibration(void)
 	dprintf("MB:  %d\r\n", MB);
 	dprintf("MC:  %d\r\n", MC);
 	dprintf("MD:  %d\r\n", MD);
+	return 1;
 }
 // ------------------------------------------------------------------------ }}}
 // get UT						 											{{{
@@ -144,12 +166,20 @@ static uint16_t get_ut(void)
 // ------------------------------------------------------------------------ }}}
 // get UP																	{{{
 // ----------------------------------------------------------------------------
-static uint16_t get_up(void)
+// up to 19 bits: MSB, LSB, XLSB >> (8 - oss)
+static int32_t raw_up(const uint8_t data[3], uint8_t oss)
 {
-	write_reg(REG_CONTROL, CMD_OSS);
-	delay_ms(8);		// max 7.5 ms
-	uint16_t up = read_reg(REG_MSB);
-	return up;
+	return (((uint32_t)data[0] << 16) | (data[1] << 8) | data[2]) >> (8 - oss);
+}
+
+static int32_t get_up(void)
+{
+	uint8_t received[3] = {0};
+
+	write_reg(REG_CONTROL, CMD_OSS(oss));
+	delay_ms((conversion_pressure_us[oss] + 999) / 1000);
+	read_regs(REG_MSB, received, 3);
+	return raw_up(received, oss);
 }
 // ------------------------------------------------------------------------ }}}
 
@@ -157,22 +187,15 @@ static uint16_t get_up(void)
 // ----------------------------------------------------------------------------
 void init(i2c::Device arg_dev)
 {
-	dev = arg_dev;
-
-	using namespace gpio;
-	rcu_periph_clock_enable(RCU_GPIOB);
-	rcu_periph_clock_enable(RCU_AF);
-	rcu_periph_clock_enable(RCU_I2C0);
-	gpio_init2(PB6, AfioOD, Speed50MHz);	// SCL
-	gpio_init2(PB7, AfioOD, Speed50MHz);	// SDA
-
-	// i2c_clock_config(I2C0, 100000, I2C_DTCY_2);
-	// i2c_enable(I2C0);
-	init(arg_dev, i2c::Speed::Speed400kHz, i2c::DutyCycle::Duty2);
+	client.bus = arg_dev;
+	i2c_bus::init(arg_dev);
 	bmp_initialized = 1;
 
 	delay_ms(10);	// start up time
-	calibration();
+	if (calibration() == 0)
+	{
+		eprintf("BMP180 calibration is not valid\r\n");
+	}
 }
 // ------------------------------------------------------------------------ }}}
 // reset																	{{{
@@ -187,56 +210,48 @@ void reset(void)
 uint8_t get_id(void)
 {
 	// should return 0x55
-	using namespace i2c;
-	start(dev);
-	send_addr(dev, BARO_ADDR, Mode::Write);
-	write(dev, REG_ID);
-	restart(dev);
-	send_addr(dev, BARO_ADDR, Mode::Read);
-	uint8_t id = read(dev);
-	stop(dev);
+	uint8_t id = 0;
+	read_regs(REG_ID, &id, 1);
 
 	return id;
 }
 // ------------------------------------------------------------------------ }}}
-// get temperature															{{{
+// compensation																{{{
 // ----------------------------------------------------------------------------
-uint16_t get_temperature(void)	// temperature / 10 = temperature in °C
+// B5 depends only on temperature, it is shared by temperature and pressure
+static int32_t calc_b5(int32_t UT)
 {
-	uint16_t UT = get_ut();
-
 	int32_t X1 = (UT - AC6) * AC5 / pow2_15;
 	int32_t X2 = MC * pow2_11 / (X1 + MD);
 	int32_t B5 = X1 + X2;
-	int32_t t = (B5 + 8) / pow2_4;
 	dprintf("X1: %d\r\n", X1);
 	dprintf("X2: %d\r\n", X2);
 	dprintf("B5: %d\r\n", B5);
+
+	return B5;
+}
+
+static int16_t calc_temperature(int32_t B5)	// temperature / 10 = temperature in °C
+{
+	int32_t t = (B5 + 8) / pow2_4;
 	dprintf("t: %d\r\n", t);
 	dprintf("t: %d\r\n", t/10);
 
 	return t;
 }
-// ------------------------------------------------------------------------ }}}
-// get pressure																{{{
-// ----------------------------------------------------------------------------
-int32_t get_pressure(void)	// return pressure in Pa
+
+static int32_t calc_pressure(int32_t UP, int32_t B5, uint8_t OSS)	// return pressure in Pa
 {
 	// Average sea-level pressure is 101.325 kPa (1013.25 hPa or mbar) or 29.92 inches (inHg) or 760 millimetres of mercury (mmHg).
+	int32_t  X1;
+	int32_t  X2;
 	int32_t  X3;
 	int32_t  B3;
 	uint32_t B4;
 	int32_t  B6;
 	uint32_t B7;
-
-	int32_t UP = get_up();
 	int32_t p;
 
-	uint32_t UT = get_ut();
-	int32_t X1 = (UT - AC6) * AC5 / pow2_15;
-	int32_t X2 = MC * pow2_11 / (X1 + MD);
-	int32_t B5 = X1 + X2;
-
 	B6 = B5 - 4000;
 	dprintf("B6: %d\r\n", B6);
 	X1 = (B2 * ((B6 * B6) >> 12)) >> 11;
@@ -281,6 +296,351 @@ int32_t get_pressure(void)	// return pressure in Pa
 	return p;
 }
 // ------------------------------------------------------------------------ }}}
+// get temperature															{{{
+// ----------------------------------------------------------------------------
+uint16_t get_temperature(void)	// temperature / 10 = temperature in °C
+{
+	return calc_temperature(calc_b5(get_ut()));
+}
+// ------------------------------------------------------------------------ }}}
+// get pressure																{{{
+// ----------------------------------------------------------------------------
+int32_t get_pressure(void)	// return pressure in Pa
+{
+	int32_t UP = get_up();
+	int32_t B5 = calc_b5(get_ut());
+
+	return calc_pressure(UP, B5, oss);
+}
+// ------------------------------------------------------------------------ }}}
+// sampler																	{{{
+// ----------------------------------------------------------------------------
+// conversions are started and read with queued I2C transactions, conversion
+// time is waited for without blocking: each call of sampler_process() only
+// checks time or status of the transaction and returns
+enum class State: uint8_t
+{
+	Stopped = 0,
+	StartTemperature,	// write CMD_GET_TEMPERATURE
+	WaitTemperature,	// conversion is running
+	ReadTemperature,	// read UT
+	StartPressure,
+	WaitPressure,
+	ReadPressure,
+	Retry,				// wait after I2C error
+};
+
+typedef struct
+{
+	State					state;
+	i2c_bus::Transaction	t;
+	uint8_t					tx;			// command for REG_CONTROL
+	uint8_t					rx[3];
+	uint8_t					oss;		// of running pressure conversion
+	uint64_t				ready;		// mtime when conversion is done
+	uint64_t				temp_period;	// in mtime ticks
+	int32_t					b5;
+	uint64_t				b5_time;
+	int32_t					acc;		// filter: sum or IIR state (4 fractional bits)
+	uint8_t					nacc;		// filter: samples in acc
+	Sample					sample;		// latest
+	volatile uint32_t		published;	// +1 before and after sample is updated
+	SamplerStats			stats;
+} Sampler;
+
+static Sampler s;
+
+// sample is not volatile: fences keep its accesses between updates of
+// published, on both sides
+#define SAMPLE_FENCE()	__atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+#define BARO_RETRY_MS				10
+
+static void sampler_submit(uint8_t reg, const uint8_t* tx, uint8_t ntx, uint8_t* rx, uint8_t nrx)
+{
+	i2c_bus::Transaction* t = &s.t;
+
+	t->client     = &client;
+	t->cmd[0]     = reg;
+	t->ncmd       = 1;
+	t->tx         = tx;
+	t->ntx        = ntx;
+	t->rx         = rx;
+	t->nrx        = nrx;
+	t->priority   = i2c_bus::Priority::Normal;
+	t->timeout_ms = I2C_BUS_TIMEOUT_MS;
+	t->callback   = NULL;
+	t->arg        = NULL;
+	i2c_bus::submit(t);
+}
+
+static void sampler_start_conversion(uint8_t cmd)
+{
+	s.tx = cmd;
+	sampler_submit(REG_CONTROL, &s.tx, 1, NULL, 0);
+}
+
+// returns 1 when last submitted transaction is finished without error
+// on error cycle starts again with temperature, after BARO_RETRY_MS
+static bool sampler_done(void)
+{
+	if (s.t.status == i2c_bus::Status::Queued)
+	{
+		i2c_bus::process(client.bus);	// bus is polled, not interrupt driven
+	}
+
+	switch (s.t.status)
+	{
+		case i2c_bus::Status::Done:
+			return 1;
+		case i2c_bus::Status::Queued:
+			return 0;	// other transaction with higher priority was done
+		default:
+			break;
+	}
+
+	s.stats.errors++;
+	s.ready = get_timer_value() + delay_ms_to_ticks(BARO_RETRY_MS);
+	s.state = State::Retry;
+	return 0;
+}
+
+// returns 1 if filtered pressure is ready
+static bool sampler_filter(int32_t p, int32_t* result)
+{
+	switch (filter_type)
+	{
+		case Filter::Average:
+			// decimation: mean of filter_n samples, then start again
+			s.acc += p;
+			if (++s.nacc < filter_n)
+			{
+				return 0;
+			}
+			*result = (s.acc + filter_n / 2) / filter_n;
+			s.acc  = 0;
+			s.nacc = 0;
+			return 1;
+
+		case Filter::Iir:
+			// acc += (p - acc) / 2^filter_n
+			if (s.nacc == 0)
+			{
+				s.acc  = p << 4;
+				s.nacc = 1;
+			}
+			else
+			{
+				s.acc += ((p << 4) - s.acc) >> filter_n;
+			}
+			*result = (s.acc + 8) >> 4;
+			return 1;
+
+		default:
+			*result = p;
+			return 1;
+	}
+}
+
+static bool sampler_publish(int32_t up, uint64_t now)
+{
+	int32_t pressure;
+	if (sampler_filter(calc_pressure(up, s.b5, s.oss), &pressure) == 0)
+	{
+		return 0;
+	}
+
+	s.published++;
+	SAMPLE_FENCE();
+	s.sample.time        = now;
+	s.sample.temp_time   = s.b5_time;
+	s.sample.temperature = calc_temperature(s.b5);
+	s.sample.pressure    = pressure;
+	s.sample.seq++;
+	SAMPLE_FENCE();
+	s.published++;
+	return 1;
+}
+
+void sampler_start(uint16_t temp_period_ms)
+{
+	ASSERT(bmp_initialized);
+
+	sampler_stop();
+	s = {};
+	s.temp_period = delay_ms_to_ticks(temp_period_ms);
+	s.state = State::StartTemperature;
+}
+
+void sampler_stop(void)
+{
+	// transaction which is still queued is finished first, it points to s.t
+	while (s.t.status == i2c_bus::Status::Queued)
+	{
+		i2c_bus::process(client.bus);
+	}
+	s.state = State::Stopped;
+}
+
+// conversion is waited for when write of the command is done
+static bool sampler_wait(uint32_t conversion_us, uint8_t nrx)
+{
+	if (s.ready == 0)
+	{
+		if (sampler_done() == 0)
+		{
+			return 0;
+		}
+		s.ready = get_timer_value() + delay_us_to_ticks(conversion_us);
+	}
+	if (get_timer_value() < s.ready)
+	{
+		return 0;
+	}
+
+	sampler_submit(REG_MSB, NULL, 0, s.rx, nrx);
+	return 1;
+}
+
+// one step of state machine, returns 1 if state was changed
+static bool sampler_step(bool* published)
+{
+	const State state = s.state;
+
+	switch (state)
+	{
+		case State::Stopped:
+			break;
+
+		case State::StartTemperature:
+			sampler_start_conversion(CMD_GET_TEMPERATURE);
+			s.ready = 0;
+			s.state = State::WaitTemperature;
+			break;
+
+		case State::WaitTemperature:
+			if (sampler_wait(CONVERSION_TEMPERATURE_US, 2))
+			{
+				s.state = State::ReadTemperature;
+			}
+			break;
+
+		case State::ReadTemperature:
+			if (sampler_done())
+			{
+				s.b5      = calc_b5((s.rx[0] << 8) | s.rx[1]);
+				s.b5_time = get_timer_value();
+				s.stats.temperatures++;
+				s.state = State::StartPressure;
+			}
+			break;
+
+		case State::StartPressure:
+			s.oss = oss;	// can be changed at any time
+			sampler_start_conversion(CMD_OSS(s.oss));
+			s.ready = 0;
+			s.state = State::WaitPressure;
+			break;
+
+		case State::WaitPressure:
+			if (sampler_wait(conversion_pressure_us[s.oss], 3))
+			{
+				s.state = State::ReadPressure;
+			}
+			break;
+
+		case State::ReadPressure:
+			if (sampler_done())
+			{
+				const uint64_t now = get_timer_value();
+				*published |= sampler_publish(raw_up(s.rx, s.oss), now);
+				s.stats.pressures++;
+
+				// B5 is reused until temperature is too old
+				s.state = ((now - s.b5_time) >= s.temp_period) ? State::StartTemperature : State::StartPressure;
+			}
+			break;
+
+		case State::Retry:
+			if (get_timer_value() >= s.ready)
+			{
+				s.state = State::StartTemperature;
+			}
+			break;
+	}
+
+	return (s.state != state);
+}
+
+// mtime when sampler_process() has work: end of conversion or retry wait,
+// 0 = now (transaction is queued), UINT64_MAX = stopped
+uint64_t sampler_next_mtime(void)
+{
+	switch (s.state)
+	{
+		case State::Stopped:
+			return UINT64_MAX;
+		case State::WaitTemperature:
+		case State::WaitPressure:
+		case State::Retry:
+			return s.ready;		// 0 while command is not written yet
+		default:
+			return 0;
+	}
+}
+
+bool sampler_process(void)
+{
+	bool published = 0;
+	while (sampler_step(&published));
+	return published;
+}
+
+// sampler can run in interrupt (timer), reader is in main loop or thread:
+// an interrupt which preempted sampler_publish() would spin here forever
+bool get_sample(Sample* sample)
+{
+	uint32_t published;
+	do
+	{
+		published = s.published;
+		SAMPLE_FENCE();
+		*sample = s.sample;
+		SAMPLE_FENCE();
+	} while ((published != s.published) || (published & 1));
+
+	return (sample->seq != 0);
+}
+
+const SamplerStats* get_sampler_stats(void)
+{
+	return &s.stats;
+}
+// ------------------------------------------------------------------------ }}}
+// oversampling and filter													{{{
+// ----------------------------------------------------------------------------
+void set_oss(uint8_t arg_oss)
+{
+	ASSERT(arg_oss <= BARO_OSS_MAX);
+	oss = arg_oss;
+}
+
+uint8_t get_oss(void)
+{
+	return oss;
+}
+
+void set_filter(Filter filter, uint8_t n)
+{
+	ASSERT(n != 0);
+	ASSERT((filter != Filter::Iir) || (n <= 8));
+
+	filter_type = filter;
+	filter_n    = n;
+	s.acc  = 0;
+	s.nacc = 0;
+}
+// ------------------------------------------------------------------------ }}}
 
 void example(i2c::Device arg_dev)
 {
@@ -289,7 +649,7 @@ void example(i2c::Device arg_dev)
 	printf("baro ID: 0x%x\r\n", get_id());
 
 	uint16_t ut = get_ut();
-	uint16_t up = get_up();
+	int32_t up = get_up();
 	int16_t temp = get_temperature() / 10;
 	int16_t temp_dec = get_temperature() % 10;
 	int32_t pressure = get_pressure();
@@ -311,7 +671,7 @@ uint8_t cmd(char *argv[])
 	uint16_t ut = get_ut();
 	int16_t temp = get_temperature() / 10;
 	int16_t temp_dec = get_temperature() % 10;
-	uint16_t up = get_up();
+	int32_t up = get_up();
 	int32_t pressure = get_pressure();
 	printf("BMP UT: %d t:%d.%d°C UP: %d pressure: %d hPa\r\n", ut, temp, temp_dec, up, pressure / 100);
 
@@ -7,6 +7,12 @@
 
 #include "i2c.hpp"
 
+#define BARO_OSS_MAX			3
+
+#ifndef BARO_TEMP_PERIOD_MS
+#define BARO_TEMP_PERIOD_MS		1000	// B5 of temperature is reused by pressure samples
+#endif
+
 namespace baro
 {
 void init(i2c::Device arg_dev);
@@ -15,6 +21,50 @@ uint8_t get_id(void);
 uint16_t get_temperature(void);	// temperature / 10 = temperature in °C
 int32_t get_pressure(void);		// returns pressure in Pa
 
+// oversampling: 2^oss internal samples, conversion 4.5, 7.5, 13.5, 25.5 ms
+void set_oss(uint8_t oss);		// 0 .. BARO_OSS_MAX
+uint8_t get_oss(void);
+
+// pressure filter of sampler
+enum class Filter: uint8_t
+{
+	None = 0,
+	Average,	// mean of n samples, every n-th sample is published (decimation)
+	Iir,		// p += (new - p) / 2^n, every sample is published, n = 1 .. 8
+};
+void set_filter(Filter filter, uint8_t n);
+
+// non-blocking sampler														{{{
+// ----------------------------------------------------------------------------
+// back to back conversions, rate is limited only by conversion time. Call
+// sampler_process() from main loop or timer, it never waits for conversion;
+// sampler_next_mtime() tells when it has work again, e.g. for a one shot
+// swtimer. Temperature is measured again when it is older than
+// temp_period_ms.
+typedef struct
+{
+	uint64_t	time;			// mtime when pressure was read
+	uint64_t	temp_time;		// mtime when temperature was read
+	int32_t		pressure;		// Pa
+	int16_t		temperature;	// temperature / 10 = temperature in °C
+	uint32_t	seq;			// +1 for each sample, 0 = no sample yet
+} Sample;
+
+typedef struct
+{
+	uint32_t	temperatures;	// conversions
+	uint32_t	pressures;
+	uint32_t	errors;			// I2C errors, cycle is restarted
+} SamplerStats;
+
+void sampler_start(uint16_t temp_period_ms);	// BARO_TEMP_PERIOD_MS is a good default
+void sampler_stop(void);
+bool sampler_process(void);			// returns 1 when new sample is published
+uint64_t sampler_next_mtime(void);	// 0 = now, UINT64_MAX = stopped
+bool get_sample(Sample* sample);	// latest sample, 0 if none yet; not from interrupt
+const SamplerStats* get_sampler_stats(void);
+// ------------------------------------------------------------------------ }}}
+
 void example(i2c::Device arg_dev);
 uint8_t cmd(char *argv[]);
 
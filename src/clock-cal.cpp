@@ -0,0 +1,171 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200218
+
+// #define DEBUG_CLOCK_CAL
+#ifndef DEBUG_CLOCK_CAL
+#undef DEBUG
+#endif // DEBUG_CLOCK_CAL
+
+#include "clock-cal.hpp"
+#include "rtc.hpp"
+#include "uart.hpp"
+#include "delay.h"
+#include "debug.h"
+#include "gd32vf103.h"		// SystemCoreClock for TIMER_FREQ
+#include "gd32vf103_bkp.h"
+#include "n200_func.h"		// get_timer_value()
+
+namespace clock_cal
+{
+
+// backup registers: magic, frequency high, frequency low
+#define BKP_MAGIC		BKP_DATA_1
+#define BKP_HZ_HIGH		BKP_DATA_2
+#define BKP_HZ_LOW		BKP_DATA_3
+#define MAGIC			0xCA1B
+
+typedef struct
+{
+	uint64_t	rtc_us;
+	uint64_t	mtime;
+} Point;
+
+static Point start;
+static uint32_t mtime_hz;		// 0 = not calibrated
+static int64_t mtime_hz_x16;	// filtered, 4 fractional bits
+
+// both clocks as close together as possible
+static void read_point(Point* p)
+{
+	p->rtc_us = rtc::now_us();
+	p->mtime  = get_timer_value();
+}
+
+static bool plausible(uint32_t hz)
+{
+	const int64_t error = (int64_t)hz - TIMER_FREQ;
+	const int64_t limit = (int64_t)TIMER_FREQ * CLOCK_CAL_LIMIT_PPM / 1000000;
+	return (error <= limit) && (error >= -limit);
+}
+
+static void apply(uint32_t hz)
+{
+	mtime_hz = hz;
+	delay_set_timer_hz(hz);
+	uart::set_clock_ppm(get_ppm());
+}
+
+void init(void)
+{
+	read_point(&start);
+
+	if (bkp_data_read(BKP_MAGIC) == MAGIC)
+	{
+		const uint32_t hz = (bkp_data_read(BKP_HZ_HIGH) << 16) | bkp_data_read(BKP_HZ_LOW);
+		if (plausible(hz))
+		{
+			mtime_hz_x16 = (int64_t)hz << 4;
+			apply(hz);
+			dprintf("clock_cal: %d Hz from backup registers\r\n", hz);
+		}
+	}
+}
+
+void restart(void)
+{
+	read_point(&start);
+}
+
+bool update(void)
+{
+	// cheap check with mtime first, RTC is read only at end of window
+	if ((get_timer_value() - start.mtime) < (uint64_t)CLOCK_CAL_WINDOW_S * TIMER_FREQ)
+	{
+		return 0;
+	}
+
+	Point end;
+	read_point(&end);
+	const uint64_t rtc_us = end.rtc_us - start.rtc_us;
+	const uint64_t ticks  = end.mtime - start.mtime;
+	start = end;
+	if (rtc_us == 0)
+	{
+		return 0;	// RTC is not running
+	}
+
+	const uint32_t measured = (ticks * 1000000 + rtc_us / 2) / rtc_us;
+	if (!plausible(measured))
+	{
+		dprintf("clock_cal: %d Hz dropped, RTC written or mtime stopped\r\n", measured);
+		return 0;	// next window starts at end
+	}
+
+	// first one as it is, then slow filter: 1/4 of each new window
+	if (mtime_hz_x16 == 0)
+	{
+		mtime_hz_x16 = (int64_t)measured << 4;
+	}
+	else
+	{
+		mtime_hz_x16 += (((int64_t)measured << 4) - mtime_hz_x16) / 4;
+	}
+	const uint32_t hz = (mtime_hz_x16 + 8) >> 4;
+	apply(hz);
+
+	bkp_data_write(BKP_HZ_HIGH, hz >> 16);
+	bkp_data_write(BKP_HZ_LOW, hz & 0xFFFF);
+	bkp_data_write(BKP_MAGIC, MAGIC);
+
+	dprintf("clock_cal: measured %d Hz, filtered %d Hz (%d ppm)\r\n", measured, hz, get_ppm());
+	return 1;
+}
+
+bool is_calibrated(void)
+{
+	return (mtime_hz != 0);
+}
+
+uint32_t get_mtime_hz(void)
+{
+	return (mtime_hz != 0) ? mtime_hz : TIMER_FREQ;
+}
+
+uint32_t get_core_hz(void)
+{
+	return get_mtime_hz() * 4;
+}
+
+int32_t get_ppm(void)
+{
+	const int64_t nominal = TIMER_FREQ;
+	return ((int64_t)get_mtime_hz() - nominal) * 1000000 / nominal;
+}
+
+uint64_t ticks_to_us(uint64_t ticks)
+{
+	const uint32_t hz = get_mtime_hz();
+	// split to avoid overflow of ticks * 1000000 after about 7 days
+	return (ticks / hz) * 1000000 + ((ticks % hz) * 1000000) / hz;
+}
+
+void set_rtc_trim(uint8_t steps)
+{
+	ASSERT(steps < 128);
+	bkp_rtc_calibration_value_set(steps);
+}
+
+void example(void)
+{
+	init();
+	printf("clock_cal: %d Hz (%d ppm), every %d s\r\n", get_mtime_hz(), get_ppm(), CLOCK_CAL_WINDOW_S);
+	while (1)
+	{
+		if (update())
+		{
+			printf("clock_cal: %d Hz (%d ppm)\r\n", get_mtime_hz(), get_ppm());
+		}
+	}
+}
+
+} // namespace
@@ -0,0 +1,48 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200218
+// mtime (SystemCoreClock / 4, PLL from IRC8M, +-1 % and temperature drift)
+// measured against RTC (32.768 kHz LXTAL crystal, +-20 ppm)
+//
+// start and end of each window are read as (RTC time with DIV, mtime)
+// pairs, so 30.5 us RTC resolution gives 0.5 ppm in 64 s window. Measured
+// frequency is kept in backup registers, it is valid right after reset
+// while backup domain has power.
+// Measured frequency is given to delay_ms() and UART baud rate
+// calculation, ticks_to_us() corrects timestamps.
+// Window which gives frequency further than CLOCK_CAL_LIMIT_PPM from
+// nominal is dropped: RTC counter was written or mtime was stopped (deep
+// sleep). Only checked values are applied and kept in backup registers.
+
+#ifndef CLOCK_CAL_H
+#define CLOCK_CAL_H
+
+#include <stdint.h>
+
+#ifndef CLOCK_CAL_WINDOW_S
+#define CLOCK_CAL_WINDOW_S		64
+#endif
+#define CLOCK_CAL_LIMIT_PPM		20000	// IRC8M is +-1 %
+
+namespace clock_cal
+{
+
+// RTC must be initialized (backup domain access)
+void init(void);
+bool update(void);				// from main loop, returns 1 when new measurement is done
+void restart(void);				// new window, after RTC write or deep sleep
+bool is_calibrated(void);
+
+uint32_t get_mtime_hz(void);	// nominal SystemCoreClock / 4 until calibrated
+uint32_t get_core_hz(void);
+int32_t get_ppm(void);			// mtime against nominal frequency
+uint64_t ticks_to_us(uint64_t ticks);
+
+// RTC itself: counter is slowed by steps * 0.954 ppm (0 .. 127), e.g. when
+// crystal was measured on calibration output (PC13, 512 Hz)
+void set_rtc_trim(uint8_t steps);
+
+void example(void);
+
+} // namespace
+
+#endif	// CLOCK_CAL_H
@@ -0,0 +1,18 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200214
+
+#include "crc.h"
+
+// bitwise, no table: used for small records only
+uint16_t crc16(uint16_t crc, const uint8_t* data, uint32_t n)
+{
+	while (n--)
+	{
+		crc ^= (uint16_t)(*data++) << 8;
+		for (uint8_t i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+		}
+	}
+	return crc;
+}
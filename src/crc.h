@@ -0,0 +1,21 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200214
+
+#ifndef CRC_H
+#define CRC_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define CRC16_INIT	0xFFFF
+
+// CRC-16/CCITT-FALSE: poly 0x1021, MSB first, init 0xFFFF
+// can be chained: crc16(crc16(CRC16_INIT, a, na), b, nb)
+uint16_t crc16(uint16_t crc, const uint8_t* data, uint32_t n);
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif // CRC_H
@@ -5,6 +5,7 @@
 #undef DEBUG
 #endif // DEBUG_RTC
 
+#include "date.hpp"
 #include "rtc.hpp"
 #ifdef SHELL
 #include "shell-cmd.hpp"
@@ -20,12 +21,7 @@ using namespace rtc;
 
 const char* days_in_week[] = {"Wrong", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"};
 
-uint32_t days_since_epoch(void)
-{
-	return (rtc::get_counter() / 60 / 60 / 24);
-}
-
-bool is_leap_year(uint32_t year)
+static bool is_leap_year(uint32_t year)
 {
 	// Wikipedia algorithm:
 	// if (year is not divisible by 4) then (it is a common year)
@@ -50,143 +46,195 @@ bool is_leap_year(uint32_t year)
 	}
 }
 
-static const char* get_day_in_week(void)
-{
-	uint8_t n = ((EPOCH_DAY + days_since_epoch()) % 7);
-	return days_in_week[n];
-}
-
 static uint8_t get_days_in_month(uint8_t month, uint32_t year)
 {
-	switch (month)
+	static const uint8_t days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+	if ((month == 2) && is_leap_year(year))
 	{
-		case 1:
-		case 3:
-		case 5:
-		case 7:
-		case 8:
-		case 10:
-		case 12:
-			return 31;
-		case 4:
-		case 6:
-		case 9:
-		case 11:
-			return 30;
-		case 2:
-			if (is_leap_year(year) == 1)
-			{
-				return 29;
-			}
-			else
-			{
-				return 28;
-			}
-		default:
-			eprintf("Wrong month: %d\r\n", month);
-			panic();
+		return 29;
 	}
-	panic();
-	return 13;	// make compiler happy
+	return days[month - 1];
 }
 
+// conversions																{{{
+// ----------------------------------------------------------------------------
+// year starts with March, so leap day is the last day of the year and day
+// of year gives month without table. Era is 400 years = 146097 days.
+// 719468 = days from 1.3.0000 to 1.1.1970
+#define DAYS_0000_TO_1970	719468
+#define DAYS_PER_ERA		146097
 
-void convert_to_string()
+void civil_from_days(uint32_t days, uint16_t* year, uint8_t* month, uint8_t* day)
+{
+	const uint32_t z   = days + DAYS_0000_TO_1970;
+	const uint32_t era = z / DAYS_PER_ERA;
+	const uint32_t doe = z - era * DAYS_PER_ERA;								// 0 .. 146096
+	const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;	// 0 .. 399
+	const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);				// 0 .. 365
+	const uint32_t mp  = (5 * doy + 2) / 153;									// 0 = March
+	const uint8_t  m   = (mp < 10) ? mp + 3 : mp - 9;
+
+	*day   = doy - (153 * mp + 2) / 5 + 1;
+	*month = m;
+	*year  = yoe + era * 400 + (m <= 2);
+}
+
+uint32_t days_from_civil(uint16_t year, uint8_t month, uint8_t day)
 {
-	uint32_t days = days_since_epoch();
-	uint32_t current_year = EPOCH;
-	uint8_t  current_month = 1;
-	uint8_t  current_day = 1;
+	const uint32_t y   = year - (month <= 2);
+	const uint32_t era = y / 400;
+	const uint32_t yoe = y - era * 400;
+	const uint32_t doy = (153 * ((month > 2) ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
 
-	/* printf("days: %d\n", days); */
-	// namjerno nije razdvojeno u posebne funkcije, ovako je jednostavnije jer nema pointera izmedju raznih funkcijica
+	return era * DAYS_PER_ERA + doe - DAYS_0000_TO_1970;
+}
+
+static uint8_t weekday_from_days(uint32_t days)
+{
+	return (EPOCH_DAY - 1 + days) % 7 + 1;
+}
 
-	// calculate year:
-	while (days > 365)
+void from_epoch(uint32_t seconds, Time* time)
+{
+	const uint32_t days = seconds / 86400;
+	const uint32_t secs = seconds % 86400;
+
+	civil_from_days(days, &time->year, &time->month, &time->day);
+	time->epoch   = seconds;
+	time->hour    = secs / 3600;
+	time->min     = (secs / 60) % 60;
+	time->sec     = secs % 60;
+	time->weekday = weekday_from_days(days);
+}
+
+uint32_t to_epoch(const Time* time)
+{
+	return days_from_civil(time->year, time->month, time->day) * 86400 +
+		time->hour * 3600 + time->min * 60 + time->sec;
+}
+// ------------------------------------------------------------------------ }}}
+// cached time																{{{
+// ----------------------------------------------------------------------------
+static Time cache;
+static volatile uint32_t cache_seq;		// odd while cache is updated
+// cache is not volatile: fences keep its accesses between cache_seq updates
+#define CACHE_FENCE()	__atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+// +1 s, carry goes up only at the end of minute, hour, day ...
+static void increment(Time* t)
+{
+	t->epoch++;
+	if (++t->sec < 60)
 	{
-		if (is_leap_year(current_year) == 1)
-		{
-			days -= 366;
-		}
-		else
-		{
-			days -= 365;
-		}
-		current_year++;
+		return;
+	}
+	t->sec = 0;
+	if (++t->min < 60)
+	{
+		return;
+	}
+	t->min = 0;
+	if (++t->hour < 24)
+	{
+		return;
+	}
+	t->hour = 0;
+	t->weekday = (t->weekday % 7) + 1;
+	if (++t->day <= get_days_in_month(t->month, t->year))
+	{
+		return;
+	}
+	t->day = 1;
+	if (++t->month <= 12)
+	{
+		return;
 	}
+	t->month = 1;
+	t->year++;
+}
 
-	// calculate month
-	while (days > 31)
+void init(void)
+{
+	cache_seq++;
+	CACHE_FENCE();
+	from_epoch(get_counter(), &cache);
+	CACHE_FENCE();
+	cache_seq++;
+}
+
+void tick(void)
+{
+	const uint32_t counter = get_counter();
+
+	cache_seq++;
+	CACHE_FENCE();
+	if (counter == cache.epoch + 1)
 	{
-		switch (current_month)
-		{
-			case 1:
-			case 3:
-			case 5:
-			case 7:
-			case 8:
-			case 10:
-			case 12:
-				days -= 31;
-				current_month++;
-				break;
-			case 4:
-			case 6:
-			case 9:
-			case 11:
-				days -= 30;
-				current_month++;
-				break;
-			case 2:
-				if (is_leap_year(current_year) == 1)
-				{
-					days -= 29;
-				}
-				else
-				{
-					days -= 28;
-				}
-				current_month++;
-				break;
-			default:
-				printf("error current_month: %d\r\n", current_month);
-				return;
-		}
+		increment(&cache);
 	}
+	else
+	{
+		// missed second or counter was written
+		from_epoch(counter, &cache);
+	}
+	CACHE_FENCE();
+	cache_seq++;
+}
 
-	// calculate day
-	current_day += days;
-	days = 0;
+void get(Time* time)
+{
+	uint32_t seq;
+	do
+	{
+		seq   = cache_seq;
+		CACHE_FENCE();
+		*time = cache;
+		CACHE_FENCE();
+	} while ((seq != cache_seq) || (seq & 1));
+}
 
-	printf("%s, %d.%d.%d\r\n", get_day_in_week(), current_year, current_month, current_day);
-	// snprintf("%s, %d.%d.%d\r\n", get_day_in_week(), current_year, current_month, current_day);
+void set(const Time* time)
+{
+	rtc::write(to_epoch(time));
+	init();
+}
+// ------------------------------------------------------------------------ }}}
+
+void convert_to_string()
+{
+	Time t;
+	get(&t);
+	printf("%s, %d.%d.%d\r\n", days_in_week[t.weekday], t.year, t.month, t.day);
 }
 
 void print(void)
 {
-	// printf("%s, %d.%d.%d\r\n", get_day_in_week(), current_year, current_month, current_day);
+	Time t;
+	get(&t);
+	printf("%s, %d.%d.%d %02d:%02d:%02d\r\n", days_in_week[t.weekday], t.day, t.month, t.year, t.hour, t.min, t.sec);
 }
 
 uint8_t get_sec(void)
 {
-	uint32_t seconds = get_counter();
-	uint8_t sec  = seconds % 60;
-	return sec;
+	Time t;
+	get(&t);
+	return t.sec;
 }
 
 uint8_t get_min(void)
 {
-	uint32_t seconds = get_counter();
-	uint8_t min  = (seconds / 60) % 60;
-	return min;
+	Time t;
+	get(&t);
+	return t.min;
 }
 
 uint8_t get_hour(void)
 {
-	uint32_t seconds = get_counter();
-	uint8_t hour = (seconds / 60 / 60) % 24;
-
-	return hour;
+	Time t;
+	get(&t);
+	return t.hour;
 }
 
 #ifdef SHELL
@@ -194,16 +242,12 @@ uint8_t cmd(char *argv[])
 {
 	uint8_t argc = get_argc(argv);
 
-	uint32_t seconds = get_counter();
-
-	uint16_t day = (seconds / 60 / 60 / 24) % 365;
-	uint8_t hour = (seconds / 60 / 60) % 24;
-	uint8_t min  = (seconds / 60) % 60;
-	uint8_t sec  = seconds % 60;
+	Time t;
+	get(&t);
 
 	if (argc == 0)
 	{
-		printf("time: day: %d %02d:%02d:%02d\r\n", day, hour, min, sec);
+		printf("time: %02d:%02d:%02d\r\n", t.hour, t.min, t.sec);
 		printf("----------\r\n");
 		print();
 	}
@@ -252,9 +296,10 @@ uint8_t cmd(char *argv[])
 
 			dprintf("sec: %d\r\n", nsec);
 		}
-		uint32_t new_seconds = 0;
-
-		rtc::write(new_seconds);
+		t.hour = nhour;
+		t.min  = nmin;
+		t.sec  = nsec;
+		set(&t);
 	}
 
 	return SHELL_RETURN_OK;
@@ -8,6 +8,33 @@
 
 namespace date
 {
+
+// broken down time, seconds since 1.1.1970 (RTC counter) in UTC
+typedef struct
+{
+	uint32_t	epoch;		// seconds since 1.1.1970
+	uint16_t	year;
+	uint8_t		month;		// 1 .. 12
+	uint8_t		day;		// 1 .. 31
+	uint8_t		hour;
+	uint8_t		min;
+	uint8_t		sec;
+	uint8_t		weekday;	// 1 = Monday .. 7 = Sunday
+} Time;
+
+// constant time conversions (H. Hinnant, "chrono-Compatible Low-Level Date Algorithms")
+uint32_t days_from_civil(uint16_t year, uint8_t month, uint8_t day);	// days since 1.1.1970
+void civil_from_days(uint32_t days, uint16_t* year, uint8_t* month, uint8_t* day);
+void from_epoch(uint32_t seconds, Time* time);
+uint32_t to_epoch(const Time* time);	// year, month, day, hour, min, sec are used
+
+// cached time: converted once at init() and set(), then updated by 1 s in
+// RTC second interrupt, so reading it is a struct copy
+void init(void);
+void tick(void);				// from RTC second interrupt
+void get(Time* time);
+void set(const Time* time);		// writes RTC counter
+
 uint8_t get_sec(void);
 uint8_t get_min(void);
 uint8_t get_hour(void);
@@ -7,6 +7,7 @@
 #include "gd32vf103_rcu.h"
 #endif // MCU_RUN
 #ifdef PC_RUN
+#include <stdlib.h>	// exit()
 #endif // PC_RUN
 
 void assert_early(uint32_t a, uint32_t b)
@@ -71,5 +72,6 @@ void panic(void)
 void panic(void)
 {
 	eprintf("PANIC\r\n");
+	exit(1);	// host tests: failed ASSERT fails the run
 }
 #endif // PC_RUN
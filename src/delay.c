@@ -1,10 +1,179 @@
 #include "delay.h"
 #include "gd32vf103.h"
 #include "n200_func.h"
+#include "gd32vf103_eclic.h"
+#include "riscv_encoding.h"
+
+#define MTIMECMP_LO		REG32(TIMER_CTRL_ADDR + TIMER_MTIMECMP)
+#define MTIMECMP_HI		REG32(TIMER_CTRL_ADDR + TIMER_MTIMECMP + 4)
+
+extern void enable_mcycle_minstret(void);	// start.s
+extern void disable_mcycle_minstret(void);
+
+static uint32_t timer_hz;	// 0 = nominal SystemCoreClock / 4
+static uint8_t timer_irq_enabled;
+static uint8_t counters_users;
+
+// mtimecmp is shared: the earliest of delay_until() and alarm deadlines
+static uint64_t delay_deadline = UINT64_MAX;
+static uint64_t alarm_deadline[DELAY_ALARMS] = {UINT64_MAX, UINT64_MAX};
+static DelayAlarmCallback alarm_callback[DELAY_ALARMS];
+static DelaySleepHook sleep_hook;
+static volatile uint32_t wake_pending;
+
+void delay_set_timer_hz(uint32_t hz)
+{
+	timer_hz = hz;
+}
+
+uint32_t delay_get_timer_hz(void)
+{
+	return (timer_hz != 0) ? timer_hz : SystemCoreClock/4;
+}
+
+uint64_t delay_ms_to_ticks(uint32_t ms)
+{
+	return (uint64_t)ms * delay_get_timer_hz() / 1000;
+}
+
+uint64_t delay_us_to_ticks(uint32_t us)
+{
+	return (uint64_t)us * delay_get_timer_hz() / 1000000;
+}
+
+// mtimecmp is 64 bit, written with 32 bit accesses: low word to max first,
+// so there is no spurious match in between
+static void set_mtimecmp(uint64_t mtime)
+{
+	MTIMECMP_LO = 0xFFFFFFFF;
+	MTIMECMP_HI = mtime >> 32;
+	MTIMECMP_LO = mtime;
+}
+
+// with interrupts disabled
+static void update_mtimecmp(void)
+{
+	if (!timer_irq_enabled)
+	{
+		eclic_irq_enable(CLIC_INT_TMR, 1, 0);
+		timer_irq_enabled = 1;
+	}
+	uint64_t next = delay_deadline;
+	for (uint8_t i = 0; i < DELAY_ALARMS; i++)
+	{
+		if (alarm_deadline[i] < next)
+		{
+			next = alarm_deadline[i];
+		}
+	}
+	set_mtimecmp(next);
+}
+
+// wakes the core from WFI (delay_until() checks the time itself) and calls
+// alarm callback when it is due
+void eclic_mtip_handler(void)
+{
+	const uint64_t now = get_timer_value();
+
+	if (delay_deadline <= now)
+	{
+		delay_deadline = UINT64_MAX;
+	}
+	for (uint8_t i = 0; i < DELAY_ALARMS; i++)
+	{
+		if (alarm_deadline[i] <= now)
+		{
+			alarm_deadline[i] = UINT64_MAX;
+			alarm_callback[i]();	// can set next alarm
+		}
+	}
+	update_mtimecmp();		// clears MTIP
+}
+
+void delay_set_alarm(uint8_t alarm, uint64_t mtime, DelayAlarmCallback callback)
+{
+	const uint32_t status = read_csr(mstatus);
+	clear_csr(mstatus, MSTATUS_MIE);
+	alarm_deadline[alarm] = (callback != NULL) ? mtime : UINT64_MAX;
+	alarm_callback[alarm] = callback;
+	update_mtimecmp();
+	if (status & MSTATUS_MIE)
+	{
+		set_csr(mstatus, MSTATUS_MIE);
+	}
+}
+
+// mintstatus bits 31 .. 24: level of interrupt being handled, 0 in thread
+bool in_interrupt(void)
+{
+	return (read_csr(0x346) >> 24) != 0;
+}
+
+void delay_set_sleep_hook(DelaySleepHook hook)
+{
+	sleep_hook = hook;
+}
+
+void delay_until(uint64_t mtime)
+{
+	// from interrupt handler or with interrupts disabled: spin as before
+	if (in_interrupt() || ((read_csr(mstatus) & MSTATUS_MIE) == 0))
+	{
+		while (get_timer_value() < mtime);
+		return;
+	}
+
+	if ((sleep_hook != NULL) && sleep_hook(mtime))
+	{
+		return;
+	}
+
+	// other interrupt wakes the core too: it is serviced and we sleep again.
+	// Interrupts are disabled between the check and WFI, otherwise timer
+	// interrupt could be handled just before WFI and the core would sleep on;
+	// pending interrupt still ends WFI and is taken after enable
+	while (1)
+	{
+		clear_csr(mstatus, MSTATUS_MIE);
+		if (get_timer_value() >= mtime)
+		{
+			delay_deadline = UINT64_MAX;
+			update_mtimecmp();
+			set_csr(mstatus, MSTATUS_MIE);
+			break;
+		}
+		delay_deadline = mtime;
+		update_mtimecmp();
+		__WFI();
+		set_csr(mstatus, MSTATUS_MIE);
+	}
+}
+
+void delay_wfi(volatile const uint32_t* pending)
+{
+	clear_csr(mstatus, MSTATUS_MIE);
+	if (*pending == 0)
+	{
+		__WFI();
+	}
+	set_csr(mstatus, MSTATUS_MIE);
+}
+
+void delay_wake(void)
+{
+	wake_pending = 1;
+}
+
+void delay_idle(void)
+{
+	delay_wfi(&wake_pending);
+	wake_pending = 0;
+}
 
 void delay_ms(uint32_t count)
 {
-	uint64_t start_mtime, delta_mtime;
+	const uint32_t hz = delay_get_timer_hz();
+	uint64_t start_mtime;
 
 	/* Don't start measuruing until we see an mtime tick */
 	uint64_t tmp = get_timer_value();
@@ -12,7 +181,53 @@ void delay_ms(uint32_t count)
 		start_mtime = get_timer_value();
 	} while (start_mtime == tmp);
 
-	do {
-		delta_mtime = get_timer_value() - start_mtime;
-	} while (delta_mtime < (SystemCoreClock/4000 * count));
+	delay_until(start_mtime + (uint64_t)hz * count / 1000);
+}
+
+// mcycle and minstret are stopped by _init() to save power, they run while
+// at least one user needs them
+void counters_enable(void)
+{
+	const uint32_t status = read_csr(mstatus);
+	clear_csr(mstatus, MSTATUS_MIE);
+	if (counters_users++ == 0)
+	{
+		enable_mcycle_minstret();
+	}
+	if (status & MSTATUS_MIE)
+	{
+		set_csr(mstatus, MSTATUS_MIE);
+	}
+}
+
+void counters_disable(void)
+{
+	const uint32_t status = read_csr(mstatus);
+	clear_csr(mstatus, MSTATUS_MIE);
+	if ((counters_users != 0) && (--counters_users == 0))
+	{
+		disable_mcycle_minstret();
+	}
+	if (status & MSTATUS_MIE)
+	{
+		set_csr(mstatus, MSTATUS_MIE);
+	}
+}
+
+// only low word of mcycle: no hi/lo/hi loop, wraps every 39 s at 108 MHz
+void delay_cycles(uint32_t cycles)
+{
+	counters_enable();
+	const uint32_t start = read_csr(mcycle);
+	while ((uint32_t)(read_csr(mcycle) - start) < cycles);
+	counters_disable();
+}
+
+void delay_us(uint32_t us)
+{
+	const uint32_t hz = delay_get_timer_hz() * 4;
+	// cycles per us with 6 fractional bits (1000000 = 15625 << 6): no 64 bit
+	// division, which would take longer than short delays
+	const uint32_t per_us = hz / 15625;
+	delay_cycles(((uint64_t)us * per_us) >> 6);
 }
@@ -5,8 +5,56 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
 
+// core sleeps with WFI until mtime reaches mtimecmp, other interrupts are
+// serviced meanwhile; busy wait from interrupt handler or with interrupts
+// disabled
 void delay_ms(uint32_t count);
+void delay_until(uint64_t mtime);
+void delay_set_timer_hz(uint32_t hz);	// measured mtime frequency, 0 = nominal
+uint32_t delay_get_timer_hz(void);
+uint64_t delay_ms_to_ticks(uint32_t ms);	// mtime ticks at calibrated rate
+uint64_t delay_us_to_ticks(uint32_t us);
+
+// 1 in interrupt handler: irq_entry enables MIE again in handlers, so only
+// the level of interrupt being handled (mintstatus) tells
+bool in_interrupt(void);
+
+// one WFI, skipped when *pending is already set (e.g. by interrupt): check
+// and WFI are done with interrupts disabled, so no wake up is lost
+void delay_wfi(volatile const uint32_t* pending);
+
+// idle main loop: delay_idle() sleeps until any interrupt, it returns at
+// once when delay_wake() was called (from interrupt) since its last return
+void delay_idle(void);
+void delay_wake(void);
+
+// alarms on mtime for timer services, they share mtimecmp with delays;
+// callback is called from interrupt, NULL = off
+enum
+{
+	DELAY_ALARM_SWTIMER = 0,
+	DELAY_ALARM_KERNEL,
+	DELAY_ALARMS
+};
+typedef void (*DelayAlarmCallback)(void);
+void delay_set_alarm(uint8_t alarm, uint64_t mtime, DelayAlarmCallback callback);
+
+// delay_until() asks the hook first, e.g. kernel blocks the calling thread
+// instead; hook returns 0 when it can't (no thread is running)
+typedef bool (*DelaySleepHook)(uint64_t mtime);
+void delay_set_sleep_hook(DelaySleepHook hook);
+
+// busy wait on mcycle, for bit banged protocols (1-Wire, DHT ...), at least
+// given time plus a few cycles of call overhead, up to 39 s at 108 MHz
+void delay_cycles(uint32_t cycles);
+void delay_us(uint32_t us);
+
+// mcycle/minstret run while they have at least one user (reference count),
+// e.g. around profiled code: get_cycle_value(), get_instret_value()
+void counters_enable(void);
+void counters_disable(void);
 
 #ifdef __cplusplus
 }
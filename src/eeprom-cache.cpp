@@ -0,0 +1,300 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200212
+
+// #define DEBUG_EEPROM_CACHE
+#ifndef DEBUG_EEPROM_CACHE
+#undef DEBUG
+#endif // DEBUG_EEPROM_CACHE
+
+#include "eeprom-cache.hpp"
+#include "debug.h"
+#include "delay.h"		// delay_ms_to_ticks()
+#include "n200_func.h"	// get_timer_value()
+
+namespace eeprom_cache
+{
+	using namespace i2c;
+
+// private types:
+typedef struct
+{
+	bool		valid;
+	bool		dirty;
+	uint16_t	page;			// EEPROM address / EEPROM_PAGE_SIZE
+	uint8_t		dirty_first;	// dirty bytes in page, only those are written
+	uint8_t		dirty_last;
+	uint32_t	used;			// LRU: value of use_counter on last access
+	uint64_t	dirty_since;	// mtime of first write after last flush
+	uint8_t		data[EEPROM_PAGE_SIZE];
+} Line;
+
+static Line lines[EEPROM_CACHE_PAGES];
+static uint32_t use_counter;
+static Stats stats;
+
+static uint16_t page_of(uint16_t addr)
+{
+	return addr / EEPROM_PAGE_SIZE;
+}
+
+static uint16_t page_addr(uint16_t page)
+{
+	return page * EEPROM_PAGE_SIZE;
+}
+
+static void copy(uint8_t* dst, const uint8_t* src, uint16_t n)
+{
+	while (n--)
+	{
+		*dst++ = *src++;
+	}
+}
+
+static Line* find(uint16_t page)
+{
+	for (uint8_t i = 0; i < EEPROM_CACHE_PAGES; i++)
+	{
+		if (lines[i].valid && (lines[i].page == page))
+		{
+			lines[i].used = ++use_counter;
+			return &lines[i];
+		}
+	}
+	return NULL;
+}
+
+// only dirty part of page, one write cycle
+static Error writeback(Line* line)
+{
+	if (line->dirty == 0)
+	{
+		return Error::Ok;
+	}
+
+	const uint8_t first = line->dirty_first;
+	const uint8_t n     = line->dirty_last - first + 1;
+	I2C_CHECK(eeprom::write_many(page_addr(line->page) + first, &line->data[first], n));
+
+	line->dirty = 0;
+	stats.writebacks++;
+	return Error::Ok;
+}
+
+// free line for page, least recently used is evicted
+// load = 0 if whole page will be overwritten anyway
+static Error allocate(uint16_t page, bool load, Line** result)
+{
+	Line* line = &lines[0];
+	for (uint8_t i = 0; i < EEPROM_CACHE_PAGES; i++)
+	{
+		if (lines[i].valid == 0)
+		{
+			line = &lines[i];
+			break;
+		}
+		if (lines[i].used < line->used)
+		{
+			line = &lines[i];
+		}
+	}
+
+	if (line->valid)
+	{
+		dprintf("evict page %d\r\n", line->page);
+		I2C_CHECK(writeback(line));
+		line->valid = 0;
+	}
+
+	if (load)
+	{
+		I2C_CHECK(eeprom::read_many(page_addr(page), line->data, EEPROM_PAGE_SIZE));
+		stats.misses++;
+	}
+
+	line->valid = 1;
+	line->dirty = 0;
+	line->page  = page;
+	line->used  = ++use_counter;
+	*result = line;
+	return Error::Ok;
+}
+
+void init(Device dev)
+{
+	eeprom::init(dev);
+	invalidate();
+	stats = {};
+}
+
+void invalidate(void)
+{
+	for (uint8_t i = 0; i < EEPROM_CACHE_PAGES; i++)
+	{
+		lines[i].valid = 0;
+		lines[i].dirty = 0;
+	}
+}
+
+uint8_t read(uint16_t addr)
+{
+	uint8_t data = 0;
+	read_many(addr, &data, 1);
+	return data;
+}
+
+// page by page: cached pages from RAM, other pages:
+// - small reads: page is loaded to cache (next read is probably close)
+// - reads longer than a page: read directly, consecutive uncached pages with
+//   one EEPROM read, without evicting anything
+Error read_many(uint16_t addr, uint8_t* data, uint16_t n)
+{
+	const bool bypass = (n > EEPROM_PAGE_SIZE);
+	uint16_t direct_addr = 0;	// start of pending direct read
+	uint8_t* direct_data = NULL;
+	uint16_t direct_n    = 0;
+
+	if (((uint32_t)addr + n) > EEPROM_SIZE)
+	{
+		return Error::WrongArgument;
+	}
+
+	while (n > 0)
+	{
+		const uint16_t offset = addr % EEPROM_PAGE_SIZE;
+		const uint16_t chunk  = (n < EEPROM_PAGE_SIZE - offset) ? n : EEPROM_PAGE_SIZE - offset;
+		Line* line = find(page_of(addr));
+
+		if ((line == NULL) && bypass)
+		{
+			if (direct_n == 0)
+			{
+				direct_addr = addr;
+				direct_data = data;
+			}
+			direct_n += chunk;
+			stats.bypass++;
+		}
+		else
+		{
+			if (direct_n != 0)
+			{
+				I2C_CHECK(eeprom::read_many(direct_addr, direct_data, direct_n));
+				direct_n = 0;
+			}
+			if (line == NULL)
+			{
+				I2C_CHECK(allocate(page_of(addr), 1, &line));
+			}
+			else
+			{
+				stats.hits++;
+			}
+			copy(data, &line->data[offset], chunk);
+		}
+
+		addr += chunk;
+		data += chunk;
+		n    -= chunk;
+	}
+
+	if (direct_n != 0)
+	{
+		return eeprom::read_many(direct_addr, direct_data, direct_n);
+	}
+	return Error::Ok;
+}
+
+Error write(uint16_t addr, uint8_t data)
+{
+	return write_many(addr, &data, 1);
+}
+
+Error write_many(uint16_t addr, const uint8_t data[], uint16_t n)
+{
+	if (((uint32_t)addr + n) > EEPROM_SIZE)
+	{
+		return Error::WrongArgument;
+	}
+
+	while (n > 0)
+	{
+		const uint8_t  offset = addr % EEPROM_PAGE_SIZE;
+		const uint16_t chunk  = (n < EEPROM_PAGE_SIZE - offset) ? n : EEPROM_PAGE_SIZE - offset;
+		const uint8_t  last   = offset + chunk - 1;
+		Line* line = find(page_of(addr));
+
+		if (line == NULL)
+		{
+			I2C_CHECK(allocate(page_of(addr), chunk != EEPROM_PAGE_SIZE, &line));
+		}
+		else
+		{
+			stats.hits++;
+		}
+
+		copy(&line->data[offset], data, chunk);
+		if (line->dirty == 0)
+		{
+			line->dirty = 1;
+			line->dirty_first = offset;
+			line->dirty_last  = last;
+			line->dirty_since = get_timer_value();
+		}
+		else
+		{
+			line->dirty_first = (offset < line->dirty_first) ? offset : line->dirty_first;
+			line->dirty_last  = (last > line->dirty_last) ? last : line->dirty_last;
+		}
+
+		addr += chunk;
+		data += chunk;
+		n    -= chunk;
+	}
+
+	return Error::Ok;
+}
+
+Error flush(void)
+{
+	for (uint8_t i = 0; i < EEPROM_CACHE_PAGES; i++)
+	{
+		if (lines[i].valid)
+		{
+			I2C_CHECK(writeback(&lines[i]));
+		}
+	}
+	return Error::Ok;
+}
+
+Error process(void)
+{
+	const uint64_t now = get_timer_value();
+	const uint64_t max_age = delay_ms_to_ticks(EEPROM_CACHE_FLUSH_MS);
+
+	for (uint8_t i = 0; i < EEPROM_CACHE_PAGES; i++)
+	{
+		Line* line = &lines[i];
+		if (line->valid && line->dirty && ((now - line->dirty_since) >= max_age))
+		{
+			I2C_CHECK(writeback(line));
+		}
+	}
+	return Error::Ok;
+}
+
+uint8_t dirty_pages(void)
+{
+	uint8_t n = 0;
+	for (uint8_t i = 0; i < EEPROM_CACHE_PAGES; i++)
+	{
+		n += (lines[i].valid && lines[i].dirty);
+	}
+	return n;
+}
+
+const Stats* get_stats(void)
+{
+	return &stats;
+}
+
+} // namespace
@@ -0,0 +1,51 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200212
+// write-back page cache in front of 24C256 driver
+// - reads of cached pages don't touch the bus
+// - writes only change RAM and mark page dirty
+// - dirty pages are written to EEPROM by flush(), by process() after
+//   EEPROM_CACHE_FLUSH_MS, or when page is evicted (LRU)
+// all EEPROM access should go through cache after init(), direct
+// eeprom::write*() would be overwritten by next flush of the same page
+
+#ifndef EEPROM_CACHE_H
+#define EEPROM_CACHE_H
+
+#include <stdint.h>
+#include "eeprom.hpp"
+
+#ifndef EEPROM_CACHE_PAGES
+#define EEPROM_CACHE_PAGES		4		// RAM: 64 B + few bytes per page
+#endif
+#ifndef EEPROM_CACHE_FLUSH_MS
+#define EEPROM_CACHE_FLUSH_MS	1000	// max time page stays dirty, see process()
+#endif
+
+namespace eeprom_cache
+{
+
+typedef struct
+{
+	uint32_t	hits;		// pages served from RAM
+	uint32_t	misses;		// pages loaded from EEPROM
+	uint32_t	bypass;		// pages read directly (large reads)
+	uint32_t	writebacks;	// page writes to EEPROM
+} Stats;
+
+void init(i2c::Device dev);
+
+uint8_t read(uint16_t addr);
+i2c::Error read_many(uint16_t addr, uint8_t* data, uint16_t n);
+i2c::Error write(uint16_t addr, uint8_t data);
+i2c::Error write_many(uint16_t addr, const uint8_t data[], uint16_t n);
+
+i2c::Error flush(void);			// write all dirty pages
+i2c::Error process(void);		// call from main loop: timed flush
+void invalidate(void);			// drop all pages, dirty pages are lost
+uint8_t dirty_pages(void);
+
+const Stats* get_stats(void);
+
+} // namespace
+
+#endif	// EEPROM_CACHE_H
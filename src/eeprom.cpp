@@ -8,17 +8,16 @@
 #endif // DEBUG_EEPROM
 
 #include "eeprom.hpp"
-#include "delay.h"
+#include "i2c-bus.hpp"
 #include "libc-bits.h"	// strlen()
+#include "delay.h"		// delay_ms_to_ticks()
+#include "n200_func.h"	// get_timer_value()
 #ifdef SHELL
 #include "shell-cmd.hpp"
 #include "utils.hpp"
 #endif // SHELL
 
-#define I2C_DTCY_2  ((uint32_t)0x00000000U)
-#define I2C0        I2C_BASE
-
-static i2c::Device dev = i2c::Device::wrong;
+static i2c_bus::Client client = {i2c::Device::wrong, EEPROM_ADDR, i2c::Speed::Speed400kHz, i2c::DutyCycle::Duty2};
 
 namespace eeprom
 {
@@ -28,161 +27,125 @@ namespace eeprom
 
 void init(i2c::Device arg_dev)
 {
-	// GPIO init
-	using namespace gpio;
-	rcu_periph_clock_enable(RCU_GPIOB);
-	rcu_periph_clock_enable(RCU_AF);
-
-	dev = arg_dev;
-
-	if (dev == i2c::Device::myI2C0)
-	{
-		rcu_periph_clock_enable(RCU_I2C0);
-		gpio_init2(PB6, AfioOD, Speed10MHz);	// SCL
-		gpio_init2(PB7, AfioOD, Speed10MHz);	// SDA
-		init(Device::myI2C0, i2c::Speed::Speed400kHz, DutyCycle::Duty2);
-	}
-	else if (dev == i2c::Device::myI2C1)
-	{
-		rcu_periph_clock_enable(RCU_I2C1);
-		gpio_init2(PB10, AfioOD, Speed10MHz);	// SCL
-		gpio_init2(PB11, AfioOD, Speed10MHz);	// SDA
-		init(Device::myI2C1, i2c::Speed::Speed400kHz, DutyCycle::Duty2);
-	}
-	else
+	if ((arg_dev != i2c::Device::myI2C0) && (arg_dev != i2c::Device::myI2C1))
 	{
-		eprintf("Wrong I2C device: %d\r\n", dev);
+		eprintf("Wrong I2C device: %d\r\n", arg_dev);
+		return;
 	}
+
+	client.bus = arg_dev;
+	i2c_bus::init(arg_dev);
 }
 
 // check address				 											{{{
 // ----------------------------------------------------------------------------
-static bool is_addr_valid(uint16_t addr)
+// n bytes from addr must fit into 256 kb = 32 kB
+static bool is_addr_valid(uint16_t addr, uint16_t n)
 {
-	// 256 kb = 32 kB
-	// max address  = 32768 = 0x8000
-
-	if ((addr > 0) || (addr < 32768))
-	{
-		return 1;
-	}
-	else
-	{
-		return 0;
-	}
+	return ((uint32_t)addr + n) <= EEPROM_SIZE;
 }
 
-#define ADDR_CHECK(addr) \
-	if (is_addr_valid(addr) == 0) \
+#define ADDR_CHECK(addr, n) \
+	if (is_addr_valid(addr, n) == 0) \
 	{ \
-		eprintf("invalid address for 256K device: %d\r\n", addr);\
-		return 0; \
+		eprintf("invalid address for 256K device: %d (n: %d)\r\n", addr, n);\
+		return Error::WrongArgument; \
 	}
+// ------------------------------------------------------------------------ }}}
+// ACK polling																{{{
+// ----------------------------------------------------------------------------
+// during internal write cycle EEPROM doesn't ACK its address, so address only
+// transaction is repeated until it does. Usually done in 3-5 ms, so this is
+// much faster than fixed max write time (datasheet, page 5: 20 ms)
+static Error wait_ready(void)
+{
+	const uint64_t deadline = get_timer_value() + delay_ms_to_ticks(EEPROM_WRITE_TIMEOUT_MS);
 
-#define ADDR_CHECK_VOID(addr) \
-	if (is_addr_valid(addr) == 0) \
-	{ \
-	eprintf("invalid address for 256K device: %d\r\n", addr);\
+	while (i2c_bus::probe(&client) != Error::Ok)
+	{
+		if (get_timer_value() > deadline)
+		{
+			eprintf("EEPROM write cycle timeout\r\n");
+			return Error::Timeout;
+		}
 	}
+	return Error::Ok;
+}
 // ------------------------------------------------------------------------ }}}
 
 uint8_t read(uint16_t addr)
 {
-	ADDR_CHECK(addr);
-
-	uint8_t addrH = addr >> 8;
-	uint8_t addrL = addr & 0x00FF;
 	uint8_t data = 0;
 
-	using namespace i2c;
-	start(dev);
-	send_addr(dev, EEPROM_ADDR, Mode::Write);
-	write(dev, addrH);
-	write(dev, addrL);
-
-	restart(dev);
-	send_addr(dev, EEPROM_ADDR, Mode::Read);
-	nack(dev);
-	data = read(dev);
-
-	stop(dev);
-
+	if (read_many(addr, &data, 1) != Error::Ok)
+	{
+		return 0;
+	}
 	return data;
 }
 
-void read_many(uint16_t addr, uint8_t* data, uint8_t n)
+Error read_many(uint16_t addr, uint8_t* data, uint16_t n)
 {
-	ADDR_CHECK_VOID(addr);
+	ADDR_CHECK(addr, n);
 
-	uint8_t addrH = addr >> 8;
-	uint8_t addrL = addr & 0x00FF;
+	const uint8_t address[2] = {(uint8_t)(addr >> 8), (uint8_t)(addr & 0x00FF)};
 
-	using namespace i2c;
-	start(dev);
-	send_addr(dev, EEPROM_ADDR, Mode::Write);
-
-	write(dev, addrH);
-	write(dev, addrL);
-
-	restart(dev);
-	send_addr(dev, EEPROM_ADDR, Mode::Read);
-	ack(dev);
-
-	while (n-- > 1)
-	{
-		*data++ = read(dev);
-	}
-	nack(dev);
-	*data++ = read(dev);
-
-
-	stop(dev);
+	// sequential read is not limited by pages
+	return i2c_bus::read(&client, address, 2, data, n);
 }
 
-void write(uint16_t addr, uint8_t data)
+Error write(uint16_t addr, uint8_t data)
 {
-	ADDR_CHECK_VOID(addr);
-	uint8_t addrH = addr >> 8;
-	uint8_t addrL = addr & 0x00FF;
-
-	start(dev);
-	send_addr(dev, EEPROM_ADDR, Mode::Write);
-	write(dev, addrH);
-	write(dev, addrL);
-	write(dev, data);
-
-	stop(dev);
-	delay_ms(20);	// datasheet, page 5, max 20 ms write delay, after _stop()
+	return write_many(addr, &data, 1);
 }
 
-void write_many(uint16_t addr, const uint8_t data[], uint16_t n)
+// one page write per 64 byte page, each followed by ACK polling
+// data crossing page boundary would wrap to start of the same page
+Error write_many(uint16_t addr, const uint8_t data[], uint16_t n)
 {
-	ADDR_CHECK_VOID(addr);
-	uint8_t addrH = addr >> 8;
-	uint8_t addrL = addr & 0x00FF;
-
-	start(dev);
-	send_addr(dev, EEPROM_ADDR, Mode::Write);
-	write(dev, addrH);
-	write(dev, addrL);
+	ADDR_CHECK(addr, n);
 
-	for (uint8_t i=0; i<n; i++)
+	while (n > 0)
 	{
-		write(dev, data[i]);
+		const uint16_t page_left = EEPROM_PAGE_SIZE - (addr % EEPROM_PAGE_SIZE);
+		const uint16_t chunk = (n < page_left) ? n : page_left;
+		const uint8_t address[2] = {(uint8_t)(addr >> 8), (uint8_t)(addr & 0x00FF)};
+
+		I2C_CHECK(i2c_bus::write(&client, address, 2, data, chunk));
+		I2C_CHECK(wait_ready());
+
+		addr += chunk;
+		data += chunk;
+		n    -= chunk;
 	}
 
-	stop(dev);
-	delay_ms(20);	// datasheet, page 5, max 20 ms write delay, after _stop()
+	return Error::Ok;
 }
 
-void erase(uint16_t addr)
+Error erase(uint16_t addr)
 {
-	write(addr, 0xFF);
+	return write(addr, 0xFF);
 }
 
-void erase_many(uint16_t addr, uint16_t n)
+Error erase_many(uint16_t addr, uint16_t n)
 {
-	write_many(addr, 0, n);
+	static uint8_t empty[EEPROM_PAGE_SIZE];
+	ADDR_CHECK(addr, n);
+
+	for (uint8_t i = 0; i < EEPROM_PAGE_SIZE; i++)
+	{
+		empty[i] = 0xFF;
+	}
+	while (n > 0)
+	{
+		// page sized chunks, write_many() splits them on page boundary
+		const uint16_t chunk = (n < EEPROM_PAGE_SIZE) ? n : EEPROM_PAGE_SIZE;
+		I2C_CHECK(write_many(addr, empty, chunk));
+		addr += chunk;
+		n    -= chunk;
+	}
+
+	return Error::Ok;
 }
 
 // ----------------------------------------------------------------------------
@@ -190,7 +153,6 @@ void erase_many(uint16_t addr, uint16_t n)
 void example(i2c::Device dev)
 {
 	init(dev);
-	ack(dev);
 
 	uint8_t value;
 
@@ -310,7 +272,7 @@ uint8_t cmd(char *argv[])
 			break;
 		case 'i':
 			// reinit ROM
-			init(dev);
+			init(client.bus);
 			break;
 		case 'e':
 			erase(naddr);
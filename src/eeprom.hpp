@@ -11,14 +11,18 @@
 namespace eeprom
 {
 #define EEPROM_ADDR	0b10100000
+#define EEPROM_SIZE				32768	// 256 kb
+#define EEPROM_PAGE_SIZE		64		// max bytes in one write cycle
+#define EEPROM_WRITE_TIMEOUT_MS	20		// max write cycle time, datasheet page 5
 
 void init(i2c::Device dev);
 uint8_t read(uint16_t addr);
-void read_many(uint16_t addr, uint8_t* data, uint8_t n);
-void write(uint16_t addr, uint8_t data);
-void write_many(uint16_t addr, const uint8_t data[], uint16_t n);
-void erase(uint16_t addr);
-void erase_many(uint16_t addr, uint16_t n);
+i2c::Error read_many(uint16_t addr, uint8_t* data, uint16_t n);
+// all writes return when data is written to EEPROM
+i2c::Error write(uint16_t addr, uint8_t data);
+i2c::Error write_many(uint16_t addr, const uint8_t data[], uint16_t n);
+i2c::Error erase(uint16_t addr);
+i2c::Error erase_many(uint16_t addr, uint16_t n);
 
 void test(void);
 void example(i2c::Device dev);
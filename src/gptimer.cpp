@@ -0,0 +1,313 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+
+// #define DEBUG_GPTIMER
+#ifndef DEBUG_GPTIMER
+#undef DEBUG
+#endif // DEBUG_GPTIMER
+
+#include "gptimer.hpp"
+#include "gd32vf103.h"			// IRQn_Type
+#include "gd32vf103_rcu.h"		// for clocks, for now
+#include "gd32vf103_eclic.h"
+
+namespace gptimer
+{
+
+// HW driver				 											{{{
+// ----------------------------------------------------------------------------
+enum class Ctl0Bits: uint8_t
+{
+	CKDIV	= 8,	// [2b] dead time and filter clock division
+	ARSE	= 7,	// auto reload shadow enable
+	CAM		= 5,	// [2b] center aligned modes
+	DIR		= 4,	// 0 = up, 1 = down
+	SPM		= 3,	// single pulse mode
+	UPS		= 2,	// update flag only on overflow, not on UPG
+	UPDIS	= 1,	// update disable
+	CEN		= 0,	// counter enable
+};
+
+enum class SwevgBits: uint8_t
+{
+	UPG		= 0,	// update: reload counter, load PSC and CAR shadows
+};
+
+// one byte of CHCTL0 or CHCTL1 per channel
+enum class ChctlBits: uint8_t
+{
+	// output mode (MS = 00)
+	COMCEN	= 7,	// clear output on external trigger
+	COMCTL	= 4,	// [3b] OutputMode
+	COMSEN	= 3,	// compare value shadow enable
+	COMFEN	= 2,	// fast compare
+	// input mode (MS = 01, from own input pin)
+	CAPFLT	= 4,	// [4b] input filter
+	CAPPSC	= 2,	// [2b] capture every 1, 2, 4, 8 edges
+	MS		= 0,	// [2b] channel mode, writable only while channel is disabled
+};
+
+// four bits of CHCTL2 per channel
+enum class Chctl2Bits: uint8_t
+{
+	CHxEN	= 0,	// channel output or capture enable
+	CHxP	= 1,	// output polarity or capture edge
+};
+
+typedef struct
+{
+	rcu_periph_enum			clock;
+	rcu_periph_reset_enum	reset;
+	IRQn_Type				irq;
+} TimerMap;
+
+static const TimerMap TimerMaps[] = {
+	{RCU_TIMER1,	RCU_TIMER1RST,	TIMER1_IRQn},
+	{RCU_TIMER2,	RCU_TIMER2RST,	TIMER2_IRQn},
+	{RCU_TIMER3,	RCU_TIMER3RST,	TIMER3_IRQn},
+	{RCU_TIMER4,	RCU_TIMER4RST,	TIMER4_IRQn},
+};
+
+static Callback callbacks[4];
+
+// TODO move it to RCU part
+uint32_t get_clock(void)
+{
+	const uint32_t apb1 = rcu_clock_freq_get(CK_APB1);
+	if ((RCU_CFG0 & RCU_CFG0_APB1PSC) == RCU_APB1_CKAHB_DIV1)
+	{
+		return apb1;
+	}
+	return 2 * apb1;
+}
+
+// the smallest prescaler which fits gives the longest period and so the
+// finest compare (duty cycle) resolution
+bool calc_period(uint32_t clock_hz, uint32_t hz, Period* period)
+{
+	if ((hz == 0) || (hz > clock_hz / 2))
+	{
+		eprintf("gptimer: %d Hz is out of range\r\n", hz);
+		return 0;
+	}
+
+	const uint32_t ticks = clock_hz / hz + ((clock_hz % hz) >= (hz + 1) / 2);
+	const uint32_t prescaler = (ticks >> 16) + ((ticks & 0xFFFF) != 0);
+	uint32_t count = (ticks + prescaler / 2) / prescaler;
+	if (count > 0x10000)
+	{
+		count = 0x10000;
+	}
+
+	const uint64_t divider = (uint64_t)prescaler * count;
+	const uint64_t actual_uhz = (uint64_t)clock_hz * 1000000 / divider;
+	period->prescaler = prescaler;
+	period->period    = count;
+	period->hz        = (actual_uhz + 500000) / 1000000;
+	period->error_ppm = ((int64_t)actual_uhz - (int64_t)hz * 1000000) / hz;
+	return 1;
+}
+
+static void load_period(Timer timer, const Period* period)
+{
+	volatile TimerReg* r = reg(timer);
+	r->PSC = period->prescaler - 1;
+	r->CAR = period->period - 1;
+}
+
+bool init(Timer timer, uint32_t hz, Period* period)
+{
+	const TimerMap* map = &TimerMaps[(uint8_t)timer];
+	Period p;
+	if (!calc_period(get_clock(), hz, &p))
+	{
+		return 0;
+	}
+
+	// reset puts all registers to default values, counter is stopped
+	rcu_periph_clock_enable(map->clock);
+	rcu_periph_reset_enable(map->reset);
+	rcu_periph_reset_disable(map->reset);
+
+	volatile TimerReg* r = reg(timer);
+	load_period(timer, &p);
+	r->CTL0  = (1 << (uint8_t)Ctl0Bits::ARSE) | (1 << (uint8_t)Ctl0Bits::UPS);
+	r->SWEVG = (1 << (uint8_t)SwevgBits::UPG);	// PSC is always shadowed
+	r->INTF  = 0;
+
+	dprintf("gptimer: %d Hz, PSC %d, CAR %d, error %d ppm\r\n", p.hz, p.prescaler - 1, p.period - 1, p.error_ppm);
+	if (period != NULL)
+	{
+		*period = p;
+	}
+	return 1;
+}
+
+bool set_frequency(Timer timer, uint32_t hz, Period* period)
+{
+	Period p;
+	if (!calc_period(get_clock(), hz, &p))
+	{
+		return 0;
+	}
+
+	load_period(timer, &p);
+	if (period != NULL)
+	{
+		*period = p;
+	}
+	return 1;
+}
+
+void start(Timer timer)
+{
+	reg(timer)->CTL0 |= (1 << (uint8_t)Ctl0Bits::CEN);
+}
+
+void stop(Timer timer)
+{
+	reg(timer)->CTL0 &= ~(1 << (uint8_t)Ctl0Bits::CEN);
+}
+
+void output_enable(Timer timer, Channel ch, bool state)
+{
+	volatile TimerReg* r = reg(timer);
+	const uint8_t bit = 4 * (uint8_t)ch + (uint8_t)Chctl2Bits::CHxEN;
+
+	r->CHCTL2 &=    ~(1 << bit);
+	r->CHCTL2 |=  state << bit;
+}
+
+// channel is disabled first, mode bits are writable only then
+static void set_channel_mode(Timer timer, Channel ch, uint8_t mode, bool polarity)
+{
+	volatile TimerReg* r = reg(timer);
+	volatile uint32_t* chctl = &r->CHCTL[(uint8_t)ch >> 1];
+	const uint8_t shift = ((uint8_t)ch & 1) * 8;
+	const uint8_t shift2 = 4 * (uint8_t)ch;
+
+	r->CHCTL2 &= ~(0b11 << shift2);
+	*chctl = (*chctl & ~(0xFF << shift)) | ((uint32_t)mode << shift);
+	r->CHCTL2 |= (polarity << (shift2 + (uint8_t)Chctl2Bits::CHxP)) | (1 << (shift2 + (uint8_t)Chctl2Bits::CHxEN));
+}
+
+// compare value is shadowed: changes take effect at the next update
+void pwm_init(Timer timer, Channel ch, OutputMode mode, uint16_t compare)
+{
+	set_compare(timer, ch, compare);
+	set_channel_mode(timer, ch,
+		((uint8_t)mode << (uint8_t)ChctlBits::COMCTL) | (1 << (uint8_t)ChctlBits::COMSEN), 0);
+}
+
+// captured value is read with get_capture(), usually from Interrupt::ChX
+void capture_init(Timer timer, Channel ch, Edge edge, uint8_t filter)
+{
+	set_channel_mode(timer, ch,
+		((filter & 0xF) << (uint8_t)ChctlBits::CAPFLT) | (0b01 << (uint8_t)ChctlBits::MS), (bool)edge);
+}
+
+void set_callback(Timer timer, Callback callback)
+{
+	callbacks[(uint8_t)timer] = callback;
+}
+
+// pending flag is cleared before the interrupt is enabled
+void interrupt(Timer timer, Interrupt interrupt, bool state)
+{
+	volatile TimerReg* r = reg(timer);
+	const uint32_t mask = 1 << (uint8_t)interrupt;
+
+	if (state)
+	{
+		r->INTF = ~mask;
+		r->DMAINTEN |= mask;
+		eclic_irq_enable(TimerMaps[(uint8_t)timer].irq, 1, 0);
+	}
+	else
+	{
+		r->DMAINTEN &= ~mask;
+	}
+}
+
+// INTF bits are cleared by writing 0, writing 1 leaves them: no RMW race
+static void irq(Timer timer)
+{
+	volatile TimerReg* r = reg(timer);
+	const uint32_t flags = r->INTF & r->DMAINTEN & 0x1F;
+	r->INTF = ~flags;
+
+	if (callbacks[(uint8_t)timer] != NULL)
+	{
+		callbacks[(uint8_t)timer](timer, flags);
+	}
+}
+// ------------------------------------------------------------------------ }}}
+
+// test				 											{{{
+// ----------------------------------------------------------------------------
+static void test_address(void)
+{
+	volatile TimerReg* TIMER1 = reg(Timer::Timer1);
+	ASSERT_EQ((uint32_t)TIMER1,					address_TIMER1);
+	ASSERT_EQ((uint32_t)reg(Timer::Timer4),		0x40000C00);
+	ASSERT_EQ((uint32_t)&TIMER1->DMAINTEN,		address_TIMER1 + 0x0C);
+	ASSERT_EQ((uint32_t)&TIMER1->CHCTL[1],		address_TIMER1 + 0x1C);
+	ASSERT_EQ((uint32_t)&TIMER1->CNT,			address_TIMER1 + 0x24);
+	ASSERT_EQ((uint32_t)&TIMER1->CAR,			address_TIMER1 + 0x2C);
+	ASSERT_EQ((uint32_t)&TIMER1->CHCV[0],		address_TIMER1 + 0x34);
+	ASSERT_EQ((uint32_t)&TIMER1->CHCV[3],		address_TIMER1 + 0x40);
+	ASSERT_EQ((uint32_t)&TIMER1->DMATB,			address_TIMER1 + 0x4C);
+}
+
+static void test_period(void)
+{
+	Period p;
+	ASSERT(calc_period(108000000, 1000, &p));
+	ASSERT_EQ(p.prescaler, 2);
+	ASSERT_EQ(p.period, 54000);
+	ASSERT_EQ(p.hz, 1000);
+	ASSERT_EQ(p.error_ppm, 0);
+
+	// 1 Hz needs the biggest prescaler, error stays small
+	ASSERT(calc_period(108000000, 1, &p));
+	ASSERT_EQ(p.prescaler, 1648);
+	ASSERT(p.period <= 0x10000);
+	ASSERT((p.error_ppm < 20) && (p.error_ppm > -20));
+
+	ASSERT(calc_period(108000000, 54000000, &p));
+	ASSERT_EQ(p.period, 2);
+	ASSERT(!calc_period(108000000, 0, &p));
+	ASSERT(!calc_period(108000000, 60000000, &p));
+}
+
+void test(void)
+{
+	test_address();
+	test_period();
+}
+// ------------------------------------------------------------------------ }}}
+
+} // namespace
+
+extern "C"	// don't mangle
+{
+void TIMER1_IRQHandler(void)
+{
+	gptimer::irq(gptimer::Timer::Timer1);
+}
+
+void TIMER2_IRQHandler(void)
+{
+	gptimer::irq(gptimer::Timer::Timer2);
+}
+
+void TIMER3_IRQHandler(void)
+{
+	gptimer::irq(gptimer::Timer::Timer3);
+}
+
+void TIMER4_IRQHandler(void)
+{
+	gptimer::irq(gptimer::Timer::Timer4);
+}
+}	// extern "C"	// don't mangle
@@ -0,0 +1,146 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+// general purpose timers TIMER1 .. TIMER4: period, PWM output, input capture
+//
+// Timer is always a compile time constant at call site: register block is
+// then a fixed address and inline accessors below are single loads and
+// stores, usable from interrupts.
+// Timers run from CK_TIMERx: APB1 clock, doubled when APB1 is divided
+// (108 MHz with 54 MHz APB1).
+
+#ifndef GPTIMER_H
+#define GPTIMER_H
+
+#include <stdint.h>
+#include "debug.h"
+
+namespace gptimer
+{
+
+enum class Timer: uint8_t
+{
+	Timer1 = 0,
+	Timer2,
+	Timer3,
+	Timer4,
+};
+
+enum class Channel: uint8_t
+{
+	Ch0 = 0,
+	Ch1,
+	Ch2,
+	Ch3,
+};
+
+enum class Interrupt: uint8_t
+{
+	// bits in DMAINTEN and INTF, callback gets (1 << Interrupt)
+	Update	= 0,		// counter reload
+	Ch0		= 1,		// compare match or capture
+	Ch1		= 2,
+	Ch2		= 3,
+	Ch3		= 4,
+};
+
+enum class OutputMode: uint8_t
+{
+	// values for CHCTLx.CHxCOMCTL
+	Timing		= 0b000,	// output is not changed, only compare flag
+	Active		= 0b001,	// set on match
+	Inactive	= 0b010,	// clear on match
+	Toggle		= 0b011,
+	ForceLow	= 0b100,
+	ForceHigh	= 0b101,
+	Pwm0		= 0b110,	// active while CNT < CHxCV
+	Pwm1		= 0b111,	// inactive while CNT < CHxCV
+};
+
+enum class Edge: uint8_t
+{
+	// values for CHCTL2.CHxP in input mode
+	Rising	= 0,
+	Falling	= 1,
+};
+
+typedef struct
+{
+	uint32_t	prescaler;		// PSC + 1
+	uint32_t	period;			// CAR + 1, ticks of one cycle
+	uint32_t	hz;				// actual frequency
+	int32_t		error_ppm;		// actual versus requested
+} Period;
+
+typedef void (*Callback)(Timer timer, uint32_t flags);	// called from interrupt
+
+// registers				 											{{{
+// ----------------------------------------------------------------------------
+const uint32_t address_TIMER1 = 0x40000000;		// TIMER2 .. 4 follow every 0x400
+
+typedef struct
+{
+	volatile uint32_t	CTL0;
+	volatile uint32_t	CTL1;
+	volatile uint32_t	SMCFG;		// slave mode
+	volatile uint32_t	DMAINTEN;	// DMA and interrupt enable
+	volatile uint32_t	INTF;		// interrupt flags, cleared by writing 0
+	volatile uint32_t	SWEVG;		// software event generation
+	volatile uint32_t	CHCTL[2];	// channel 0, 1 and 2, 3 mode
+	volatile uint32_t	CHCTL2;		// channel enable and polarity
+	volatile uint32_t	CNT;
+	volatile uint32_t	PSC;
+	volatile uint32_t	CAR;		// counter auto reload
+	volatile uint32_t	CREP;		// TIMER0 only
+	volatile uint32_t	CHCV[4];	// compare or capture value
+	volatile uint32_t	CCHP;		// TIMER0 only
+	volatile uint32_t	DMACFG;
+	volatile uint32_t	DMATB;
+} TimerReg;
+
+inline volatile TimerReg* reg(Timer timer)
+{
+	return (volatile TimerReg*)(address_TIMER1 + (uint32_t)timer * 0x400);
+}
+// ------------------------------------------------------------------------ }}}
+
+bool calc_period(uint32_t clock_hz, uint32_t hz, Period* period);	// 0 when out of range
+uint32_t get_clock(void);
+
+// timer is stopped after init(), period is optional
+bool init(Timer timer, uint32_t hz, Period* period);
+bool set_frequency(Timer timer, uint32_t hz, Period* period);	// from next update
+void start(Timer timer);
+void stop(Timer timer);
+
+void pwm_init(Timer timer, Channel ch, OutputMode mode, uint16_t compare);
+void capture_init(Timer timer, Channel ch, Edge edge, uint8_t filter);	// filter 0 .. 15
+void output_enable(Timer timer, Channel ch, bool state);
+
+void set_callback(Timer timer, Callback callback);
+void interrupt(Timer timer, Interrupt interrupt, bool state);
+
+inline uint32_t get_period(Timer timer)
+{
+	return reg(timer)->CAR + 1;
+}
+
+inline uint16_t get_counter(Timer timer)
+{
+	return reg(timer)->CNT;
+}
+
+inline void set_compare(Timer timer, Channel ch, uint16_t value)
+{
+	reg(timer)->CHCV[(uint8_t)ch] = value;
+}
+
+inline uint16_t get_capture(Timer timer, Channel ch)
+{
+	return reg(timer)->CHCV[(uint8_t)ch];
+}
+
+void test(void);
+
+} // namespace
+
+#endif // GPTIMER_H
@@ -0,0 +1,355 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200208
+
+// #define DEBUG_I2C_BUS
+#ifndef DEBUG_I2C_BUS
+#undef DEBUG
+#endif // DEBUG_I2C_BUS
+
+#include "i2c-bus.hpp"
+#include "delay.h"		// delay_ms_to_ticks()
+#include "n200_func.h"	// get_timer_value()
+
+namespace i2c_bus
+{
+	using namespace i2c;
+
+// private types:
+typedef struct
+{
+	bool			initialized;
+	Speed			speed;		// current SCL speed
+	DutyCycle		duty;
+	uint8_t			n;			// number of queued transactions
+	Transaction*	queue[I2C_BUS_QUEUE_SIZE];	// sorted by priority, [0] is next
+	uint64_t		stuck_until;	// bus failed recovery, fail fast until then
+} Bus;
+
+static Bus buses[2];	// index is i2c::Device
+
+static Bus* get_bus(Device dev)
+{
+	ASSERT(dev != Device::wrong);
+	return &buses[(uint8_t)dev];
+}
+
+// priority queue												 			{{{
+// ----------------------------------------------------------------------------
+// few entries only: keep array sorted on insert, take from the front
+static bool queue_insert(Bus* bus, Transaction* t)
+{
+	if (bus->n >= I2C_BUS_QUEUE_SIZE)
+	{
+		return 0;
+	}
+
+	// insert after all transactions with same or higher priority (FIFO)
+	uint8_t i = bus->n;
+	while ((i > 0) && (bus->queue[i - 1]->priority > t->priority))
+	{
+		bus->queue[i] = bus->queue[i - 1];
+		i--;
+	}
+	bus->queue[i] = t;
+	bus->n++;
+
+	return 1;
+}
+
+static Transaction* queue_pop(Bus* bus)
+{
+	if (bus->n == 0)
+	{
+		return NULL;
+	}
+
+	Transaction* t = bus->queue[0];
+	bus->n--;
+	for (uint8_t i = 0; i < bus->n; i++)
+	{
+		bus->queue[i] = bus->queue[i + 1];
+	}
+
+	return t;
+}
+// ------------------------------------------------------------------------ }}}
+
+void init(Device dev)
+{
+	Bus* bus = get_bus(dev);
+
+	if (bus->initialized == 1)
+	{
+		return;		// already done by some other driver
+	}
+
+	bus->speed = Speed::Speed400kHz;
+	bus->duty  = DutyCycle::Duty2;
+	bus->n     = 0;
+	bus->stuck_until = 0;
+	i2c::init(dev, bus->speed, bus->duty);
+	bus->initialized = 1;
+}
+
+bool is_initialized(Device dev)
+{
+	return get_bus(dev)->initialized;
+}
+
+Status submit(Transaction* t)
+{
+	Bus* bus = get_bus(t->client->bus);
+	ASSERT(bus->initialized);
+
+	t->deadline = 0;
+	if (t->timeout_ms != 0)
+	{
+		t->deadline = get_timer_value() + delay_ms_to_ticks(t->timeout_ms);
+	}
+
+	t->status = Status::Queued;
+	t->error  = Error::Ok;
+	if (queue_insert(bus, t) == 0)
+	{
+		eprintf("I2C%d queue is full\r\n", t->client->bus);
+		t->status = Status::Full;
+		t->error  = Error::Busy;
+	}
+
+	return t->status;
+}
+
+uint8_t pending(Device dev)
+{
+	return get_bus(dev)->n;
+}
+
+// one transaction on the bus, stops at first error
+static Error execute(Bus* bus, Transaction* t)
+{
+	const Client* c = t->client;
+	Device dev = c->bus;
+
+	if ((c->speed != bus->speed) || (c->duty != bus->duty))
+	{
+		I2C_CHECK(set_speed(dev, c->speed, c->duty));
+		bus->speed = c->speed;
+		bus->duty  = c->duty;
+	}
+
+	// still busy when nothing should be on the bus: some slave holds SDA/SCL
+	if (wait_until_flag(dev, Flag::BSY, 1) != Error::Ok)
+	{
+		return Error::BusStuck;
+	}
+	I2C_CHECK(start(dev));
+
+	// nothing to send or receive: only check if slave ACKs its address
+	if ((t->ncmd == 0) && (t->ntx == 0) && (t->nrx == 0))
+	{
+		I2C_CHECK(send_addr(dev, c->address, Mode::Write));
+		return stop(dev);
+	}
+
+	if ((t->ncmd != 0) || (t->ntx != 0))
+	{
+		I2C_CHECK(send_addr(dev, c->address, Mode::Write));
+		for (uint8_t i = 0; i < t->ncmd; i++)
+		{
+			I2C_CHECK(i2c::write(dev, t->cmd[i]));
+		}
+		for (uint16_t i = 0; i < t->ntx; i++)
+		{
+			I2C_CHECK(i2c::write(dev, t->tx[i]));
+		}
+
+		if (t->nrx == 0)
+		{
+			I2C_CHECK(wait_until_flag(dev, Flag::BTC, 0));
+			return stop(dev);
+		}
+		I2C_CHECK(restart(dev));
+	}
+
+	// receive() generates STOP by itself
+	return receive(dev, c->address, t->rx, t->nrx);
+}
+
+// leave the bus in usable state after failed transaction
+static void abort(Bus* bus, Device dev, Error err)
+{
+	switch (err)
+	{
+		case Error::Nack:
+			// slave is fine, just release the bus
+			stop(dev);
+			break;
+		case Error::ArbitrationLost:
+			// other master owns the bus now, don't touch it
+			break;
+		default:
+			// timeout, bus error or stuck: bus state is unknown
+			if (recover(dev) != Error::Ok)
+			{
+				bus->stuck_until = get_timer_value() + delay_ms_to_ticks(I2C_BUS_STUCK_RETRY_MS);
+			}
+			break;
+	}
+}
+
+bool process(Device dev)
+{
+	Bus* bus = get_bus(dev);
+	Transaction* t = queue_pop(bus);
+
+	if (t == NULL)
+	{
+		return 0;
+	}
+
+	const uint64_t now = get_timer_value();
+
+	if ((t->deadline != 0) && (now > t->deadline))
+	{
+		dprintf("I2C%d transaction for 0x%x expired in queue\r\n", dev, t->client->address);
+		t->status = Status::Timeout;
+		t->error  = Error::Timeout;
+	}
+	else if (now < bus->stuck_until)
+	{
+		// don't waste time on the bus which was stuck few ms ago
+		t->status = Status::Error;
+		t->error  = Error::BusStuck;
+	}
+	else
+	{
+		t->error = execute(bus, t);
+		if (t->error == Error::Ok)
+		{
+			t->status = Status::Done;
+		}
+		else
+		{
+			dprintf("I2C%d transaction for 0x%x failed: %d\r\n", dev, t->client->address, t->error);
+			abort(bus, dev, t->error);
+			t->status = Status::Error;
+		}
+	}
+
+	if (t->callback != NULL)
+	{
+		t->callback(t->arg, t->status);
+	}
+
+	return 1;
+}
+
+void process_all(Device dev)
+{
+	while (process(dev) == 1);
+}
+
+Status transfer(Transaction* t)
+{
+	if (submit(t) != Status::Queued)
+	{
+		return t->status;
+	}
+
+	// everything with higher priority (or queued before) goes first
+	while (t->status == Status::Queued)
+	{
+		process(t->client->bus);
+	}
+
+	return t->status;
+}
+
+static void fill(Transaction* t, const Client* client, const uint8_t* cmd, uint8_t ncmd)
+{
+	ASSERT(ncmd <= I2C_BUS_MAX_CMD);
+
+	t->client = client;
+	for (uint8_t i = 0; i < ncmd; i++)
+	{
+		t->cmd[i] = cmd[i];
+	}
+	t->ncmd       = ncmd;
+	t->tx         = NULL;
+	t->ntx        = 0;
+	t->rx         = NULL;
+	t->nrx        = 0;
+	t->priority   = Priority::Normal;
+	t->timeout_ms = I2C_BUS_TIMEOUT_MS;
+	t->callback   = NULL;
+	t->arg        = NULL;
+	t->status     = Status::Free;
+	t->error      = Error::Ok;
+}
+
+Error write(const Client* client, const uint8_t* cmd, uint8_t ncmd, const uint8_t* tx, uint16_t ntx)
+{
+	Transaction t;
+	fill(&t, client, cmd, ncmd);
+	t.tx  = tx;
+	t.ntx = ntx;
+
+	transfer(&t);
+	return t.error;
+}
+
+Error read(const Client* client, const uint8_t* cmd, uint8_t ncmd, uint8_t* rx, uint16_t nrx)
+{
+	Transaction t;
+	fill(&t, client, cmd, ncmd);
+	t.rx  = rx;
+	t.nrx = nrx;
+
+	transfer(&t);
+	return t.error;
+}
+
+Error probe(const Client* client)
+{
+	Transaction t;
+	fill(&t, client, NULL, 0);
+
+	transfer(&t);
+	return t.error;
+}
+
+// tests						 											{{{
+// ----------------------------------------------------------------------------
+// queue only, nothing is sent to the bus
+static void test_queue_order(void)
+{
+	Bus bus = {};
+	Client c = {Device::myI2C0, 0x00, Speed::Speed100kHz, DutyCycle::Duty2};
+	Transaction low, normal1, normal2, high;
+	fill(&low,     &c, NULL, 0);
+	fill(&normal1, &c, NULL, 0);
+	fill(&normal2, &c, NULL, 0);
+	fill(&high,    &c, NULL, 0);
+	low.priority  = Priority::Low;
+	high.priority = Priority::High;
+
+	queue_insert(&bus, &low);
+	queue_insert(&bus, &normal1);
+	queue_insert(&bus, &high);
+	queue_insert(&bus, &normal2);
+
+	ASSERT_EQ(bus.n, 4);
+	ASSERT(queue_pop(&bus) == &high);
+	ASSERT(queue_pop(&bus) == &normal1);
+	ASSERT(queue_pop(&bus) == &normal2);
+	ASSERT(queue_pop(&bus) == &low);
+	ASSERT(queue_pop(&bus) == NULL);
+}
+
+void test(void)
+{
+	test_queue_order();
+}
+// ------------------------------------------------------------------------ }}}
+
+} // namespace
@@ -0,0 +1,92 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200208
+// I2C bus manager: bus is initialized once, device drivers only queue
+// transactions for their slave and don't touch the bus directly
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdint.h>
+#include "i2c.hpp"
+
+#define I2C_BUS_QUEUE_SIZE		8	// max pending transactions per bus
+#define I2C_BUS_TIMEOUT_MS		10	// default timeout for blocking helpers
+#define I2C_BUS_MAX_CMD			4	// max command bytes (register/memory address)
+#define I2C_BUS_STUCK_RETRY_MS	100	// don't touch stuck bus before next recovery attempt
+
+namespace i2c_bus
+{
+
+enum class Status: uint8_t
+{
+	Free = 0,	// transaction not submitted
+	Queued,
+	Done,
+	Timeout,	// not done before its deadline
+	Full,		// queue is full, not submitted
+	Error,		// failed on the bus, see Transaction.error
+};
+
+// lower value = served first, same priority = FIFO
+enum class Priority: uint8_t
+{
+	High = 0,
+	Normal,
+	Low,
+};
+
+// one slave device on the bus, owned by its driver
+typedef struct
+{
+	i2c::Device		bus;
+	uint8_t			address;	// 8 bit address, R/W bit = 0
+	i2c::Speed		speed;		// bus is switched to this speed for each transaction
+	i2c::DutyCycle	duty;
+} Client;
+
+typedef void (*Callback)(void* arg, Status status);
+
+// sequence on the bus:
+// START, address+W, cmd[], tx[], (RESTART, address+R, rx[]), STOP
+// write part is skipped if ncmd and ntx are 0
+// if ncmd, ntx and nrx are 0: START, address+W, STOP (probe)
+typedef struct
+{
+	const Client*	client;
+	uint8_t			cmd[I2C_BUS_MAX_CMD];	// register or memory address
+	uint8_t			ncmd;
+	const uint8_t*	tx;
+	uint16_t		ntx;
+	uint8_t*		rx;
+	uint16_t		nrx;
+	Priority		priority;
+	uint16_t		timeout_ms;	// from submit() to start of transfer, 0 = forever
+	Callback		callback;	// called from process(), can be NULL
+	void*			arg;
+
+	// used by bus manager:
+	volatile Status	status;
+	i2c::Error		error;
+	uint64_t		deadline;	// in mtime ticks
+} Transaction;
+
+void init(i2c::Device bus);
+bool is_initialized(i2c::Device bus);
+
+// async API
+Status submit(Transaction* t);
+bool process(i2c::Device bus);		// do one transaction, returns 0 if queue was empty
+void process_all(i2c::Device bus);
+uint8_t pending(i2c::Device bus);
+
+// blocking API, other queued transactions are served in order of priority
+Status transfer(Transaction* t);
+i2c::Error write(const Client* client, const uint8_t* cmd, uint8_t ncmd, const uint8_t* tx, uint16_t ntx);
+i2c::Error read(const Client* client, const uint8_t* cmd, uint8_t ncmd, uint8_t* rx, uint16_t nrx);
+i2c::Error probe(const Client* client);	// Ok if slave ACKs its address
+
+void test(void);
+
+} // namespace
+
+#endif	// I2C_BUS_H
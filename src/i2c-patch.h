@@ -1,12 +0,0 @@
-#ifndef ASDF
-#define ASDF
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-void i2c_clock_config2(uint32_t i2c_periph, uint32_t clkspeed, uint32_t dutycyc);
-
-#ifdef __cplusplus
-}
-#endif	// __cplusplus
-#endif
@@ -0,0 +1,406 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200209
+
+// #define DEBUG_I2C_SLAVE
+#ifndef DEBUG_I2C_SLAVE
+#undef DEBUG
+#endif // DEBUG_I2C_SLAVE
+
+#include "i2c-slave.hpp"
+#include "i2c_hw.hpp"
+#include "gd32vf103.h"
+#include "gd32vf103_eclic.h"
+#include "n200_func.h"		// eclic_enable_interrupt()
+#include "delay.h"
+#include "baro.hpp"
+#include "wii-nunchuck.hpp"
+
+namespace i2c_slave
+{
+	using namespace i2c;
+
+// private types:
+typedef struct
+{
+	IRQn_Type	event;
+	IRQn_Type	error;
+} IrqMap;
+
+static const IrqMap IrqMaps[] = {
+	// event			error
+	{I2C0_EV_IRQn,		I2C0_ER_IRQn},
+	{I2C1_EV_IRQn,		I2C1_ER_IRQn},
+};
+
+static RegFile* regfiles[2];	// index is i2c::Device, NULL when not slave
+
+// register file, no HW here												{{{
+// ----------------------------------------------------------------------------
+static void on_write_end(RegFile* rf)
+{
+	if ((rf->state == State::Writing) && (rf->nwritten != 0) && (rf->on_write != NULL))
+	{
+		rf->on_write(rf->arg, rf->start, rf->nwritten);
+	}
+}
+
+// our address matched
+static void on_address(RegFile* rf, bool is_read)
+{
+	// write part of write + RESTART + read sequence
+	on_write_end(rf);
+
+	if (is_read)
+	{
+		rf->state = State::Reading;
+		if (rf->on_read != NULL)
+		{
+			rf->on_read(rf->arg, rf->pointer);
+		}
+	}
+	else
+	{
+		rf->state    = State::Pointer;
+		rf->nwritten = 0;
+	}
+}
+
+static void on_receive(RegFile* rf, uint8_t byte)
+{
+	if (rf->state == State::Pointer)
+	{
+		rf->pointer = byte;
+		rf->start   = byte;
+		rf->state   = State::Writing;
+	}
+	else if (rf->state == State::Writing)
+	{
+		const uint8_t r = rf->pointer;
+		if ((r < rf->size) && (r >= rf->first_writable))
+		{
+			rf->regs[r] = byte;
+		}
+		rf->pointer++;
+		rf->nwritten++;
+	}
+}
+
+static uint8_t on_transmit(RegFile* rf)
+{
+	const uint8_t r = rf->pointer++;
+	return (r < rf->size) ? rf->regs[r] : I2C_SLAVE_EMPTY;
+}
+
+static void on_stop(RegFile* rf)
+{
+	on_write_end(rf);
+	rf->state = State::Idle;
+}
+
+// master NACKs last byte it wants to read
+static void on_nack(RegFile* rf)
+{
+	if (rf->state == State::Reading)
+	{
+		// one byte more was already put to DATA when master NACKed
+		rf->pointer--;
+	}
+	rf->state = State::Idle;
+}
+// ------------------------------------------------------------------------ }}}
+
+// slave sequences are the same as on STM32F1, see RM0008 "I2C slave mode"
+static void event_irq(Device dev)
+{
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	RegFile* rf = regfiles[(uint8_t)dev];
+	const uint32_t stat0 = reg->STAT0;
+
+	if (rf == NULL)
+	{
+		return;
+	}
+
+	if (stat0 & (1 << (uint8_t)Stat0Bits::ADDSEND))
+	{
+		// reading STAT1 after STAT0 clears ADDSEND
+		const uint32_t stat1 = reg->STAT1;
+		on_address(rf, (stat1 >> (uint8_t)Stat1Bits::TR) & 1);
+	}
+
+	if (stat0 & (1 << (uint8_t)Stat0Bits::RBNE))
+	{
+		on_receive(rf, reg->DATA);
+	}
+
+	if ((stat0 & (1 << (uint8_t)Stat0Bits::TBE)) && (rf->state == State::Reading))
+	{
+		reg->DATA = on_transmit(rf);
+	}
+
+	if (stat0 & (1 << (uint8_t)Stat0Bits::STPDET))
+	{
+		// cleared by reading STAT0 (done above) and writing CTL0
+		reg->CTL0 = reg->CTL0;
+		on_stop(rf);
+	}
+}
+
+static void error_irq(Device dev)
+{
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	RegFile* rf = regfiles[(uint8_t)dev];
+	const uint32_t stat0 = reg->STAT0;
+	const uint32_t aerr  = (1 << (uint8_t)Stat0Bits::AERR);
+	const uint32_t other = (1 << (uint8_t)Stat0Bits::BERR) |
+		(1 << (uint8_t)Stat0Bits::LOSTARB) | (1 << (uint8_t)Stat0Bits::OUERR);
+
+	// error flags are cleared by writing 0
+	reg->STAT0 = ~(aerr | other);
+
+	if (rf == NULL)
+	{
+		return;
+	}
+
+	if (stat0 & aerr)
+	{
+		// normal end of master read, not an error
+		on_nack(rf);
+	}
+	if (stat0 & other)
+	{
+		dprintf("I2C%d slave error, STAT0: 0x%x\r\n", dev, stat0);
+		rf->state = State::Idle;
+	}
+}
+
+Error init(Device dev, uint8_t address, RegFile* rf)
+{
+	if ((dev == Device::wrong) || (rf == NULL) || (rf->size == 0) || (rf->size > 256))
+	{
+		return Error::WrongArgument;
+	}
+
+	// GPIO, clocks and CTL1.I2CCLK, SCL speed is not used in slave mode
+	I2C_CHECK(i2c::init(dev, Speed::Speed100kHz, DutyCycle::Duty2));
+
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	const IrqMap* irq = &IrqMaps[(uint8_t)dev];
+
+	rf->state    = State::Idle;
+	rf->pointer  = 0;
+	rf->nwritten = 0;
+	regfiles[(uint8_t)dev] = rf;
+
+	// 7 bit address in bits 7..1, ADDFORMAT = 0
+	reg->SADDR0 = (address & 0xFE);
+	reg->CTL0  |= (1 << (uint8_t)Ctl0Bits::ACKEN);
+	reg->CTL1  |= (1 << (uint8_t)Ctl1Bits::EVIE) | (1 << (uint8_t)Ctl1Bits::BUFIE) |
+		(1 << (uint8_t)Ctl1Bits::ERRIE);
+
+	eclic_global_interrupt_enable();
+	eclic_priority_group_set(ECLIC_PRIGROUP_LEVEL3_PRIO1);
+	eclic_irq_enable(irq->event, 1, 0);
+	eclic_irq_enable(irq->error, 1, 0);
+
+	return Error::Ok;
+}
+
+void deinit(Device dev)
+{
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	const IrqMap* irq = &IrqMaps[(uint8_t)dev];
+
+	eclic_irq_disable(irq->event);
+	eclic_irq_disable(irq->error);
+	reg->CTL1 &= ~((1 << (uint8_t)Ctl1Bits::EVIE) | (1 << (uint8_t)Ctl1Bits::BUFIE) |
+		(1 << (uint8_t)Ctl1Bits::ERRIE));
+	reg->CTL0 &= ~(1 << (uint8_t)Ctl0Bits::ACKEN);
+	reg->SADDR0 = 0;
+	regfiles[(uint8_t)dev] = NULL;
+}
+
+bool update(Device dev, uint8_t reg, const uint8_t* data, uint8_t n)
+{
+	RegFile* rf = regfiles[(uint8_t)dev];
+	const IRQn_Type irq = IrqMaps[(uint8_t)dev].event;
+	bool done = 0;
+
+	ASSERT(rf != NULL);
+	ASSERT(reg + n <= rf->size);
+
+	// master can't start reading while interrupt is off: SCL is stretched
+	eclic_disable_interrupt(irq);
+	if (rf->state != State::Reading)
+	{
+		for (uint8_t i = 0; i < n; i++)
+		{
+			rf->regs[reg + i] = data[i];
+		}
+		done = 1;
+	}
+	eclic_enable_interrupt(irq);
+
+	return done;
+}
+
+// sensor hub example														{{{
+// ----------------------------------------------------------------------------
+// BMP180 and nunchuck on I2C0 (master), hub registers on I2C1 (slave)
+// master reads everything with one transaction: 0x00, RESTART, 14 bytes
+#define HUB_ADDR		0x84	// 0x42 in 7 bit format
+
+enum class HubReg: uint8_t
+{
+	ID			= 0x00,		// HUB_ID
+	Sequence	= 0x01,		// incremented on each update
+	Temperature	= 0x02,		// [2B] big endian, 0.1 °C
+	Pressure	= 0x04,		// [4B] big endian, Pa
+	Nunchuck	= 0x08,		// [6B] raw nunchuck report
+	Period		= 0x0E,		// RW: update period in 10 ms
+	Size,
+};
+
+#define HUB_ID			0x48
+
+static uint8_t hub_regs[(uint8_t)HubReg::Size];
+static volatile uint8_t hub_period = 10;
+
+static void hub_on_write(void* arg, uint8_t reg, uint8_t n)
+{
+	(void)arg;
+	if ((reg <= (uint8_t)HubReg::Period) && (reg + n > (uint8_t)HubReg::Period))
+	{
+		const uint8_t period = hub_regs[(uint8_t)HubReg::Period];
+		hub_period = (period != 0) ? period : 1;
+	}
+}
+
+void example(void)
+{
+	static RegFile rf = {};
+	rf.regs           = hub_regs;
+	rf.size           = sizeof(hub_regs);
+	rf.first_writable = (uint8_t)HubReg::Period;
+	rf.on_write       = hub_on_write;
+
+	hub_regs[(uint8_t)HubReg::ID]     = HUB_ID;
+	hub_regs[(uint8_t)HubReg::Period] = hub_period;
+
+	baro::init(Device::myI2C0);
+	wii_nunchuck::init();
+	if (init(Device::myI2C1, HUB_ADDR, &rf) != Error::Ok)
+	{
+		eprintf("I2C1 slave init failed\r\n");
+		return;
+	}
+
+	uint8_t sequence = 0;
+	while (1)
+	{
+		// same order as HubReg, from Sequence up to Period
+		uint8_t buf[(uint8_t)HubReg::Period - (uint8_t)HubReg::Sequence];
+		const uint16_t t = baro::get_temperature();
+		const int32_t  p = baro::get_pressure();
+
+		buf[0] = ++sequence;
+		buf[1] = t >> 8;
+		buf[2] = t;
+		buf[3] = p >> 24;
+		buf[4] = p >> 16;
+		buf[5] = p >> 8;
+		buf[6] = p;
+		if (wii_nunchuck::read_raw(&buf[7]) != Error::Ok)
+		{
+			for (uint8_t i = 7; i < sizeof(buf); i++)
+			{
+				buf[i] = I2C_SLAVE_EMPTY;
+			}
+		}
+
+		while (update(Device::myI2C1, (uint8_t)HubReg::Sequence, buf, sizeof(buf)) == 0);
+		delay_ms(hub_period * 10);
+	}
+}
+// ------------------------------------------------------------------------ }}}
+
+// tests						 											{{{
+// ----------------------------------------------------------------------------
+// register file only, ISR is simulated with on_*() calls
+static uint8_t test_written_reg;
+static uint8_t test_written_n;
+
+static void test_on_write(void* arg, uint8_t reg, uint8_t n)
+{
+	(void)arg;
+	test_written_reg = reg;
+	test_written_n   = n;
+}
+
+static void test_regfile(void)
+{
+	uint8_t regs[4] = {0x10, 0x11, 0x12, 0x13};
+	RegFile rf = {};
+	rf.regs           = regs;
+	rf.size           = sizeof(regs);
+	rf.first_writable = 2;
+	rf.on_write       = test_on_write;
+
+	// write 3 bytes from reg 1: reg 1 is read only, last one is past the end
+	on_address(&rf, 0);
+	on_receive(&rf, 1);
+	on_receive(&rf, 0xA1);
+	on_receive(&rf, 0xA2);
+	on_receive(&rf, 0xA3);
+	on_stop(&rf);
+	ASSERT_EQ(regs[1], 0x11);
+	ASSERT_EQ(regs[2], 0xA2);
+	ASSERT_EQ(regs[3], 0xA3);
+	ASSERT_EQ(test_written_reg, 1);
+	ASSERT_EQ(test_written_n, 3);
+	ASSERT_EQ((uint8_t)rf.state, (uint8_t)State::Idle);
+
+	// set pointer, RESTART, read 2 bytes, master NACKs the second one
+	test_written_n = 0;
+	on_address(&rf, 0);
+	on_receive(&rf, 2);
+	on_address(&rf, 1);
+	ASSERT_EQ(on_transmit(&rf), 0xA2);
+	ASSERT_EQ(on_transmit(&rf), 0xA3);
+	ASSERT_EQ(on_transmit(&rf), I2C_SLAVE_EMPTY);	// already in DATA on NACK
+	on_nack(&rf);
+	ASSERT_EQ(test_written_n, 0);
+	ASSERT_EQ(rf.pointer, 4);
+}
+
+void test(void)
+{
+	test_regfile();
+}
+// ------------------------------------------------------------------------ }}}
+
+} // namespace
+
+extern "C"	// don't mangle
+{
+void I2C0_EV_IRQHandler(void)
+{
+	i2c_slave::event_irq(i2c::Device::myI2C0);
+}
+
+void I2C0_ER_IRQHandler(void)
+{
+	i2c_slave::error_irq(i2c::Device::myI2C0);
+}
+
+void I2C1_EV_IRQHandler(void)
+{
+	i2c_slave::event_irq(i2c::Device::myI2C1);
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+	i2c_slave::error_irq(i2c::Device::myI2C1);
+}
+}	// extern "C"	// don't mangle
@@ -0,0 +1,69 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200209
+// I2C slave: GD32V looks like a sensor with registers to some other master
+//
+// master write: START, address+W, register, data[], STOP
+//   first byte sets register pointer, data is written from there
+// master read:  START, address+W, register, RESTART, address+R, data[], STOP
+//   or without register part to continue from current pointer
+// register pointer is auto incremented after each byte, reads past the end
+// of register file return 0xFF, writes past the end are ignored
+//
+// bus used as slave can't be used by i2c/i2c_bus master drivers
+
+#ifndef I2C_SLAVE_H
+#define I2C_SLAVE_H
+
+#include <stdint.h>
+#include "i2c.hpp"
+
+#define I2C_SLAVE_EMPTY		0xFF	// read from non existing register
+
+namespace i2c_slave
+{
+
+enum class State: uint8_t
+{
+	Idle = 0,
+	Pointer,	// addressed for write, next byte is register
+	Writing,	// master is writing registers
+	Reading,	// master is reading registers
+};
+
+// both are called from ISR, keep them short
+// master starts reading from reg: last chance to refresh registers
+typedef void (*ReadCallback)(void* arg, uint8_t reg);
+// master wrote n bytes starting with reg (read only registers are counted too)
+typedef void (*WriteCallback)(void* arg, uint8_t reg, uint8_t n);
+
+typedef struct
+{
+	uint8_t*		regs;
+	uint16_t		size;			// 1..256, register address is 1 byte
+	uint8_t			first_writable;	// registers below are read only for master
+	ReadCallback	on_read;		// can be NULL
+	WriteCallback	on_write;		// can be NULL
+	void*			arg;
+
+	// used by slave driver:
+	volatile State	state;
+	volatile uint8_t pointer;		// next register
+	uint8_t			start;			// first register of current write
+	uint8_t			nwritten;
+} RegFile;
+
+// address is 8 bit address like for master drivers, R/W bit is ignored
+i2c::Error init(i2c::Device dev, uint8_t address, RegFile* rf);
+void deinit(i2c::Device dev);
+
+// copy data to registers from main loop, doesn't touch registers while master
+// is reading them (returns 0, try again later) so master never reads half
+// old and half new value
+bool update(i2c::Device dev, uint8_t reg, const uint8_t* data, uint8_t n);
+
+void example(void);
+void test(void);
+
+} // namespace
+
+#endif // I2C_SLAVE_H
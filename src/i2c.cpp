@@ -2,15 +2,17 @@
 // created 141205 - STM32F1 C
 // Created 200104 - GD32V C+
 
+// #define DEBUG_I2C
+#ifndef DEBUG_I2C
+#undef DEBUG
+#endif // DEBUG_I2C
+
 #include "i2c.hpp"
-#include "i2c-patch.h"
+#include "i2c_hw.hpp"
 #include "delay.h"
+#include "n200_func.h"	// get_timer_value()
 #include "libc-bits.h"	// strlen()
 #include "gd32vf103_rcu.h"
-#include "gd32vf103_i2c.h"
-
-#define I2C_DTCY_2		((uint32_t)0x00000000U)
-#define I2C0			I2C_BASE
 
 namespace i2c
 {
@@ -20,110 +22,74 @@ namespace i2c
 
 // HW registers and bits		 											{{{
 // ----------------------------------------------------------------------------
-const uint32_t address_I2C0 = 0x40005400;
-const uint32_t address_I2C1 = 0x40005800;
-
-typedef struct
-{
-	volatile uint32_t	CTL0;		// control 0
-	volatile uint32_t	CTL1;		// control 1
-	volatile uint32_t	SADDR0;		// slave address
-	volatile uint32_t	SADDR1;		// slave address for dual address mode
-	volatile uint32_t	DATA;
-	volatile uint32_t	STAT0;
-	volatile uint32_t	STAT1;
-	volatile uint32_t	CKCFG;
-	volatile uint32_t	RT;
-} I2cReg;
-
 static volatile I2cReg* myI2C0 = (I2cReg*)address_I2C0;
 static volatile I2cReg* myI2C1 = (I2cReg*)address_I2C1;
 
-typedef struct
-{
-	Device				dev;
-	volatile I2cReg*	reg;
-	GpioPin				scl;
-	GpioPin				sda;
-} DevMap;
-
-DevMap DevMaps[] = {
-	// dev				reg		scl		sda
-	{Device::myI2C0,	myI2C0, PB6,	PB7},
-	{Device::myI2C1,	myI2C1, PB10,	PB11},
-};
-
-enum class Ctl0Bits: uint8_t
-{
-	SRESET		= 15,	// software reset
-	SALT		= 13,	// SMBus ...
-	PECTRANS	= 12,	// PEC ...
-	POAP		= 11,	// NACK position
-	ACKEN		= 10,	// to ACK or to not ACK
-	STOP		= 9,	// generate STOP
-	START		= 8,	// generate START
-	SS			= 7,	// stretch clock when data is not ready in slave mode
-	GCEN		= 6,	// general call
-	PECEN		= 5,	// PEC...
-	ARPEN		= 4,	// SMBus...
-	SMBSEL		= 3,	// SMBus...
-	SMBEN		= 1,	// SMBus...
-	I2CEN		= 0,	// enable
+const DevMap DevMaps[] = {
+	// dev				reg		scl		sda		clock
+	{Device::myI2C0,	myI2C0, PB6,	PB7,	RCU_I2C0},
+	{Device::myI2C1,	myI2C1, PB10,	PB11,	RCU_I2C1},
 };
 
 bool get_flag(Device dev, Flag flag);
-void ack(Device dev);
-void nack(Device dev);
+static Error get_error(Device dev);
+
+// timeout for one flag, in mtime ticks, per bus, set in init()
+static uint64_t timeouts[2];
+
+// busy wait for bit-banged recovery, no need for anything precise
+static void wait_us(uint32_t us)
+{
+	const uint64_t end = get_timer_value() + delay_us_to_ticks(us);
+	while (get_timer_value() < end);
+}
 
-// Basic error "handling":
-// - don't stuck until forever if there is error on I2C
-// - has simple SW timeout
-// TODO: return something and check value later in code (one day, for proper error handling which will be hard to implement correctly and which will be easy to use)
-#define wait_until_flag(dev, flag, condition) _wait_until_flag(dev, flag, condition, __func__, __FILE__, __LINE__);
-void _wait_until_flag(Device dev, Flag flag, uint8_t condition, const char* fn_name, const char* file, uint32_t line)
+// wait while flag == condition
+// - time based timeout (doesn't depend on CPU clock or optimization level)
+// - returns as soon as slave NACKs or bus error is detected, no need to wait
+//   for timeout
+Error _wait_until_flag(Device dev, Flag flag, uint8_t condition, const char* fn_name, const char* file, uint32_t line)
 {
-	uint32_t timeout = I2C_TIMEOUT_MAX;
+	const uint64_t deadline = get_timer_value() + timeouts[(uint8_t)dev];
 
 	while (get_flag(dev, flag) == condition)
 	{
-		if ((timeout--) == 0)
+		Error err = get_error(dev);
+		if (err != Error::Ok)
 		{
-			rprintf("TIMEOUT for I2C dev: %d in func: %s()\r\n", dev, fn_name);
-			return;
+			dprintf("I2C%d error %d in %s() %s:%d\r\n", dev, err, fn_name, file, line);
+			return err;
+		}
+		if (get_timer_value() > deadline)
+		{
+			dprintf("TIMEOUT for I2C dev: %d in func: %s() %s:%d\r\n", dev, fn_name, file, line);
+			return Error::Timeout;
 		}
 	}
-}
 
-// TODO 200126: replace Timed()
-// #define wait_while(condition) \
-// 	uint32_t timeout2 = 0xFFF;\
-// 	while(condition) { if ((timeout2--) == 0) { \
-// 		rprintf("I2C TIMEOUT in func: %s()\r\n", __func__); return; \
-// 	} }
+	return Error::Ok;
+}
 
-void reset_bus(Device dev)
+void set_timeout(Device dev, uint32_t us)
 {
-	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
-	// while (reg->STAT1 & (1 << (uint8_t)Stat1Bits::I2CBSY));
-	reg->STAT0 |= (1 << (uint8_t)Ctl0Bits::SRESET);
+	timeouts[(uint8_t)dev] = delay_us_to_ticks(us);
 }
 
-void ack(Device dev)
+Error ack(Device dev)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 	reg->CTL0 |= (1 << (uint8_t)Ctl0Bits::ACKEN);
-	// dprintf("wait ack\r\n");
-	while (!(reg->CTL0 & (1 << (uint8_t)Ctl0Bits::ACKEN)));
+	return Error::Ok;
 }
 
-void nack(Device dev)
+Error nack(Device dev)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 	reg->CTL0 &= ~(1 << (uint8_t)Ctl0Bits::ACKEN);
-	while ((reg->CTL0 & (1 << (uint8_t)Ctl0Bits::ACKEN)));
+	return Error::Ok;
 }
 
-void nack_position(Device dev, NackPosition pos)
+Error nack_position(Device dev, NackPosition pos)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 
@@ -135,67 +101,131 @@ void nack_position(Device dev, NackPosition pos)
 	{
 		reg->CTL0 |= (1 << (uint8_t)Ctl0Bits::POAP);
 	}
+	return Error::Ok;
 }
 
-enum class Ctl1Bits: uint8_t
-{
-	DMALST	= 12,	// something DMA related
-	DMAON	= 11,	// DMA enable/disable
-	BUFIE	= 10,	// interrupt when TBE = 1 or RBNE = 1
-	EVIE	= 9,	// event interrupt enable (when ADDSEND = 1, BTC = 1, or (if BUFIE =1) RBNE=1 or TBE=1
-	ERRIE	= 8,	// error interrupt enable
-	I2CLK	= 0,	// [5b] value of APB1 clock in MHz. Must be between 2 MHz (0b10) and 54 MHz (110110)
-	// If SCL == 100 kHz -> I2CLK must be >= 2MHz
-	// If SCL == 400 kHz -> I2CLK must be >= 8MHz
-	// If SCL >  400 kHz -> I2CLK must be >= 24MHz
-};
 
-enum class Saddr0Bits: uint8_t
-{
-	ADDFORMAT	= 15,
-	ADDRESS		= 0,	// 10 or 7 bit part of address
-						// b0 - R or W bit of address
-};
 
-enum class AddressLength: uint8_t
+
+
+
+// check and clear error flags in STAT0
+static Error get_error(Device dev)
 {
-	// bit SADDR0.ADDFORMAT
-	SevenBits	= 0,
-	TenBits		= 1,
-};
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	const uint32_t stat0 = reg->STAT0;
+	const uint32_t aerr    = (1 << (uint8_t)Stat0Bits::AERR);
+	const uint32_t lostarb = (1 << (uint8_t)Stat0Bits::LOSTARB);
+	const uint32_t berr    = (1 << (uint8_t)Stat0Bits::BERR);
 
-enum class Stat0Bits: uint8_t
-{
-	SMBALT		= 15,	// SMBus...
-	SMBTO		= 14,	// SMBus...
-	PECERR		= 12,	// PEC...
-	OUERR		= 11,	// over/under-run in slave mode, when SCL stretching id siabled
-	AERR		= 10,	// ACK error
-	LOSTARB		= 9,	// arbitration lost
-	BERR		= 8,	// unexpected START or STOP occurs
-	TBE			= 7,	// TX empty
-	RBNE		= 6,	// RX not empty
-	STPDET		= 4,	// STOP detected in slave mode
-	ADD10SEND	= 3,	// 10 bit address sent
-	BTC			= 2,	// byte transmission completed
-	ADDSEND		= 1,	// address is sent to slave
-	SBSEND		= 0,	// START sent to slave
-};
+	if ((stat0 & (aerr | lostarb | berr)) == 0)
+	{
+		return Error::Ok;
+	}
 
-enum class Stat1Bits: uint8_t
+	// error flags are cleared by writing 0, writing 1 has no effect
+	reg->STAT0 = ~(aerr | lostarb | berr);
+
+	if (stat0 & berr)
+	{
+		return Error::BusError;
+	}
+	if (stat0 & lostarb)
+	{
+		return Error::ArbitrationLost;
+	}
+	return Error::Nack;
+}
+
+
+
+// values for CKCFG, RT and FMPCFG for one SCL speed
+typedef struct
 {
-	PECV		= 8,	// [8b] PEC...
-	DUMODF		= 7,	// related to dual address mode thing
-	HSTSMB		= 6,	// SMBus..
-	DEFSMB		= 5,	// SMBus..
-	RXGC		= 4,	// general call
-	TR			= 2,	// Tx or RX? 0 = Rx, 1 = TX
-	I2CBSY		= 1,	// 1 when busy
-	MASTER		= 0,	// 0 = slave, 1 = master mode
-};
+	uint32_t	i2cclk;		// CTL1.I2CCLK, APB1 in MHz
+	uint32_t	ckcfg;
+	uint32_t	rt;
+	uint32_t	fmpcfg;
+} ClockCfg;
+
+// limits from user manual
+const uint32_t i2cclk_min		= 2;		// MHz
+const uint32_t i2cclk_max		= 54;		// MHz
+const uint32_t clkc_max			= 0xFFF;
+const uint32_t scl_standard_max	= 100000;
+const uint32_t scl_fast_max		= 400000;
+const uint32_t scl_fmp_max		= 1000000;
+
+// calculate registers for SCL <= scl_hz (never faster than requested)
+// returns achieved SCL frequency, 0 if it can't be done with this APB1 clock
+static uint32_t calc_clock(uint32_t pclk, uint32_t scl_hz, DutyCycle duty, ClockCfg* cfg)
+{
+	const uint32_t i2cclk = pclk / 1000000;
+	uint32_t divider;			// SCL period in pclk periods per CLKC
+	uint32_t rise_ns;			// max SCL rise time allowed by I2C spec
+	uint32_t i2cclk_needed;		// min APB1 in MHz for this mode
+
+	if ((scl_hz == 0) || (scl_hz > scl_fmp_max) || (i2cclk < i2cclk_min) || (i2cclk > i2cclk_max))
+	{
+		return 0;
+	}
+
+	cfg->i2cclk = i2cclk;
+	cfg->ckcfg  = 0;
+	cfg->fmpcfg = 0;
+
+	if (scl_hz <= scl_standard_max)
+	{
+		// Thigh = Tlow = CLKC * Tpclk
+		divider = 2;
+		rise_ns = 1000;
+		i2cclk_needed = 2;
+	}
+	else
+	{
+		// Thigh = CLKC * Tpclk, Tlow = 2 * Thigh, or
+		// Thigh = 9 * CLKC * Tpclk, Tlow = 16 * CLKC * Tpclk
+		divider = (duty == DutyCycle::Duty16_9) ? 25 : 3;
+		rise_ns = 300;
+		i2cclk_needed = 8;
+		cfg->ckcfg |= (1 << (uint8_t)CkcfgBits::FAST);
+		if (duty == DutyCycle::Duty16_9)
+		{
+			cfg->ckcfg |= (1 << (uint8_t)CkcfgBits::DTCY);
+		}
+		if (scl_hz > scl_fast_max)
+		{
+			rise_ns = 120;
+			i2cclk_needed = 24;
+			cfg->fmpcfg = (1 << (uint8_t)FmpcfgBits::FMPEN);
+		}
+	}
+
+	if (i2cclk < i2cclk_needed)
+	{
+		return 0;
+	}
+
+	// round up: slower SCL is always safe, faster is not
+	uint32_t clkc = (pclk + divider * scl_hz - 1) / (divider * scl_hz);
+	if ((scl_hz <= scl_standard_max) && (clkc < 4))
+	{
+		clkc = 4;	// standard mode minimum
+	}
+	if (clkc == 0)
+	{
+		clkc = 1;
+	}
+	if (clkc > clkc_max)
+	{
+		return 0;
+	}
 
+	cfg->ckcfg |= (clkc << (uint8_t)CkcfgBits::CLKC);
+	cfg->rt     = (i2cclk * rise_ns) / 1000 + 1;
 
-// void set_i2c_clock(
+	return pclk / (divider * clkc);
+}
 
 // ------------------------------------------------------------------------ }}}
 // HW tests						 											{{{
@@ -214,6 +244,7 @@ static void test_address(void)
 	ASSERT_EQ((uint32_t)&myI2C0->STAT1,		address_I2C0 + 0x18);
 	ASSERT_EQ((uint32_t)&myI2C0->CKCFG,		address_I2C0 + 0x1C);
 	ASSERT_EQ((uint32_t)&myI2C0->RT,		address_I2C0 + 0x20);
+	ASSERT_EQ((uint32_t)&myI2C0->FMPCFG,	address_I2C0 + 0x90);
 }
 
 static void test_map(void)
@@ -225,10 +256,43 @@ static void test_map(void)
 	ASSERT_EQ((uint32_t)reg, address_I2C1);
 }
 
+// only calculation, registers are not touched
+static void test_clock(void)
+{
+	ClockCfg cfg;
+	const uint32_t pclk = 54000000;
+
+	ASSERT_EQ(calc_clock(pclk, 100000, DutyCycle::Duty2, &cfg), 100000);
+	ASSERT_EQ(cfg.ckcfg, 270);
+	ASSERT_EQ(cfg.rt, 55);
+	ASSERT_EQ(cfg.fmpcfg, 0);
+
+	ASSERT_EQ(calc_clock(pclk, 400000, DutyCycle::Duty2, &cfg), 400000);
+	ASSERT_EQ(cfg.ckcfg, (1 << 15) | 45);
+	ASSERT_EQ(cfg.rt, 17);
+
+	ASSERT_EQ(calc_clock(pclk, 400000, DutyCycle::Duty16_9, &cfg), 360000);
+	ASSERT_EQ(cfg.ckcfg, (1 << 15) | (1 << 14) | 6);
+
+	ASSERT_EQ(calc_clock(pclk, 1000000, DutyCycle::Duty2, &cfg), 1000000);
+	ASSERT_EQ(cfg.ckcfg, (1 << 15) | 18);
+	ASSERT_EQ(cfg.rt, 7);
+	ASSERT_EQ(cfg.fmpcfg, 1);
+
+	// never faster than asked for
+	ASSERT_EQ(calc_clock(pclk, 350000, DutyCycle::Duty2, &cfg), 346153);
+
+	// APB1 too slow for fast mode plus, SCL too fast or too slow
+	ASSERT_EQ(calc_clock(12000000, 1000000, DutyCycle::Duty2, &cfg), 0);
+	ASSERT_EQ(calc_clock(pclk, 2000000, DutyCycle::Duty2, &cfg), 0);
+	ASSERT_EQ(calc_clock(pclk, 1000, DutyCycle::Duty2, &cfg), 0);
+}
+
 void test(void)
 {
 	test_address();
 	test_map();
+	test_clock();
 }
 // ------------------------------------------------------------------------ }}}
 
@@ -273,7 +337,7 @@ bool get_flag(Device dev, Flag flag)
 	};
 }
 
-void clear_flag(Device dev, Flag flag)
+Error clear_flag(Device dev, Flag flag)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 	switch (flag)
@@ -282,81 +346,131 @@ void clear_flag(Device dev, Flag flag)
 			// cleared by reading STAT0 and STAT1
 			(void)reg->STAT0;
 			(void)reg->STAT1;
-			break;
+			return Error::Ok;
 		default:
 			eprintf("Flag not cleared: 0x%x\r\n", flag);
-			break;
+			return Error::WrongArgument;
 	};
 }
 
-void init(Device dev, Speed speed, DutyCycle duty)
+Error init(Device dev, Speed speed, DutyCycle duty)
 {
-	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	if (dev == Device::wrong)
+	{
+		return Error::WrongArgument;
+	}
+
+	set_timeout(dev, I2C_TIMEOUT_US);
 
-	printf("CTL1.I2CLK: %d\r\n",	reg->CTL1 & 0x1F);
-	i2c_clock_config2(I2C0, 400000, I2C_DTCY_2);
-	printf("CTL1.I2CLK: %d\r\n",	reg->CTL1 & 0xFF);
-	printf("CTL1: 0x%d\r\n",	reg->CTL1);
-	// 100 kHz: CLK: 54, CTL1: 0x54 = 84 = 1010100
-	// 200 kHz: CLK: 54, CTL1:
+	// GPIO init, both I2C are on GPIOB
+	rcu_periph_clock_enable(RCU_GPIOB);
+	rcu_periph_clock_enable(RCU_AF);
+	rcu_periph_clock_enable(DevMaps[(uint8_t)dev].clock);
+	gpio_init2(DevMaps[(uint8_t)dev].scl, AfioOD, Speed50MHz);
+	gpio_init2(DevMaps[(uint8_t)dev].sda, AfioOD, Speed50MHz);
 
-	// write APB1 clock in MHz to CTL1.I2CLK
-	uint8_t clk_apb1 = rcu_clock_freq_get(CK_APB1) / 1000000;		// TODO 200106: replace with my RCU
-	printf("APB1 clock: %d MHz\r\n", clk_apb1);
+	return set_speed(dev, speed, duty);
+}
 
-	switch (speed)
+// SCL frequency set by last set_clock(), per bus
+static uint32_t clocks[2];
+
+// set SCL to scl_hz or the closest lower frequency possible with APB1 clock
+// - up to 100 kHz standard mode, up to 400 kHz fast mode, up to 1 MHz fast
+//   mode plus (needs APB1 >= 24 MHz)
+// - duty is ignored in standard mode
+// - achieved frequency is returned in achieved_hz (can be NULL)
+Error set_clock(Device dev, uint32_t scl_hz, DutyCycle duty, uint32_t* achieved_hz)
+{
+	if (dev == Device::wrong)
 	{
-		case Speed::Speed100kHz:
-			ASSERT(clk_apb1 >= 2);
-			break;
+		return Error::WrongArgument;
 	}
 
-	reg->CTL1 |= clk_apb1 << (uint8_t)Ctl1Bits::I2CLK;
-	enable(dev);
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	ClockCfg cfg;
+
+	const uint32_t hz = calc_clock(rcu_clock_freq_get(CK_APB1), scl_hz, duty, &cfg);		// TODO 200106: replace with my RCU
+	if (hz == 0)
+	{
+		eprintf("I2C%d: SCL %d Hz not possible\r\n", dev, scl_hz);
+		return Error::WrongArgument;
+	}
+	dprintf("I2C%d: SCL %d Hz (asked %d Hz), CKCFG: 0x%x RT: %d\r\n", dev, hz, scl_hz, cfg.ckcfg, cfg.rt);
+
+	// CKCFG and RT can be changed only when I2C is disabled. disable() clears
+	// I2CEN even on timeout: busy bus is checked first, peripheral stays as is
+	I2C_CHECK(wait_until_flag(dev, Flag::BSY, 1));
+	I2C_CHECK(disable(dev));
+	reg->CTL1   = (reg->CTL1 & ~0x3F) | (cfg.i2cclk << (uint8_t)Ctl1Bits::I2CLK);
+	reg->CKCFG  = cfg.ckcfg;
+	reg->RT     = cfg.rt;
+	reg->FMPCFG = cfg.fmpcfg;
+	clocks[(uint8_t)dev] = hz;
+
+	if (achieved_hz != NULL)
+	{
+		*achieved_hz = hz;
+	}
+	return enable(dev);
+}
+
+uint32_t get_clock(Device dev)
+{
+	return clocks[(uint8_t)dev];
+}
+
+// change SCL speed on already initialized bus
+// used by i2c_bus when devices with different speeds share one bus
+Error set_speed(Device dev, Speed speed, DutyCycle duty)
+{
+	return set_clock(dev, (uint32_t)speed, duty, NULL);
 }
 
 // generate start
-void start(Device dev)
+Error start(Device dev)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 
-	// wait_until_flag(dev, Flag::IsBusy, 1);
 	reg->CTL0 |= (1 << (uint8_t)Ctl0Bits::START);
-	wait_until_flag(dev, Flag::SBSEND, 0);
+	return wait_until_flag(dev, Flag::SBSEND, 0);
 }
 
-void restart(Device dev)
+Error restart(Device dev)
 {
 	// restart is just start without previous stop
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 
 	reg->CTL0 |= (1 << (uint8_t)Ctl0Bits::START);
-	wait_until_flag(dev, Flag::SBSEND, 0);
+	return wait_until_flag(dev, Flag::SBSEND, 0);
 }
 
-void stop(Device dev)
+Error stop(Device dev)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 	reg->CTL0 |= (1 << (uint8_t)Ctl0Bits::STOP);
+	return Error::Ok;
 }
 
-void enable(Device dev)
+Error enable(Device dev)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 	reg->CTL0 |= (1 << (uint8_t)Ctl0Bits::I2CEN);
+	return Error::Ok;
 }
 
-void disable(Device dev)
+Error disable(Device dev)
 {
-	wait_until_flag(dev, Flag::BSY, 1);
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	Error err = wait_until_flag(dev, Flag::BSY, 1);
 	reg->CTL0 &= ~(1 << (uint8_t)Ctl0Bits::I2CEN);
+	return err;
 }
 
 // send slave address to the bus. direction depends on mode (RX or TX)
 // address is send to the bus, SADDRx are used then MCU I2C is in slave mode
 // only implemented for 7 bit adresses, don't have any 10bit i2c device
-void send_addr(Device dev, uint8_t address, Mode mode)
+Error send_addr(Device dev, uint8_t address, Mode mode)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 
@@ -364,31 +478,169 @@ void send_addr(Device dev, uint8_t address, Mode mode)
 	reg->STAT0;
 
 	reg->DATA = ((address & 0xFE) | (uint8_t)mode);
-	wait_until_flag(dev, Flag::ADDSEND, 0);
+	I2C_CHECK(wait_until_flag(dev, Flag::ADDSEND, 0));
 
 	// clear ADDSEND flag:
 	reg->STAT0;
 	reg->STAT1;
+	return Error::Ok;
 }
 
-uint8_t read(Device dev)
+Error read(Device dev, uint8_t* data)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 
-	wait_until_flag(dev, Flag::RxNotEmpty, 0);
-	uint8_t data = reg->DATA;
+	I2C_CHECK(wait_until_flag(dev, Flag::RxNotEmpty, 0));
+	*data = reg->DATA;
 	// RBNE is automatically cleared
 
-	return data;
+	return Error::Ok;
 }
 
-void write(Device dev, uint8_t data)
+Error write(Device dev, uint8_t data)
 {
 	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
 
 	reg->DATA = data;
-	wait_until_flag(dev, Flag::TxEmpty, 0);
+	return wait_until_flag(dev, Flag::TxEmpty, 0);
+}
+
+// master receive: send read address (after start/restart) and read n bytes
+// NACK and STOP must be set at different moments depending on n, so this
+// can't be done with send_addr() + read() from upper layers
+Error receive(Device dev, uint8_t address, uint8_t* data, uint16_t n)
+{
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+
+	if (n == 0)
+	{
+		return Error::Ok;
+	}
+
+	ack(dev);
+	nack_position(dev, NackPosition::Current);
+
+	// clear SBSEND by reading STAT0 and putting header to DATA
+	reg->STAT0;
+	reg->DATA = ((address & 0xFE) | (uint8_t)Mode::Read);
+	I2C_CHECK(wait_until_flag(dev, Flag::ADDSEND, 0));
+
+	if (n == 1)
+	{
+		// NACK must be set before ADDSEND is cleared
+		nack(dev);
+		clear_flag(dev, Flag::ADDSEND);
+		stop(dev);
+		return read(dev, data);
+	}
+	else if (n == 2)
+	{
+		// NACK second byte, both bytes are read after BTC
+		nack_position(dev, NackPosition::Next);
+		nack(dev);
+		clear_flag(dev, Flag::ADDSEND);
+		I2C_CHECK(wait_until_flag(dev, Flag::BTC, 0));
+		stop(dev);
+		*data++ = reg->DATA;
+		*data   = reg->DATA;
+		nack_position(dev, NackPosition::Current);
+		return Error::Ok;
+	}
+	else
+	{
+		clear_flag(dev, Flag::ADDSEND);
+		while (n-- > 3)
+		{
+			I2C_CHECK(read(dev, data++));
+		}
+
+		// 3 bytes left: byte N-2 is in DATA, N-1 in shift register
+		I2C_CHECK(wait_until_flag(dev, Flag::BTC, 0));
+		nack(dev);
+		*data++ = reg->DATA;	// N-2
+		stop(dev);
+		*data++ = reg->DATA;	// N-1
+		return read(dev, data);	// N
+	}
+}
+
+// bus recovery																{{{
+// ----------------------------------------------------------------------------
+// slave which was interrupted in the middle of a byte (reset, glitch) can hold
+// SDA low forever. Clock it out with SCL pulses, generate STOP by hand and
+// reset the peripheral (SRESET also clears all I2C registers)
+static bool is_bus_free(Device dev)
+{
+	return (gpio_get(DevMaps[(uint8_t)dev].scl) == 1) && (gpio_get(DevMaps[(uint8_t)dev].sda) == 1);
+}
+
+Error recover(Device dev)
+{
+	volatile I2cReg* reg = DevMaps[(uint8_t)dev].reg;
+	const GpioPin scl = DevMaps[(uint8_t)dev].scl;
+	const GpioPin sda = DevMaps[(uint8_t)dev].sda;
+	const uint32_t half_period_us = 5;	// ~100 kHz
+
+	dprintf("I2C%d recovery\r\n", dev);
+
+	// registers cleared by SRESET:
+	const uint32_t ctl1  = reg->CTL1;
+	const uint32_t ckcfg = reg->CKCFG;
+	const uint32_t rt    = reg->RT;
+	const uint32_t fmp   = reg->FMPCFG;
+
+	reg->CTL0 &= ~(1 << (uint8_t)Ctl0Bits::I2CEN);
+
+	// take pins from I2C
+	gpio_set(scl);
+	gpio_set(sda);
+	gpio_init2(scl, OutOD, Speed50MHz);
+	gpio_init2(sda, OutOD, Speed50MHz);
+	wait_us(half_period_us);
+
+	// max 9 clocks: 8 data bits + ACK
+	for (uint8_t i = 0; (i < 9) && (gpio_get(sda) == 0); i++)
+	{
+		gpio_reset(scl);
+		wait_us(half_period_us);
+		gpio_set(scl);
+		wait_us(half_period_us);
+	}
+
+	// STOP: SDA low -> high while SCL is high
+	gpio_reset(scl);
+	wait_us(half_period_us);
+	gpio_reset(sda);
+	wait_us(half_period_us);
+	gpio_set(scl);
+	wait_us(half_period_us);
+	gpio_set(sda);
+	wait_us(half_period_us);
+
+	const bool free = is_bus_free(dev);
+
+	gpio_init2(scl, AfioOD, Speed50MHz);
+	gpio_init2(sda, AfioOD, Speed50MHz);
+
+	// clears BSY which could be stuck from glitches on the lines
+	reg->CTL0 |=  (1 << (uint8_t)Ctl0Bits::SRESET);
+	reg->CTL0 &= ~(1 << (uint8_t)Ctl0Bits::SRESET);
+
+	reg->CTL1  = ctl1;
+	reg->CKCFG = ckcfg;
+	reg->RT    = rt;
+	reg->FMPCFG = fmp;
+	enable(dev);
+
+	if (free == 0)
+	{
+		eprintf("I2C%d bus is stuck\r\n", dev);
+		return Error::BusStuck;
+	}
+	return Error::Ok;
 }
+// ------------------------------------------------------------------------ }}}
+
 
 
 
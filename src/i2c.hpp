@@ -10,7 +10,10 @@
 #include "gpio.hpp"
 #include "gd32vf103_rcu.h"
 
-#define I2C_TIMEOUT_MAX 0xFFFF	// for SW delay: how long to wait for I2C bus response
+#define I2C_TIMEOUT_US	1000	// default: how long to wait for one flag, in us
+
+// return error from caller, for sequences of I2C calls
+#define I2C_CHECK(x)	do { i2c::Error _err = (x); if (_err != i2c::Error::Ok) { return _err; } } while (0)
 
 namespace i2c
 {
@@ -22,17 +25,31 @@ enum class Device: uint8_t
 	wrong,
 };
 
-enum class Speed
+// returned by every I2C call
+enum class Error: uint8_t
+{
+	Ok = 0,
+	Timeout,			// flag didn't change in time
+	Nack,				// AERR, slave didn't ACK address or data
+	BusError,			// BERR, misplaced START or STOP
+	ArbitrationLost,	// LOSTARB, other master on the bus
+	BusStuck,			// SCL or SDA still low after recovery
+	Busy,				// bus manager queue full
+	WrongArgument,
+};
+
+enum class Speed: uint32_t
 {
-	// used for CKCFG.FAST
-	Speed100kHz		= 0,	// Standard
-	Speed400kHz		= 1,	// Fast
+	// SCL in Hz, any other value can be used with set_clock()
+	Speed100kHz		= 100000,	// Standard
+	Speed400kHz		= 400000,	// Fast
+	Speed1MHz		= 1000000,	// Fast mode plus
 };
 
 enum class DutyCycle
 {
 	// used for CKCFG.DTCY
-	// only used for Fast/400kHz mode
+	// only used for Fast and Fast plus modes
 	Duty2		= 0,	// Tlow/Thigh = 2
 	Duty16_9	= 1,	// Tlow/Thigh = 16/9
 };
@@ -80,25 +97,31 @@ enum class Event
 
 void test(void);
 
-void init(Device dev, Speed speed, DutyCycle duty);
-void start(Device dev);
-void restart(Device dev);
-void stop(Device dev);
-void enable(Device dev);
-void disable(Device dev);
-void send_addr(Device dev, uint8_t address, Mode mode);
-
-uint8_t read(Device dev);
-void write(Device dev, uint8_t data);
-
-void ack(Device dev);
-void nack(Device dev);
-void nack_position(Device dev, NackPosition pos);
+Error init(Device dev, Speed speed, DutyCycle duty);
+Error set_speed(Device dev, Speed speed, DutyCycle duty);
+Error set_clock(Device dev, uint32_t scl_hz, DutyCycle duty, uint32_t* achieved_hz);
+uint32_t get_clock(Device dev);
+void set_timeout(Device dev, uint32_t us);
+Error start(Device dev);
+Error restart(Device dev);
+Error stop(Device dev);
+Error enable(Device dev);
+Error disable(Device dev);
+Error send_addr(Device dev, uint8_t address, Mode mode);
+Error recover(Device dev);
+
+Error read(Device dev, uint8_t* data);
+Error write(Device dev, uint8_t data);
+Error receive(Device dev, uint8_t address, uint8_t* data, uint16_t n);
+
+Error ack(Device dev);
+Error nack(Device dev);
+Error nack_position(Device dev, NackPosition pos);
 
 // 200128 Needed for wii nunchuck:
-#define wait_until_flag(dev, flag, condition) _wait_until_flag(dev, flag, condition, __func__, __FILE__, __LINE__);
-void _wait_until_flag(Device dev, Flag flag, uint8_t condition, const char* fn_name, const char* file, uint32_t line);
-void clear_flag(Device dev, Flag flag);
+#define wait_until_flag(dev, flag, condition) _wait_until_flag(dev, flag, condition, __func__, __FILE__, __LINE__)
+Error _wait_until_flag(Device dev, Flag flag, uint8_t condition, const char* fn_name, const char* file, uint32_t line);
+Error clear_flag(Device dev, Flag flag);
 bool check_event(Event event);
 
 } // namespace
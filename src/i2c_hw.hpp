@@ -0,0 +1,135 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200209
+// internal header
+// HW specific registers and register bits definitions, shared by master
+// (i2c.cpp) and slave (i2c-slave.cpp) drivers
+
+#ifndef I2C_HW_H
+#define I2C_HW_H
+
+#include <stdint.h>
+#include "i2c.hpp"
+
+namespace i2c
+{
+
+const uint32_t address_I2C0 = 0x40005400;
+const uint32_t address_I2C1 = 0x40005800;
+
+typedef struct
+{
+	volatile uint32_t	CTL0;		// control 0
+	volatile uint32_t	CTL1;		// control 1
+	volatile uint32_t	SADDR0;		// slave address
+	volatile uint32_t	SADDR1;		// slave address for dual address mode
+	volatile uint32_t	DATA;
+	volatile uint32_t	STAT0;
+	volatile uint32_t	STAT1;
+	volatile uint32_t	CKCFG;
+	volatile uint32_t	RT;			// SCL rise time
+	volatile uint32_t	reserved[27];
+	volatile uint32_t	FMPCFG;		// Fast-mode Plus (not in vendor headers, see user manual)
+} I2cReg;
+
+typedef struct
+{
+	Device				dev;
+	volatile I2cReg*	reg;
+	gpio::GpioPin		scl;
+	gpio::GpioPin		sda;
+	rcu_periph_enum		clock;
+} DevMap;
+
+enum class Ctl0Bits: uint8_t
+{
+	SRESET		= 15,	// software reset
+	SALT		= 13,	// SMBus ...
+	PECTRANS	= 12,	// PEC ...
+	POAP		= 11,	// NACK position
+	ACKEN		= 10,	// to ACK or to not ACK
+	STOP		= 9,	// generate STOP
+	START		= 8,	// generate START
+	SS			= 7,	// stretch clock when data is not ready in slave mode
+	GCEN		= 6,	// general call
+	PECEN		= 5,	// PEC...
+	ARPEN		= 4,	// SMBus...
+	SMBSEL		= 3,	// SMBus...
+	SMBEN		= 1,	// SMBus...
+	I2CEN		= 0,	// enable
+};
+
+enum class Ctl1Bits: uint8_t
+{
+	DMALST	= 12,	// something DMA related
+	DMAON	= 11,	// DMA enable/disable
+	BUFIE	= 10,	// interrupt when TBE = 1 or RBNE = 1
+	EVIE	= 9,	// event interrupt enable (when ADDSEND = 1, BTC = 1, or (if BUFIE =1) RBNE=1 or TBE=1
+	ERRIE	= 8,	// error interrupt enable
+	I2CLK	= 0,	// [5b] value of APB1 clock in MHz. Must be between 2 MHz (0b10) and 54 MHz (110110)
+	// If SCL == 100 kHz -> I2CLK must be >= 2MHz
+	// If SCL == 400 kHz -> I2CLK must be >= 8MHz
+	// If SCL >  400 kHz -> I2CLK must be >= 24MHz
+};
+
+enum class Saddr0Bits: uint8_t
+{
+	ADDFORMAT	= 15,
+	ADDRESS		= 0,	// 10 or 7 bit part of address
+						// b0 - R or W bit of address
+};
+
+enum class AddressLength: uint8_t
+{
+	// bit SADDR0.ADDFORMAT
+	SevenBits	= 0,
+	TenBits		= 1,
+};
+
+enum class Stat0Bits: uint8_t
+{
+	SMBALT		= 15,	// SMBus...
+	SMBTO		= 14,	// SMBus...
+	PECERR		= 12,	// PEC...
+	OUERR		= 11,	// over/under-run in slave mode, when SCL stretching id siabled
+	AERR		= 10,	// ACK error
+	LOSTARB		= 9,	// arbitration lost
+	BERR		= 8,	// unexpected START or STOP occurs
+	TBE			= 7,	// TX empty
+	RBNE		= 6,	// RX not empty
+	STPDET		= 4,	// STOP detected in slave mode
+	ADD10SEND	= 3,	// 10 bit address sent
+	BTC			= 2,	// byte transmission completed
+	ADDSEND		= 1,	// address is sent to slave
+	SBSEND		= 0,	// START sent to slave
+};
+
+enum class Stat1Bits: uint8_t
+{
+	PECV		= 8,	// [8b] PEC...
+	DUMODF		= 7,	// related to dual address mode thing
+	HSTSMB		= 6,	// SMBus..
+	DEFSMB		= 5,	// SMBus..
+	RXGC		= 4,	// general call
+	TR			= 2,	// Tx or RX? 0 = Rx, 1 = TX
+	I2CBSY		= 1,	// 1 when busy
+	MASTER		= 0,	// 0 = slave, 1 = master mode
+};
+
+enum class CkcfgBits: uint8_t
+{
+	FAST		= 15,	// 0 = standard mode, 1 = fast mode (also used for fast mode plus)
+	DTCY		= 14,	// fast mode duty cycle, see DutyCycle
+	CLKC		= 0,	// [12b] SCL clock divider
+};
+
+enum class FmpcfgBits: uint8_t
+{
+	FMPEN		= 0,	// fast mode plus enable, SCL > 400 kHz
+};
+
+// index is Device, defined in i2c.cpp
+extern const DevMap DevMaps[];
+
+} // namespace
+
+#endif // I2C_HW_H
@@ -0,0 +1,69 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+// kernel context switch in machine software interrupt (see kernel.hpp)
+//
+// irq_entry has already pushed the interrupt frame (caller registers, mcause,
+// mepc, msubm) on the stack of the interrupted thread and called us as a
+// normal function. Callee registers and return address into irq_entry are
+// pushed too, the rest is a function return on the stack of the next thread:
+// irq_entry then restores its frame and mret continues that thread.
+//
+// thread stack at switch, from top:
+// [interrupt frame, 20 words] [ra, s0 .. s11, 16 words] <- Thread.sp
+
+#include "context.h"
+#include "n200_timer.h"
+
+#define SWITCH_FRAME	16		// 13 registers, sp stays 16 byte aligned
+
+.section .text
+.align 2
+.global eclic_msip_handler
+eclic_msip_handler:
+	DISABLE_MIE			// jalmnxti enabled it: no nesting over the switch
+
+	// clear MSIP
+	li t0, TIMER_CTRL_ADDR + TIMER_MSIP
+	sw zero, 0(t0)
+
+	addi sp, sp, -SWITCH_FRAME*REGBYTES
+	STORE x1,  0*REGBYTES(sp)
+	STORE x8,  1*REGBYTES(sp)
+	STORE x9,  2*REGBYTES(sp)
+	STORE x18, 3*REGBYTES(sp)
+	STORE x19, 4*REGBYTES(sp)
+	STORE x20, 5*REGBYTES(sp)
+	STORE x21, 6*REGBYTES(sp)
+	STORE x22, 7*REGBYTES(sp)
+	STORE x23, 8*REGBYTES(sp)
+	STORE x24, 9*REGBYTES(sp)
+	STORE x25, 10*REGBYTES(sp)
+	STORE x26, 11*REGBYTES(sp)
+	STORE x27, 12*REGBYTES(sp)
+
+	// uint32_t* kernel_switch(uint32_t* sp): saves sp, returns next one
+	mv a0, sp
+	call kernel_switch
+	mv sp, a0
+
+	LOAD x1,  0*REGBYTES(sp)
+	LOAD x8,  1*REGBYTES(sp)
+	LOAD x9,  2*REGBYTES(sp)
+	LOAD x18, 3*REGBYTES(sp)
+	LOAD x19, 4*REGBYTES(sp)
+	LOAD x20, 5*REGBYTES(sp)
+	LOAD x21, 6*REGBYTES(sp)
+	LOAD x22, 7*REGBYTES(sp)
+	LOAD x23, 8*REGBYTES(sp)
+	LOAD x24, 9*REGBYTES(sp)
+	LOAD x25, 10*REGBYTES(sp)
+	LOAD x26, 11*REGBYTES(sp)
+	LOAD x27, 12*REGBYTES(sp)
+	addi sp, sp, SWITCH_FRAME*REGBYTES
+	ret
+
+// first run of a new thread: kernel::create() sets this as return address
+// of its switch frame, interrupt frame holds entry (mepc) and argument (a0)
+.global kernel_thread_start
+kernel_thread_start:
+	IRQ_RETURN
@@ -0,0 +1,665 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+
+// #define DEBUG_KERNEL
+#ifndef DEBUG_KERNEL
+#undef DEBUG
+#endif // DEBUG_KERNEL
+
+#include "kernel.hpp"
+#include "baro.hpp"
+#include "delay.h"
+#include "debug.h"
+#include "utils.hpp"		// COUNT_OF()
+#include "gd32vf103.h"
+#include "gd32vf103_eclic.h"
+#include "n200_func.h"		// get_timer_value(), __WFI()
+#include "riscv_encoding.h"
+
+namespace kernel
+{
+
+#define MSIP			REG32(TIMER_CTRL_ADDR + TIMER_MSIP)
+#define IDLE_PRIORITY	(KERNEL_PRIORITIES - 1)
+#define STACK_FILL		0xDEADBEEF
+#define FRAME_WORDS		20		// interrupt frame, lib/RISCV/context.h
+#define SWITCH_WORDS	16		// ra, s0 .. s11 and padding, kernel-switch.s
+// mcause of new thread, restored by mret: interrupt, MPP = machine,
+// MPIE = interrupts enabled, MPIL = 0 (thread level)
+#define NEW_MCAUSE		(0x80000000 | (3UL << 28) | (1UL << 27) | CLIC_INT_SFT)
+
+static_assert(KERNEL_PRIORITIES <= 32, "one bit per priority");
+
+extern "C" void kernel_thread_start(void);		// kernel-switch.s
+extern "C" uint32_t* kernel_switch(uint32_t* sp);
+
+static Thread* ready[KERNEL_PRIORITIES];	// head is running, FIFO per priority
+static uint32_t ready_map;					// bit per non empty priority
+static Thread* current;
+static Thread* sleeping;					// sorted by wake
+static Thread* threads;						// all of them, for print_threads()
+static Thread idle;
+static bool started;
+
+// lists																	{{{
+// ----------------------------------------------------------------------------
+static uint32_t irq_disable(void)
+{
+	const uint32_t status = read_csr(mstatus);
+	clear_csr(mstatus, MSTATUS_MIE);
+	return status;
+}
+
+static void irq_restore(uint32_t status)
+{
+	if (status & MSTATUS_MIE)
+	{
+		set_csr(mstatus, MSTATUS_MIE);
+	}
+}
+
+static void ready_add(Thread* t)
+{
+	Thread** p = &ready[t->priority];
+	while (*p != NULL)
+	{
+		p = &(*p)->next;
+	}
+	t->next = NULL;
+	*p = t;
+	ready_map |= 1UL << t->priority;
+}
+
+static void ready_remove(Thread* t)
+{
+	Thread** p = &ready[t->priority];
+	while (*p != t)
+	{
+		p = &(*p)->next;
+	}
+	*p = t->next;
+	if (ready[t->priority] == NULL)
+	{
+		ready_map &= ~(1UL << t->priority);
+	}
+}
+
+// by priority, after the ones with the same priority
+static void wait_add(Thread** list, Thread* t)
+{
+	t->wait_list = list;
+	while ((*list != NULL) && ((*list)->priority <= t->priority))
+	{
+		list = &(*list)->next;
+	}
+	t->next = *list;
+	*list = t;
+}
+
+static void wait_remove(Thread* t)
+{
+	Thread** p = t->wait_list;
+	while (*p != t)
+	{
+		p = &(*p)->next;
+	}
+	*p = t->next;
+	t->wait_list = NULL;
+}
+
+static void alarm(void);
+
+static void program_alarm(void)
+{
+	if (sleeping != NULL)
+	{
+		delay_set_alarm(DELAY_ALARM_KERNEL, sleeping->wake, alarm);
+	}
+	else
+	{
+		delay_set_alarm(DELAY_ALARM_KERNEL, UINT64_MAX, NULL);
+	}
+}
+
+static void sleep_add(Thread* t)
+{
+	Thread** p = &sleeping;
+	while ((*p != NULL) && ((*p)->wake <= t->wake))
+	{
+		p = &(*p)->sleep_next;
+	}
+	t->sleep_next = *p;
+	*p = t;
+	if (sleeping == t)
+	{
+		program_alarm();
+	}
+}
+
+// alarm is left as it is, at worst it finds nothing to do
+static void sleep_remove(Thread* t)
+{
+	Thread** p = &sleeping;
+	while (*p != t)
+	{
+		p = &(*p)->sleep_next;
+	}
+	*p = t->sleep_next;
+	t->wake = UINT64_MAX;
+}
+// ------------------------------------------------------------------------ }}}
+// scheduling																{{{
+// ----------------------------------------------------------------------------
+// switch is an interrupt: pending one is taken when interrupts are enabled
+// in thread, or right after the interrupt which called this returns
+static void reschedule(void)
+{
+	if (started && (ready[__builtin_ctz(ready_map)] != current))
+	{
+		MSIP = 1;
+	}
+}
+
+// from eclic_msip_handler: saves stack of current thread, returns next one
+extern "C" uint32_t* kernel_switch(uint32_t* sp)
+{
+	current->sp = sp;
+	current = ready[__builtin_ctz(ready_map)];
+	return current->sp;
+}
+
+static void wake_up(Thread* t, bool timed_out)
+{
+	if (t->wake != UINT64_MAX)
+	{
+		sleep_remove(t);
+	}
+	if (t->wait_list != NULL)
+	{
+		wait_remove(t);
+	}
+	t->waiting_for = NULL;
+	t->timed_out   = timed_out;
+	t->state       = State::Ready;
+	ready_add(t);
+}
+
+// current thread waits on list (NULL = just sleeps) until it is woken up or
+// until deadline; called and returns with interrupts disabled, they are
+// enabled meanwhile (status), returns 0 on timeout
+static bool block(Thread** list, uint64_t deadline, uint32_t status)
+{
+	ASSERT(started && (current != &idle) && !in_interrupt() && (status & MSTATUS_MIE));
+
+	Thread* t = current;
+	ready_remove(t);
+	t->state     = State::Blocked;
+	t->timed_out = 0;
+	if (list != NULL)
+	{
+		wait_add(list, t);
+	}
+	if (deadline != UINT64_MAX)
+	{
+		t->wake = deadline;
+		sleep_add(t);
+	}
+	reschedule();
+
+	irq_restore(status);	// switch
+	irq_disable();
+	return !t->timed_out;
+}
+
+// from mtime interrupt
+static void alarm(void)
+{
+	const uint32_t status = irq_disable();
+	const uint64_t now = get_timer_value();
+	while ((sleeping != NULL) && (sleeping->wake <= now))
+	{
+		wake_up(sleeping, 1);
+	}
+	program_alarm();
+	reschedule();
+	irq_restore(status);
+}
+
+static void thread_exit(void)
+{
+	const uint32_t status = irq_disable();
+	ASSERT(current->held == NULL);
+	current->state = State::Done;
+	ready_remove(current);
+	reschedule();
+	irq_restore(status);
+	while (1);		// not reached
+}
+
+static uint64_t deadline_ms(uint32_t ms)
+{
+	if (ms == KERNEL_FOREVER)
+	{
+		return UINT64_MAX;
+	}
+	return get_timer_value() + (uint64_t)ms * (delay_get_timer_hz() / 1000);
+}
+
+// delay_ms() in a thread
+static bool delay_hook(uint64_t mtime)
+{
+	if (!started || (current == &idle) || in_interrupt())
+	{
+		return 0;
+	}
+	sleep_until(mtime);
+	return 1;
+}
+// ------------------------------------------------------------------------ }}}
+
+void init(void)
+{
+	for (uint8_t i = 0; i < KERNEL_PRIORITIES; i++)
+	{
+		ready[i] = NULL;
+	}
+	ready_map = 0;
+	sleeping  = NULL;
+	threads   = NULL;
+	current   = NULL;
+	started   = 0;
+}
+
+void create(Thread* thread, const char* name, uint8_t priority,
+		uint32_t* stack, uint32_t stack_words, Entry entry, void* arg)
+{
+	ASSERT(priority < IDLE_PRIORITY);
+	ASSERT(stack_words >= KERNEL_STACK_MIN);
+
+	for (uint32_t i = 0; i < stack_words; i++)
+	{
+		stack[i] = STACK_FILL;
+	}
+
+	// as if thread was interrupted at entry(arg) and switched out:
+	// interrupt frame, switch frame which returns to kernel_thread_start
+	uint32_t* top = (uint32_t*)((uintptr_t)(stack + stack_words) & ~(uintptr_t)15);
+	uint32_t* frame = top - FRAME_WORDS;
+	for (uint8_t i = 0; i < FRAME_WORDS; i++)
+	{
+		frame[i] = 0;
+	}
+	frame[0]  = (uintptr_t)thread_exit;		// ra, when entry returns
+	frame[5]  = (uintptr_t)arg;				// a0
+	frame[17] = NEW_MCAUSE;
+	frame[18] = (uintptr_t)entry;			// mepc
+	uint32_t* sw = frame - SWITCH_WORDS;
+	for (uint8_t i = 0; i < SWITCH_WORDS; i++)
+	{
+		sw[i] = 0;
+	}
+	sw[0] = (uintptr_t)kernel_thread_start;
+
+	*thread = {};
+	thread->sp            = sw;
+	thread->name          = name;
+	thread->stack         = stack;
+	thread->stack_words   = stack_words;
+	thread->priority      = priority;
+	thread->base_priority = priority;
+	thread->wake          = UINT64_MAX;
+	thread->state         = State::Ready;
+
+	const uint32_t status = irq_disable();
+	thread->next_thread = threads;
+	threads = thread;
+	ready_add(thread);
+	reschedule();
+	irq_restore(status);
+	dprintf("thread %s, priority %d, stack %d words\r\n", name, priority, stack_words);
+}
+
+void start(void)
+{
+	idle = {};
+	idle.name          = "idle";
+	idle.priority      = IDLE_PRIORITY;
+	idle.base_priority = IDLE_PRIORITY;
+	idle.wake          = UINT64_MAX;
+	idle.next_thread   = threads;
+	threads = &idle;
+	current = &idle;
+	ready_add(&idle);
+
+	delay_set_sleep_hook(delay_hook);
+	eclic_global_interrupt_enable();
+	eclic_irq_enable(CLIC_INT_SFT, 1, 0);
+	started = 1;
+
+	// first switch saves main() as idle thread
+	reschedule();
+	while (1)
+	{
+		__WFI();		// wake up interrupt pends the switch
+	}
+}
+
+Thread* self(void)
+{
+	return current;
+}
+
+void yield(void)
+{
+	const uint32_t status = irq_disable();
+	ready_remove(current);
+	ready_add(current);
+	reschedule();
+	irq_restore(status);
+}
+
+void sleep_until(uint64_t mtime)
+{
+	const uint32_t status = irq_disable();
+	if (get_timer_value() < mtime)
+	{
+		block(NULL, mtime, status);
+	}
+	irq_restore(status);
+}
+
+void sleep_ms(uint32_t ms)
+{
+	sleep_until(deadline_ms(ms));
+}
+
+uint32_t stack_free(const Thread* thread)
+{
+	uint32_t n = 0;
+	while ((n < thread->stack_words) && (thread->stack[n] == STACK_FILL))
+	{
+		n++;
+	}
+	return n;
+}
+
+// mutex																	{{{
+// ----------------------------------------------------------------------------
+static void set_priority(Thread* t, uint8_t priority)
+{
+	if (t->state == State::Ready)
+	{
+		ready_remove(t);
+		t->priority = priority;
+		ready_add(t);
+	}
+	else
+	{
+		t->priority = priority;
+		if (t->wait_list != NULL)
+		{
+			Thread** list = t->wait_list;
+			wait_remove(t);
+			wait_add(list, t);
+		}
+	}
+}
+
+// owner chain: owner of a mutex can wait for another one
+static void inherit(Thread* owner, uint8_t priority)
+{
+	while ((owner != NULL) && (priority < owner->priority))
+	{
+		set_priority(owner, priority);
+		owner = (owner->waiting_for != NULL) ? owner->waiting_for->owner : NULL;
+	}
+}
+
+static void take(Mutex* mutex, Thread* t)
+{
+	mutex->owner     = t;
+	mutex->next_held = t->held;
+	t->held          = mutex;
+}
+
+void mutex_init(Mutex* mutex)
+{
+	*mutex = {};
+}
+
+void lock(Mutex* mutex)
+{
+	const uint32_t status = irq_disable();
+	ASSERT(mutex->owner != current);
+
+	if (mutex->owner == NULL)
+	{
+		take(mutex, current);
+	}
+	else
+	{
+		current->waiting_for = mutex;
+		inherit(mutex->owner, current->priority);
+		block(&mutex->waiters, UINT64_MAX, status);
+		// unlock() made us the owner
+	}
+	irq_restore(status);
+}
+
+bool try_lock(Mutex* mutex)
+{
+	const uint32_t status = irq_disable();
+	const bool free = (mutex->owner == NULL);
+	if (free)
+	{
+		take(mutex, current);
+	}
+	irq_restore(status);
+	return free;
+}
+
+void unlock(Mutex* mutex)
+{
+	const uint32_t status = irq_disable();
+	Thread* t = current;
+	ASSERT(mutex->owner == t);
+
+	Mutex** p = &t->held;
+	while (*p != mutex)
+	{
+		p = &(*p)->next_held;
+	}
+	*p = mutex->next_held;
+
+	// back to own priority or to the highest waiter of what is still held
+	uint8_t priority = t->base_priority;
+	for (const Mutex* m = t->held; m != NULL; m = m->next_held)
+	{
+		if ((m->waiters != NULL) && (m->waiters->priority < priority))
+		{
+			priority = m->waiters->priority;
+		}
+	}
+	if (priority != t->priority)
+	{
+		set_priority(t, priority);
+	}
+
+	// handed over to the highest waiter, it inherits from the rest
+	mutex->owner = NULL;
+	Thread* w = mutex->waiters;
+	if (w != NULL)
+	{
+		wake_up(w, 0);
+		take(mutex, w);
+		if ((mutex->waiters != NULL) && (mutex->waiters->priority < w->priority))
+		{
+			set_priority(w, mutex->waiters->priority);
+		}
+	}
+
+	reschedule();
+	irq_restore(status);
+}
+// ------------------------------------------------------------------------ }}}
+// queue																	{{{
+// ----------------------------------------------------------------------------
+static void copy(void* dest, const void* src, uint16_t n)
+{
+	uint8_t* d = (uint8_t*)dest;
+	const uint8_t* s = (const uint8_t*)src;
+	while (n--)
+	{
+		*d++ = *s++;
+	}
+}
+
+void queue_init(Queue* queue, void* buffer, uint16_t item_size, uint16_t size)
+{
+	*queue = {};
+	queue->buffer    = (uint8_t*)buffer;
+	queue->item_size = item_size;
+	queue->size      = size;
+}
+
+// woken thread tries again, it can find the queue full (empty) again
+bool send(Queue* queue, const void* item, uint32_t timeout_ms)
+{
+	const uint64_t deadline = deadline_ms(timeout_ms);
+	const uint32_t status = irq_disable();
+
+	while (queue->count == queue->size)
+	{
+		if ((timeout_ms == 0) || !block(&queue->writers, deadline, status))
+		{
+			irq_restore(status);
+			return 0;
+		}
+	}
+
+	const uint16_t tail = (queue->head + queue->count) % queue->size;
+	copy(&queue->buffer[tail * queue->item_size], item, queue->item_size);
+	queue->count++;
+	if (queue->readers != NULL)
+	{
+		wake_up(queue->readers, 0);
+		reschedule();
+	}
+
+	irq_restore(status);
+	return 1;
+}
+
+bool send_from_isr(Queue* queue, const void* item)
+{
+	return send(queue, item, 0);
+}
+
+bool receive(Queue* queue, void* item, uint32_t timeout_ms)
+{
+	const uint64_t deadline = deadline_ms(timeout_ms);
+	const uint32_t status = irq_disable();
+
+	while (queue->count == 0)
+	{
+		if ((timeout_ms == 0) || !block(&queue->readers, deadline, status))
+		{
+			irq_restore(status);
+			return 0;
+		}
+	}
+
+	copy(item, &queue->buffer[queue->head * queue->item_size], queue->item_size);
+	queue->head = (queue->head + 1) % queue->size;
+	queue->count--;
+	if (queue->writers != NULL)
+	{
+		wake_up(queue->writers, 0);
+		reschedule();
+	}
+
+	irq_restore(status);
+	return 1;
+}
+// ------------------------------------------------------------------------ }}}
+
+void print_threads(void)
+{
+	static const char* const states[] = {"ready", "blocked", "done"};
+
+	printf("name         prio state   stack free [words]\r\n");
+	for (const Thread* t = threads; t != NULL; t = t->next_thread)
+	{
+		printf("%-12s %2d/%d %-7s %d\r\n", t->name, t->priority, t->base_priority,
+			states[(uint8_t)t->state], (t->stack != NULL) ? stack_free(t) : 0);
+	}
+}
+
+// example: 5 ms control loop keeps its period while baro thread waits for
+// I2C conversions and logger prints; printf is shared through a mutex
+static Mutex print_mutex;
+static Queue pressure_queue;
+static int32_t pressure_buffer[4];
+static volatile uint32_t max_late_us;
+
+static void control_thread(void* arg)
+{
+	(void)arg;
+	const uint32_t ticks_per_us = delay_get_timer_hz() / 1000000;
+	uint64_t next = get_timer_value();
+	while (1)
+	{
+		next += 5000 * ticks_per_us;
+		sleep_until(next);
+		const uint32_t late_us = (get_timer_value() - next) / ticks_per_us;
+		if (late_us > max_late_us)
+		{
+			max_late_us = late_us;
+		}
+		// control output ...
+	}
+}
+
+static void baro_thread(void* arg)
+{
+	(void)arg;
+	while (1)
+	{
+		const int32_t pressure = baro::get_pressure();	// delay_ms() blocks only this thread
+		send(&pressure_queue, &pressure, KERNEL_FOREVER);
+		sleep_ms(100);
+	}
+}
+
+static void log_thread(void* arg)
+{
+	(void)arg;
+	int32_t pressure;
+	while (1)
+	{
+		if (receive(&pressure_queue, &pressure, 1000))
+		{
+			lock(&print_mutex);
+			printf("kernel: pressure %d Pa, control loop late max %d us\r\n", pressure, max_late_us);
+			unlock(&print_mutex);
+		}
+	}
+}
+
+void example(void)
+{
+	static uint32_t control_stack[KERNEL_STACK_MIN];
+	static uint32_t baro_stack[512];
+	static uint32_t log_stack[512];
+	static Thread control, baro, log;
+
+	init();
+	mutex_init(&print_mutex);
+	queue_init(&pressure_queue, pressure_buffer, sizeof(pressure_buffer[0]), COUNT_OF(pressure_buffer));
+	create(&control, "control", 0, control_stack, COUNT_OF(control_stack), control_thread, NULL);
+	create(&baro, "baro", 2, baro_stack, COUNT_OF(baro_stack), baro_thread, NULL);
+	create(&log, "log", 4, log_stack, COUNT_OF(log_stack), log_thread, NULL);
+	start();
+}
+
+} // namespace
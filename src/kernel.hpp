@@ -0,0 +1,109 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+// small preemptive kernel: threads with own stacks, fixed priorities
+//
+// The highest priority ready thread runs, 0 is the highest; threads of the
+// same priority run in turn only when they block or yield(). Context is
+// switched in machine software interrupt (MSIP, non-vectored, level 1): it
+// goes through irq_entry like any other interrupt, see kernel-switch.s. An
+// interrupt which wakes a thread only pends the switch, it is taken right
+// after the interrupt returns.
+// Interrupts use the stack of the thread they interrupt: every stack needs
+// room for them on top of the thread itself.
+//
+// main() becomes the idle thread in start(). Sleeping is done with mtime
+// alarm (DELAY_ALARM_KERNEL), and delay_ms() in a thread blocks the thread.
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdint.h>
+
+#ifndef KERNEL_PRIORITIES
+#define KERNEL_PRIORITIES	8		// up to 32, the lowest one is for idle
+#endif
+
+#define KERNEL_FOREVER		0xFFFFFFFF	// timeout
+#define KERNEL_STACK_MIN	128			// words: switch and interrupt frame with some calls
+
+namespace kernel
+{
+
+typedef void (*Entry)(void* arg);
+
+enum class State: uint8_t
+{
+	Ready = 0,		// also running
+	Blocked,		// mutex, queue or sleep
+	Done,			// entry returned
+};
+
+struct Mutex;
+
+// owned by caller, fields are private
+typedef struct Thread
+{
+	uint32_t*		sp;
+	struct Thread*	next;			// ready or wait list
+	struct Thread*	sleep_next;		// sleep list, sorted by wake
+	struct Thread*	next_thread;	// all threads
+	struct Thread**	wait_list;		// while waiting for mutex or queue
+	struct Mutex*	waiting_for;	// for priority inheritance chain
+	struct Mutex*	held;			// mutexes it owns
+	uint64_t		wake;			// mtime
+	const char*		name;
+	uint32_t*		stack;
+	uint32_t		stack_words;
+	uint8_t			priority;		// effective, can be inherited
+	uint8_t			base_priority;
+	State			state;
+	bool			timed_out;
+} Thread;
+
+// priority inheritance: owner runs at priority of its highest waiter
+typedef struct Mutex
+{
+	Thread*			owner;
+	Thread*			waiters;		// by priority
+	struct Mutex*	next_held;		// list of owner
+} Mutex;
+
+// fixed size items, copied in and out
+typedef struct
+{
+	uint8_t*	buffer;
+	uint16_t	item_size;
+	uint16_t	size;			// items
+	uint16_t	head;
+	uint16_t	count;
+	Thread*		readers;		// waiting, by priority
+	Thread*		writers;
+} Queue;
+
+void init(void);
+void create(Thread* thread, const char* name, uint8_t priority,
+		uint32_t* stack, uint32_t stack_words, Entry entry, void* arg);
+void start(void);				// main() continues as idle thread, never returns
+
+Thread* self(void);
+void yield(void);
+void sleep_ms(uint32_t ms);
+void sleep_until(uint64_t mtime);
+uint32_t stack_free(const Thread* thread);	// words never used
+
+void mutex_init(Mutex* mutex);
+void lock(Mutex* mutex);		// not from interrupt
+bool try_lock(Mutex* mutex);
+void unlock(Mutex* mutex);		// only by owner
+
+void queue_init(Queue* queue, void* buffer, uint16_t item_size, uint16_t size);
+bool send(Queue* queue, const void* item, uint32_t timeout_ms);		// 0 on timeout
+bool receive(Queue* queue, void* item, uint32_t timeout_ms);
+bool send_from_isr(Queue* queue, const void* item);					// 0 when full
+
+void print_threads(void);
+void example(void);
+
+} // namespace
+
+#endif	// KERNEL_H
@@ -0,0 +1,449 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200214
+
+// #define DEBUG_KV_STORE
+#ifndef DEBUG_KV_STORE
+#undef DEBUG
+#endif // DEBUG_KV_STORE
+
+#include "kv-store.hpp"
+#include "crc.h"
+#include "debug.h"
+
+namespace kv_store
+{
+	using namespace i2c;
+
+#define KV_MAGIC				0x3153564B	// "KVS1"
+#define KV_REGION_HEADER_SIZE	10
+
+#if (KV_BASE % EEPROM_PAGE_SIZE) || (KV_REGION_SIZE % EEPROM_PAGE_SIZE)
+#error KV store regions must be page aligned
+#endif
+#if (KV_BASE + 2 * KV_REGION_SIZE) > EEPROM_SIZE
+#error KV store does not fit to EEPROM
+#endif
+
+// private types:
+typedef struct
+{
+	uint16_t	addr;	// EEPROM address of latest record, 0 = no value
+	uint8_t		len;
+} Entry;
+
+static Entry index[KV_MAX_KEYS];	// key -> latest record
+static uint32_t base_seq;			// seq of first record in active region
+static uint32_t tail;				// EEPROM address for next record
+static Stats stats;
+
+// helpers																	{{{
+// ----------------------------------------------------------------------------
+static uint32_t region_start(uint8_t region)
+{
+	return KV_BASE + (uint32_t)region * KV_REGION_SIZE;
+}
+
+static uint32_t region_end(uint8_t region)
+{
+	return region_start(region) + KV_REGION_SIZE;
+}
+
+static void put16(uint8_t* p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+	put16(&p[0], v);
+	put16(&p[2], v >> 16);
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+	return get16(&p[0]) | ((uint32_t)get16(&p[2]) << 16);
+}
+
+static uint16_t record_crc(const uint8_t* record)
+{
+	// header without CRC, then value
+	const uint16_t crc = crc16(CRC16_INIT, record, 6);
+	return crc16(crc, &record[KV_HEADER_SIZE], record[1]);
+}
+
+// record to buf, returns its size
+static uint8_t encode(uint8_t* buf, uint8_t key, const uint8_t* value, uint8_t len, uint32_t seq)
+{
+	buf[0] = key;
+	buf[1] = len;
+	put32(&buf[2], seq);
+	for (uint8_t i = 0; i < len; i++)
+	{
+		buf[KV_HEADER_SIZE + i] = value[i];
+	}
+	put16(&buf[6], record_crc(buf));
+	return KV_HEADER_SIZE + len;
+}
+
+// avail: bytes in buffer, record can't be longer
+static bool is_valid(const uint8_t* record, uint8_t avail, uint32_t seq)
+{
+	if (avail < KV_HEADER_SIZE)
+	{
+		return 0;
+	}
+	const uint8_t key = record[0];
+	const uint8_t len = record[1];
+
+	return (key < KV_MAX_KEYS) && (len <= KV_MAX_VALUE) && (KV_HEADER_SIZE + len <= avail) &&
+		(get32(&record[2]) == seq) && (get16(&record[6]) == record_crc(record));
+}
+// ------------------------------------------------------------------------ }}}
+// region header															{{{
+// ----------------------------------------------------------------------------
+static bool read_region_header(uint8_t region, uint32_t* seq)
+{
+	uint8_t buf[KV_REGION_HEADER_SIZE];
+
+	if (eeprom::read_many(region_start(region), buf, sizeof(buf)) != Error::Ok)
+	{
+		return 0;
+	}
+	if ((get32(&buf[0]) != KV_MAGIC) || (get16(&buf[8]) != crc16(CRC16_INIT, buf, 8)))
+	{
+		return 0;
+	}
+	*seq = get32(&buf[4]);
+	return 1;
+}
+
+// written last: this makes region active
+static Status write_region_header(uint8_t region, uint32_t seq)
+{
+	uint8_t buf[KV_REGION_HEADER_SIZE];
+
+	put32(&buf[0], KV_MAGIC);
+	put32(&buf[4], seq);
+	put16(&buf[8], crc16(CRC16_INIT, buf, 8));
+
+	if (eeprom::write_many(region_start(region), buf, sizeof(buf)) != Error::Ok)
+	{
+		return Status::IoError;
+	}
+	return Status::Ok;
+}
+// ------------------------------------------------------------------------ }}}
+// log scan																	{{{
+// ----------------------------------------------------------------------------
+// build index from log, one page read at a time
+static Status scan(uint8_t region)
+{
+	uint8_t page[EEPROM_PAGE_SIZE];
+	uint32_t loaded = 0xFFFFFFFF;	// address of page in buffer
+	uint32_t addr   = region_start(region) + EEPROM_PAGE_SIZE;
+	uint32_t seq    = base_seq;
+	bool skipped    = 0;
+
+	for (uint8_t i = 0; i < KV_MAX_KEYS; i++)
+	{
+		index[i].addr = 0;
+		index[i].len  = 0;
+	}
+	tail = addr;
+
+	while (addr + KV_HEADER_SIZE <= region_end(region))
+	{
+		const uint32_t page_addr = addr - (addr % EEPROM_PAGE_SIZE);
+		const uint8_t offset = addr - page_addr;
+
+		if (page_addr != loaded)
+		{
+			if (eeprom::read_many(page_addr, page, EEPROM_PAGE_SIZE) != Error::Ok)
+			{
+				return Status::IoError;
+			}
+			loaded = page_addr;
+		}
+
+		const uint8_t* record = &page[offset];
+		if (is_valid(record, EEPROM_PAGE_SIZE - offset, seq))
+		{
+			const uint8_t key = record[0];
+			const uint8_t len = record[1];
+			index[key].addr = (len != 0) ? addr : 0;
+			index[key].len  = len;
+			seq++;
+			addr += KV_HEADER_SIZE + len;
+			tail = addr;
+			skipped = 0;
+		}
+		else if ((offset != 0) && (skipped == 0))
+		{
+			// record which didn't fit was written to next page
+			addr = page_addr + EEPROM_PAGE_SIZE;
+			skipped = 1;
+		}
+		else
+		{
+			break;	// end of log, stale data or torn write
+		}
+	}
+
+	stats.next_seq = seq;
+	dprintf("region %d: seq %d..%d, tail: 0x%x\r\n", region, base_seq, seq, tail);
+	return Status::Ok;
+}
+// ------------------------------------------------------------------------ }}}
+
+Status format(void)
+{
+	// new region must win over both existing ones
+	const uint8_t region = stats.region ^ 1;
+	const uint32_t seq = (stats.next_seq != 0) ? stats.next_seq : 1;
+
+	if (write_region_header(region, seq) != Status::Ok)
+	{
+		return Status::IoError;
+	}
+	stats.region = region;
+	base_seq = seq;
+	return scan(region);
+}
+
+Status init(Device dev)
+{
+	uint32_t seq[2] = {0, 0};
+	bool valid[2];
+
+	eeprom::init(dev);
+	stats = {};
+
+	valid[0] = read_region_header(0, &seq[0]);
+	valid[1] = read_region_header(1, &seq[1]);
+
+	if ((valid[0] == 0) && (valid[1] == 0))
+	{
+		dprintf("no valid region, formatting\r\n");
+		stats.region = 1;	// format() takes the other one
+		return format();
+	}
+
+	stats.region = ((valid[1] == 0) || (valid[0] && (seq[0] > seq[1]))) ? 0 : 1;
+	base_seq = seq[stats.region];
+	return scan(stats.region);
+}
+
+// copy latest records to the other region, packed to pages
+Status compact(void)
+{
+	const uint8_t target = stats.region ^ 1;
+	const uint32_t new_base = stats.next_seq;
+	uint8_t page[EEPROM_PAGE_SIZE];
+	uint8_t fill = 0;
+	uint32_t page_addr = region_start(target) + EEPROM_PAGE_SIZE;
+	uint32_t seq = new_base;
+
+	dprintf("compacting region %d -> %d\r\n", stats.region, target);
+
+	for (uint8_t key = 0; key < KV_MAX_KEYS; key++)
+	{
+		uint8_t value[KV_MAX_VALUE];
+		uint8_t len;
+
+		if (index[key].addr == 0)
+		{
+			continue;
+		}
+
+		const Status status = get(key, value, sizeof(value), &len);
+		if (status == Status::Corrupted)
+		{
+			eprintf("KV key %d is corrupted, dropped\r\n", key);
+			continue;
+		}
+		if (status != Status::Ok)
+		{
+			return status;
+		}
+
+		if (fill + KV_HEADER_SIZE + len > EEPROM_PAGE_SIZE)
+		{
+			if (eeprom::write_many(page_addr, page, fill) != Error::Ok)
+			{
+				return Status::IoError;
+			}
+			page_addr += EEPROM_PAGE_SIZE;
+			fill = 0;
+			if (page_addr >= region_end(target))
+			{
+				return Status::NoSpace;
+			}
+		}
+		fill += encode(&page[fill], key, value, len, seq++);
+	}
+
+	if ((fill != 0) && (eeprom::write_many(page_addr, page, fill) != Error::Ok))
+	{
+		return Status::IoError;
+	}
+
+	// power loss before this point: old region is still active
+	if (write_region_header(target, new_base) != Status::Ok)
+	{
+		return Status::IoError;
+	}
+
+	stats.region = target;
+	stats.compactions++;
+	base_seq = new_base;
+	return scan(target);
+}
+
+static Status append(uint8_t key, const uint8_t* value, uint8_t len)
+{
+	uint8_t buf[EEPROM_PAGE_SIZE];
+	const uint8_t size = KV_HEADER_SIZE + len;
+	uint32_t addr = tail;
+
+	for (uint8_t retry = 0; retry < 2; retry++)
+	{
+		// never split record between pages
+		if ((addr % EEPROM_PAGE_SIZE) + size > EEPROM_PAGE_SIZE)
+		{
+			addr += EEPROM_PAGE_SIZE - (addr % EEPROM_PAGE_SIZE);
+		}
+		if (addr + size <= region_end(stats.region))
+		{
+			break;
+		}
+		if (retry == 1)
+		{
+			return Status::NoSpace;
+		}
+
+		const Status status = compact();
+		if (status != Status::Ok)
+		{
+			return status;
+		}
+		addr = tail;
+	}
+
+	encode(buf, key, value, len, stats.next_seq);
+	if (eeprom::write_many(addr, buf, size) != Error::Ok)
+	{
+		return Status::IoError;
+	}
+
+	index[key].addr = (len != 0) ? addr : 0;
+	index[key].len  = len;
+	tail = addr + size;
+	stats.next_seq++;
+	stats.appends++;
+	return Status::Ok;
+}
+
+Status get(uint8_t key, uint8_t* value, uint8_t size, uint8_t* len)
+{
+	uint8_t buf[EEPROM_PAGE_SIZE];
+
+	if (key >= KV_MAX_KEYS)
+	{
+		return Status::WrongKey;
+	}
+	const Entry* e = &index[key];
+	if (e->addr == 0)
+	{
+		return Status::NotFound;
+	}
+	if (e->len > size)
+	{
+		return Status::WrongLength;
+	}
+
+	if (eeprom::read_many(e->addr, buf, KV_HEADER_SIZE + e->len) != Error::Ok)
+	{
+		return Status::IoError;
+	}
+	if ((buf[0] != key) || (buf[1] != e->len) || (get16(&buf[6]) != record_crc(buf)))
+	{
+		return Status::Corrupted;
+	}
+
+	for (uint8_t i = 0; i < e->len; i++)
+	{
+		value[i] = buf[KV_HEADER_SIZE + i];
+	}
+	*len = e->len;
+	return Status::Ok;
+}
+
+Status put(uint8_t key, const uint8_t* value, uint8_t len)
+{
+	if (key >= KV_MAX_KEYS)
+	{
+		return Status::WrongKey;
+	}
+	if ((len == 0) || (len > KV_MAX_VALUE))
+	{
+		return Status::WrongLength;
+	}
+
+	// same value: don't waste a write cycle
+	if (index[key].len == len)
+	{
+		uint8_t old[KV_MAX_VALUE];
+		uint8_t n;
+		bool same = (get(key, old, sizeof(old), &n) == Status::Ok);
+		for (uint8_t i = 0; same && (i < len); i++)
+		{
+			same = (old[i] == value[i]);
+		}
+		if (same)
+		{
+			return Status::Ok;
+		}
+	}
+
+	return append(key, value, len);
+}
+
+Status remove(uint8_t key)
+{
+	if (key >= KV_MAX_KEYS)
+	{
+		return Status::WrongKey;
+	}
+	if (index[key].addr == 0)
+	{
+		return Status::NotFound;
+	}
+	return append(key, NULL, 0);
+}
+
+bool exists(uint8_t key)
+{
+	return (key < KV_MAX_KEYS) && (index[key].addr != 0);
+}
+
+const Stats* get_stats(void)
+{
+	stats.used = tail - region_start(stats.region);
+	stats.live = 0;
+	for (uint8_t i = 0; i < KV_MAX_KEYS; i++)
+	{
+		if (index[i].addr != 0)
+		{
+			stats.live += KV_HEADER_SIZE + index[i].len;
+		}
+	}
+	return &stats;
+}
+
+} // namespace
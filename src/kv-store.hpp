@@ -0,0 +1,76 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200214
+// wear leveled key-value store on 24C256 EEPROM
+//
+// log structured: every put() appends a record, old values are never
+// rewritten in place. EEPROM area is split into 2 regions, when active
+// region is full only the latest records are copied to the other one
+// (compaction) and regions are swapped.
+//
+// region: [page 0: region header][records ...]
+// header: magic (4B), base_seq (4B), CRC16 (2B)
+// record: key (1B), len (1B), seq (4B), CRC16 (2B), value (len B)
+// - record is never split between 2 pages: one put() = one write cycle
+// - seq is +1 for each record, so stale records from previous use of the
+//   region and torn writes (CRC) end the log when it is scanned at boot
+// - len 0 = key was removed
+// - active region is the valid one with higher base_seq
+// - all numbers are little endian
+
+#ifndef KV_STORE_H
+#define KV_STORE_H
+
+#include <stdint.h>
+#include "eeprom.hpp"
+
+#ifndef KV_BASE
+#define KV_BASE				0x0000		// EEPROM address of first region
+#endif
+#ifndef KV_REGION_SIZE
+#define KV_REGION_SIZE		0x4000		// 2 regions, whole 24C256 by default
+#endif
+#ifndef KV_MAX_KEYS
+#define KV_MAX_KEYS			32			// keys are 0 .. KV_MAX_KEYS-1
+#endif
+#define KV_HEADER_SIZE		8
+#define KV_MAX_VALUE		(EEPROM_PAGE_SIZE - KV_HEADER_SIZE)
+
+namespace kv_store
+{
+
+enum class Status: uint8_t
+{
+	Ok = 0,
+	NotFound,
+	NoSpace,		// live values don't fit to one region
+	WrongLength,	// value is empty, longer than KV_MAX_VALUE or buffer is too short
+	WrongKey,
+	Corrupted,		// CRC of record doesn't match any more
+	IoError,		// EEPROM didn't respond
+};
+
+typedef struct
+{
+	uint8_t		region;			// active region: 0 or 1
+	uint16_t	used;			// bytes in active region, headers included
+	uint16_t	live;			// bytes of latest records, headers included
+	uint32_t	next_seq;
+	uint32_t	appends;		// since init()
+	uint32_t	compactions;	// since init()
+} Stats;
+
+// reads region headers and builds RAM index (one pass over the log)
+Status init(i2c::Device dev);
+Status format(void);	// erase all keys
+
+Status put(uint8_t key, const uint8_t* value, uint8_t len);
+Status get(uint8_t key, uint8_t* value, uint8_t size, uint8_t* len);
+Status remove(uint8_t key);
+bool exists(uint8_t key);
+Status compact(void);
+
+const Stats* get_stats(void);
+
+} // namespace
+
+#endif	// KV_STORE_H
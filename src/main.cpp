@@ -6,6 +6,7 @@
 #include "gd32vf103.h"
 #include "gd32vf103_rcu.h"
 #include "gd32vf103_eclic.h"
+#include "n200_func.h"	// get_timer_value()
 #include "src/gpio.hpp"
 #include "src/test_gpio.hpp"
 #include "src/gpio-exti.hpp"
@@ -14,15 +15,80 @@
 #include "src/exti.hpp"
 // #include "eeprom.hpp"
 #include "baro.hpp"
+#include "sample-store.hpp"
 #include "wii-nunchuck.hpp"
 #include "pwm.hpp"
 // #include "shell.hpp"
 #include "rtc.hpp"
 #include "date.hpp"
+#include "wakeup.hpp"
+#include "clock-cal.hpp"
+#include "swtimer.hpp"
+#include "scheduler.hpp"
+#include "kernel.hpp"
+#include "profiler.h"
 
 extern "C" void _init(void);
 #define DELAY 500
 
+// barometer history: 32 raw samples, 1 minute of 1 s averages, 4 hours of
+// 1 min averages. Host sends 'r', 's' or 'm' and gets one binary block
+#define BARO_STORE_ID	1
+static sample_store::Record baro_raw[32];
+static sample_store::Record baro_second[60];
+static sample_store::Record baro_minute[240];
+static sample_store::Store baro_store;
+
+static void put_uart(uint8_t byte)
+{
+	_putchar(byte);
+}
+
+// sampler runs from one shot timer when it has work (end of conversion),
+// new samples go to the store
+static swtimer::Timer sampler_timer;
+
+static void sample(void* arg)
+{
+	(void)arg;
+	bool sampled;
+	{
+		PROFILE_SCOPE("sampler_process");
+		sampled = baro::sampler_process();
+	}
+	if (sampled)
+	{
+		PROFILE_SCOPE("sample_store::add");
+		baro::Sample sample;
+		baro::get_sample(&sample);
+		const int32_t values[2] = {sample.pressure, sample.temperature};
+		sample_store::add(&baro_store, sample.time, values);
+	}
+
+	const uint64_t next = baro::sampler_next_mtime();
+	if (next != UINT64_MAX)
+	{
+		const uint64_t now = get_timer_value();
+		const uint32_t per_ms = delay_get_timer_hz() / 1000;
+		const uint32_t ms = (next > now) ? (next - now + per_ms - 1) / per_ms : 1;
+		swtimer::start(&sampler_timer, ms, 0, sample, NULL);
+	}
+}
+
+// LED and latest sample every DELAY ms
+static void blink(void* arg)
+{
+	(void)arg;
+	gpio_toggle(LEDB);
+
+	baro::Sample sample;
+	if (baro::get_sample(&sample))
+	{
+		PROFILE_SCOPE("printf");
+		printf("Temp: %d.%d°C pressure: %d\r\n", sample.temperature / 10, sample.temperature % 10, sample.pressure);
+	}
+}
+
 extern "C" {	// don't mangle main() it is called from startup code
 void main(void)
 {
@@ -60,31 +126,62 @@ void main(void)
 	// pwm::example();
 	// rtc::test();
 	rtc::example();
+	date::init();
+	clock_cal::init();
+	// wakeup::example();
+	swtimer::init();
+	profiler_init();
+	// swtimer::example();
+	// scheduler::example();
+	// kernel::example();
 
 	// const uint32_t* DBG_ID = (uint32_t *)0xE0042000;
 	// printf("DBG_ID: 0x%x\r\n", *DBG_ID);
 	printf("date: ");
 	date::print();
 
+	// sampler runs in background, timer blinks and prints latest sample
+	baro::sampler_start(BARO_TEMP_PERIOD_MS);
+	sample_store::init(&baro_store, BARO_STORE_ID, 2, baro_raw, 32, baro_second, 60, baro_minute, 240);
+	static swtimer::Timer blink_timer;
+	swtimer::start(&blink_timer, 0, DELAY, blink, NULL);
+	swtimer::start(&sampler_timer, 0, 0, sample, NULL);
+
+	// everything runs from timers and interrupts: the loop sleeps between
 	printf("sad ide while\r\n");
 	while(1)
 	{
-		gpio_toggle(LEDB);
-		delay_ms(DELAY);
-		gpio_toggle(LEDB);
-		delay_ms(DELAY);
+		clock_cal::update();
+		swtimer::process();
 
-		using namespace baro;
-		uint16_t temp = get_temperature() / 10;
-		uint16_t temp_dec = get_temperature() % 10;
-		int32_t pressure = get_pressure();
-		printf("Temp: %d.%d°C pressure: %d\r\n", temp, temp_dec, pressure);
+		switch (uart1_get_rx1())
+		{
+			case 'r':
+				sample_store::export_block(&baro_store, sample_store::Rate::Raw, 0, put_uart);
+				break;
+			case 's':
+				sample_store::export_block(&baro_store, sample_store::Rate::Second, 0, put_uart);
+				break;
+			case 'm':
+				sample_store::export_block(&baro_store, sample_store::Rate::Minute, 0, put_uart);
+				break;
+			case 'p':	// cycle profile report
+				profiler_report();
+				break;
+			case 'P':
+				profiler_reset();
+				break;
+			default:
+				break;
+		}
 
 		// bool key = gpio_get(KEY);
 		// if (key)
 		// {
 		// 	printf("key changed to state: %d\r\n", key);
 		// }
+
+		delay_idle();	// until swtimer alarm, UART RX or other interrupt
 	}
 }
 } // extern C
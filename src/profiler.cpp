@@ -0,0 +1,196 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+
+// #define DEBUG_PROFILER
+#ifndef DEBUG_PROFILER
+#undef DEBUG
+#endif // DEBUG_PROFILER
+
+#include "profiler.h"
+#include "delay.h"			// counters_enable()
+#include "debug.h"
+#include "n200_func.h"		// get_cycle_value(), get_instret_value()
+#ifdef SHELL
+#include <string.h>
+#include "shell-cmd.hpp"
+#endif // SHELL
+
+static ProfilerProbe probes[PROFILER_PROBES];
+static uint8_t nprobes;
+static uint32_t overhead;		// cycles of empty begin/end pair
+static bool running;
+
+// low words are enough: one measurement is shorter than 39 s
+static uint32_t cycles(void)
+{
+	return get_cycle_value();
+}
+
+static uint32_t instret(void)
+{
+	return get_instret_value();
+}
+
+void profiler_reset(void)
+{
+	for (uint8_t i = 0; i < nprobes; i++)
+	{
+		const char* name = probes[i].name;
+		probes[i] = {};
+		probes[i].name = name;
+		probes[i].min  = UINT32_MAX;
+	}
+}
+
+void profiler_init(void)
+{
+	if (!running)
+	{
+		counters_enable();
+		running = 1;
+	}
+
+	// shortest empty pair is the cost of measurement itself
+	overhead = 0;
+	uint32_t min = UINT32_MAX;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		ProfilerStart start;
+		profiler_begin(&start);
+		const uint32_t n = cycles() - start.cycles;
+		if (n < min)
+		{
+			min = n;
+		}
+	}
+	overhead = min;
+	profiler_reset();
+	dprintf("profiler: overhead %d cycles\r\n", overhead);
+}
+
+void profiler_stop(void)
+{
+	if (running)
+	{
+		counters_disable();
+		running = 0;
+	}
+}
+
+void profiler_begin(ProfilerStart* start)
+{
+	start->instret = instret();
+	start->cycles  = cycles();	// last: closest to measured code
+}
+
+static uint8_t find(const char* name)
+{
+	for (uint8_t i = 0; i < nprobes; i++)
+	{
+		if (probes[i].name == name)
+		{
+			return i;
+		}
+	}
+	if (nprobes >= PROFILER_PROBES)
+	{
+		eprintf("profiler: no room for %s\r\n", name);
+		return PROFILER_NEW;
+	}
+
+	probes[nprobes] = {};
+	probes[nprobes].name = name;
+	probes[nprobes].min  = UINT32_MAX;
+	return nprobes++;
+}
+
+void profiler_end(uint8_t* index, const char* name, const ProfilerStart* start)
+{
+	const uint32_t end = cycles();
+	const uint32_t end_instret = instret();
+
+	if (*index == PROFILER_NEW)
+	{
+		*index = find(name);
+		if (*index == PROFILER_NEW)
+		{
+			return;
+		}
+	}
+
+	uint32_t n = end - start->cycles;
+	n = (n > overhead) ? n - overhead : 0;
+
+	ProfilerProbe* p = &probes[*index];
+	p->count++;
+	p->cycles  += n;
+	p->instret += end_instret - start->instret;
+	if (n < p->min)
+	{
+		p->min = n;
+	}
+	if (n > p->max)
+	{
+		p->max = n;
+	}
+}
+
+uint8_t profiler_count(void)
+{
+	return nprobes;
+}
+
+const ProfilerProbe* profiler_get(uint8_t index)
+{
+	return &probes[index];
+}
+
+void profiler_report(void)
+{
+	// indexes sorted by total cycles, insertion sort of a few entries
+	uint8_t order[PROFILER_PROBES];
+	uint64_t sum = 0;
+	for (uint8_t i = 0; i < nprobes; i++)
+	{
+		uint8_t j = i;
+		while ((j > 0) && (probes[order[j - 1]].cycles < probes[i].cycles))
+		{
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+		sum += probes[i].cycles;
+	}
+
+	// long long is not in printf: total in kcycles wraps after 11 hours
+	printf("probe                 count        min       mean        max  total [kcycles]   %%   IPC\r\n");
+	for (uint8_t i = 0; i < nprobes; i++)
+	{
+		const ProfilerProbe* p = &probes[order[i]];
+		if (p->count == 0)
+		{
+			continue;
+		}
+		const uint32_t share = (sum != 0) ? p->cycles * 100 / sum : 0;
+		const uint32_t ipc = (p->cycles != 0) ? p->instret * 100 / p->cycles : 0;
+		printf("%-20s %6d %10d %10d %10d %16u %3d %d.%02d\r\n", p->name, p->count, p->min,
+			(uint32_t)(p->cycles / p->count), p->max, (uint32_t)(p->cycles / 1000), share, ipc / 100, ipc % 100);
+	}
+	printf("profiler overhead %d cycles (subtracted)\r\n", overhead);
+}
+
+#ifdef SHELL
+// profile [reset]
+uint8_t profiler_cmd(char *argv[])
+{
+	if ((argv[1] != NULL) && (strncmp(argv[1], "reset", 5) == 0))
+	{
+		profiler_reset();
+	}
+	else
+	{
+		profiler_report();
+	}
+	return SHELL_RETURN_OK;
+}
+#endif // SHELL
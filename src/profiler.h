@@ -0,0 +1,97 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+// cycle profiler: named probes with count, min, mean and max of mcycle
+//
+// C:	PROFILE_BEGIN(get_pressure);
+//		p = get_pressure();
+//		PROFILE_END(get_pressure);
+// C++:	{
+//			PROFILE_SCOPE("printf");
+//			printf(...);
+//		}
+//
+// probe is found by name on its first use only, later its index is kept in
+// a static variable next to the call site. Overhead of begin/end itself is
+// measured in profiler_init() and subtracted. Counters (mcycle, minstret)
+// run only while profiler is initialized.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifndef PROFILER_PROBES
+#define PROFILER_PROBES		16
+#endif
+
+#define PROFILER_NEW		0xFF	// probe index not known yet
+
+typedef struct
+{
+	uint32_t	cycles;
+	uint32_t	instret;
+} ProfilerStart;
+
+typedef struct
+{
+	const char*	name;
+	uint32_t	count;
+	uint32_t	min;		// cycles
+	uint32_t	max;
+	uint64_t	cycles;		// sum
+	uint64_t	instret;
+} ProfilerProbe;
+
+void profiler_init(void);
+void profiler_stop(void);		// counters are stopped again
+void profiler_reset(void);		// statistics only, probes stay
+void profiler_begin(ProfilerStart* start);
+void profiler_end(uint8_t* index, const char* name, const ProfilerStart* start);
+
+uint8_t profiler_count(void);
+const ProfilerProbe* profiler_get(uint8_t index);
+void profiler_report(void);		// sorted by total cycles
+uint8_t profiler_cmd(char *argv[]);
+
+#define PROFILE_BEGIN(probe) \
+	ProfilerStart profiler_start_##probe; \
+	profiler_begin(&profiler_start_##probe)
+
+#define PROFILE_END(probe) \
+	do { \
+		static uint8_t index = PROFILER_NEW; \
+		profiler_end(&index, #probe, &profiler_start_##probe); \
+	} while (0)
+
+#ifdef __cplusplus
+}	// extern "C"
+
+class ProfileScope
+{
+public:
+	ProfileScope(uint8_t* index, const char* name): index(index), name(name)
+	{
+		profiler_begin(&start);
+	}
+	~ProfileScope()
+	{
+		profiler_end(index, name, &start);
+	}
+
+private:
+	uint8_t*		index;
+	const char*		name;
+	ProfilerStart	start;
+};
+
+#define PROFILE_CAT2(a, b)	a##b
+#define PROFILE_CAT(a, b)	PROFILE_CAT2(a, b)
+#define PROFILE_SCOPE(name) \
+	static uint8_t PROFILE_CAT(profiler_index_, __LINE__) = PROFILER_NEW; \
+	ProfileScope PROFILE_CAT(profiler_scope_, __LINE__)(&PROFILE_CAT(profiler_index_, __LINE__), name)
+
+#endif	// __cplusplus
+#endif // PROFILER_H
@@ -2,9 +2,9 @@
 // Created 200114 - GD32V C+
 
 #include "pwm.hpp"
+#include "gptimer.hpp"
 #include "gd32vf103_rcu.h"
 #include "gd32vf103_gpio.h"
-#include "gd32vf103_timer.h"
 
 namespace pwm
 {
@@ -15,6 +15,15 @@ namespace pwm
 #define LR1	GPIO_PIN_5
 #define LR2	GPIO_PIN_6
 
+#define PWM_TIMER	gptimer::Timer::Timer1
+#define PWM_FREQ_HZ	16			// was 108 MHz / 432 / 16000 = 15.6 Hz
+
+// duty cycles in %, kept when frequency changes
+static uint8_t duty[3] = {0, 50, 75};
+static const gptimer::Channel channels[3] = {
+	gptimer::Channel::Ch1, gptimer::Channel::Ch2, gptimer::Channel::Ch3,
+};
+
 void gpio_config(void)
 {
 	rcu_periph_clock_enable(RCU_GPIOA);
@@ -32,79 +41,45 @@ void gpio_config(void)
 	gpio_bit_reset(GPIOA, LR2);
 }
 
-void timer_config(void)
+// compare value for duty cycle in %, output is high while CNT < compare
+static uint16_t duty_to_compare(uint8_t percent)
 {
-	/* -----------------------------------------------------------------------
-	   TIMER1 configuration: generate 3 PWM signals with 3 different duty cycles:
-	   TIMER1CLK = SystemCoreClock / 108 = 1MHz
-
-	   TIMER1 channel1 duty cycle = (4000/ 16000)* 100  = 25%
-	   TIMER1 channel2 duty cycle = (8000/ 16000)* 100  = 50%
-	   TIMER1 channel3 duty cycle = (12000/ 16000)* 100 = 75%
-	   ----------------------------------------------------------------------- */
-	timer_oc_parameter_struct timer_ocinitpara;
-	timer_parameter_struct timer_initpara;
-
-	rcu_periph_clock_enable(RCU_TIMER1);
-
-	timer_deinit(TIMER1);
-	/* initialize TIMER init parameter struct */
-	timer_struct_para_init(&timer_initpara);
-	/* TIMER1 configuration */
-	// timer_initpara.prescaler         = 107;
-	timer_initpara.prescaler         = 431;
-	timer_initpara.alignedmode       = TIMER_COUNTER_EDGE;
-	timer_initpara.counterdirection  = TIMER_COUNTER_UP;
-	timer_initpara.period            = 15999;
-	timer_initpara.clockdivision     = TIMER_CKDIV_DIV1;
-	timer_initpara.repetitioncounter = 0;
-	timer_init(TIMER1, &timer_initpara);
-
-	/* initialize TIMER channel output parameter struct */
-	timer_channel_output_struct_para_init(&timer_ocinitpara);
-	/* CH0, CH1 and CH2 configuration in PWM mode */
-	timer_ocinitpara.outputstate  = TIMER_CCX_ENABLE;
-	timer_ocinitpara.outputnstate = TIMER_CCXN_DISABLE;
-	timer_ocinitpara.ocpolarity   = TIMER_OC_POLARITY_HIGH;
-	timer_ocinitpara.ocnpolarity  = TIMER_OCN_POLARITY_HIGH;
-	timer_ocinitpara.ocidlestate  = TIMER_OC_IDLE_STATE_LOW;
-	timer_ocinitpara.ocnidlestate = TIMER_OCN_IDLE_STATE_LOW;
-
-	timer_channel_output_config(TIMER1,TIMER_CH_1,&timer_ocinitpara);
-	timer_channel_output_config(TIMER1,TIMER_CH_2,&timer_ocinitpara);
-	timer_channel_output_config(TIMER1,TIMER_CH_3,&timer_ocinitpara);
-
-	/* CH1 configuration in PWM mode1,duty cycle 25% */
-	// timer_channel_output_pulse_value_config(TIMER1,TIMER_CH_1,3999);
-	timer_channel_output_pulse_value_config(TIMER1,TIMER_CH_1,0);
-	timer_channel_output_mode_config(TIMER1,TIMER_CH_1,TIMER_OC_MODE_PWM0);
-	timer_channel_output_shadow_config(TIMER1,TIMER_CH_1,TIMER_OC_SHADOW_DISABLE);
-
-	/* CH2 configuration in PWM mode1,duty cycle 50% */
-	timer_channel_output_pulse_value_config(TIMER1,TIMER_CH_2,7999);
-	timer_channel_output_mode_config(TIMER1,TIMER_CH_2,TIMER_OC_MODE_PWM0);
-	timer_channel_output_shadow_config(TIMER1,TIMER_CH_2,TIMER_OC_SHADOW_DISABLE);
-
-	/* CH3 configuration in PWM mode1,duty cycle 75% */
-	timer_channel_output_pulse_value_config(TIMER1,TIMER_CH_3,11999);
-	timer_channel_output_mode_config(TIMER1,TIMER_CH_3,TIMER_OC_MODE_PWM0);
-	timer_channel_output_shadow_config(TIMER1,TIMER_CH_3,TIMER_OC_SHADOW_DISABLE);
-
-	/* auto-reload preload enable */
-	timer_auto_reload_shadow_enable(TIMER1);
-	/* auto-reload preload enable */
-	timer_enable(TIMER1);
+	const uint32_t compare = gptimer::get_period(PWM_TIMER) * percent / 100;
+	return (compare > 0xFFFF) ? 0xFFFF : compare;
 }
 
-void pwm_set_freq(uint32_t freq)
+// TIMER1 CH1, CH2 and CH3: 3 PWM signals with different duty cycles
+void timer_config(void)
 {
-	timer_parameter_struct timer_initpara;
+	gptimer::Period period;
+	if (!gptimer::init(PWM_TIMER, PWM_FREQ_HZ, &period))
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		gptimer::pwm_init(PWM_TIMER, channels[i], gptimer::OutputMode::Pwm0, duty_to_compare(duty[i]));
+	}
+	gptimer::start(PWM_TIMER);
+	printf("PWM: %d Hz, error %d ppm\r\n", period.hz, period.error_ppm);
+}
 
-	uint8_t cpu_freq = 108;
+bool pwm_set_freq(uint32_t freq)
+{
+	gptimer::Period period;
+	if (!gptimer::set_frequency(PWM_TIMER, freq, &period))
+	{
+		return 0;
+	}
 
-	// timer_initpara.prescaler         = 107;	(108 MHz / 107+1 = 1 MHz)
-	timer_initpara.prescaler         = 431;
-	timer_init(TIMER1, &timer_initpara);
+	// new CAR and compare values are loaded together at the next update
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		gptimer::set_compare(PWM_TIMER, channels[i], duty_to_compare(duty[i]));
+	}
+	printf("PWM: %d Hz, error %d ppm\r\n", period.hz, period.error_ppm);
+	return 1;
 }
 
 void pwm_set_duty(uint8_t n)
@@ -114,12 +89,6 @@ void pwm_set_duty(uint8_t n)
 	// 	eprintf("duty cycle can't be more than 100%\r\n");
 	// }
 
-	uint32_t duty = n * 160;
-	if (duty == 0)
-	{
-		duty = 1;
-	}
-
 	if (n == 'z')
 	{
 		printf("left\r\n");
@@ -144,11 +113,8 @@ void pwm_set_duty(uint8_t n)
 
 	printf("setting duty cycle to n = %d\r\n", n);
 
-	/* CH1 configuration in PWM mode1,duty cycle 25% */
-	// timer_channel_output_pulse_value_config(TIMER1,TIMER_CH_1,3999);
-	timer_channel_output_pulse_value_config(TIMER1,TIMER_CH_1, duty - 1);
-	timer_channel_output_mode_config(TIMER1,TIMER_CH_1,TIMER_OC_MODE_PWM0);
-	timer_channel_output_shadow_config(TIMER1,TIMER_CH_1,TIMER_OC_SHADOW_DISABLE);
+	duty[0] = n;
+	gptimer::set_compare(PWM_TIMER, channels[0], duty_to_compare(n));
 }
 
 
@@ -190,6 +156,13 @@ uint8_t cmd(char *argv[])
 				pwm_set_duty(duty_or_freq);
 			}
 			break;
+		case 'f':
+		case 'F':
+			if (strlen(string_part_read) == 0)
+			{
+				pwm_set_freq(duty_or_freq);
+			}
+			break;
 		default:
 			eprintf("unknown action: %c\r\n", action);
 			return 0;
@@ -12,6 +12,7 @@ namespace pwm
 
 void example(void);
 void pwm_set_duty(uint8_t n);
+bool pwm_set_freq(uint32_t freq);	// duty cycles are kept
 
 uint8_t cmd(char *argv[]);
 
@@ -7,10 +7,13 @@
 
 #include "config.h"
 #include "rtc.hpp"
+#include "date.hpp"
+#include "clock-cal.hpp"
 #ifdef SHELL
 #include "shell-cmd.hpp"
 #endif // SHELL
 #include "utils.hpp"
+#include "exti.hpp"
 #include "gd32vf103_bkp.h"
 #include "gd32vf103_pmu.h"
 #include "gd32vf103_eclic.h"
@@ -58,9 +61,22 @@ static void test_address(void)
 	ASSERT_EQ((uint32_t)&RTC->ALRML,	address_RTC+ 0x24);
 }
 
+// on MCU, RTC has to be running
+static void test_now(void)
+{
+	uint64_t last = now_us();
+	for (uint32_t i = 0; i < 100000; i++)
+	{
+		const uint64_t t = now_us();
+		ASSERT(t >= last);
+		last = t;
+	}
+}
+
 void test(void)
 {
 	test_address();
+	test_now();
 }
 // ------------------------------------------------------------------------ }}}
 
@@ -98,7 +114,10 @@ bool get_flag(Flag flag)
 
 void clear_flag(Flag flag)
 {
-	RTC->CTL = ~(1 << (uint8_t)flag);
+	// SCIF, ALRMIF, OVIF, RSYNF are cleared by writing 0, writing 1 has no
+	// effect; CMF is written with its current value
+	const uint32_t cmf = RTC->CTL & (1 << (uint8_t)Flag::CMF);
+	RTC->CTL = (cmf | 0x0F) & ~(1 << (uint8_t)flag);
 }
 
 void wait_for(Flag flag)
@@ -107,34 +126,108 @@ void wait_for(Flag flag)
 	while ((RTC->CTL & (1 << (uint8_t)flag)) == 0);
 }
 
-void set_prescaler(uint32_t prescaler)
+static uint32_t prescaler = RTC_PRESCALER;	// PSC is write only
+
+void set_prescaler(uint32_t arg_prescaler)
 {
 	// write 20b prescaler to PSCH and PSCL (WO 16b registers)
-	ASSERT((prescaler & 0xFFF00000) != 0);	// only 20 bits allowed
-	uint16_t prescaler_high = prescaler >> 16;
-	uint16_t prescaler_low  = prescaler & 0xFFFF;
+	ASSERT((arg_prescaler & 0xFFF00000) == 0);	// only 20 bits allowed
+	uint16_t prescaler_high = arg_prescaler >> 16;
+	uint16_t prescaler_low  = arg_prescaler & 0xFFFF;
 
+	wait_for(Flag::LWOFF);
+	RTC->CTL |= (1 << (uint8_t)Flag::CMF);
 	RTC->PSCH = prescaler_high;
 	RTC->PSCL = prescaler_low;
+	RTC->CTL &= ~(1 << (uint8_t)Flag::CMF);
+	wait_for(Flag::LWOFF);
+
+	prescaler = arg_prescaler;
+}
+
+// 32 bit value from two 16 bit registers which can change between the
+// reads: high part is read again and everything is repeated if it changed
+static uint32_t read_coherent(volatile uint32_t* high, volatile uint32_t* low, uint16_t high_mask)
+{
+	uint16_t h1;
+	uint16_t h2;
+	uint16_t l;
+
+	do
+	{
+		h1 = *high & high_mask;
+		l  = *low;
+		h2 = *high & high_mask;
+	} while (h1 != h2);
+
+	return ((uint32_t)h1 << 16) | l;
 }
 
 uint32_t get_divider(void)
 {
-	// read from DIVH and DIVL (16b RO registers)
-	uint16_t div_h = RTC->DIVH;
-	uint16_t div_l = RTC->DIVL;
-	return (div_h | div_l);
+	// DIVH [3:0] and DIVL (16b RO registers), counts down from PSC to 0
+	return read_coherent(&RTC->DIVH, &RTC->DIVL, 0x000F);
 }
 
 uint32_t get_counter(void)
 {
 	// CNTH + CNTL = 32 bit value which increments every second
 	// overflow after 49,710 days = 136 years
-	uint16_t low  = RTC->CNTL;
-	uint16_t high = RTC->CNTH;
-	uint32_t seconds = (high << 16) | low;
+	return read_coherent(&RTC->CNTH, &RTC->CNTL, 0xFFFF);
+}
+
+void now(Timestamp* ts)
+{
+	uint32_t counter;
+	uint32_t divider;
 
-	return seconds;
+	// DIV is reloaded when CNT is incremented: CNT must be the same
+	// before and after DIV is read
+	do
+	{
+		counter = get_counter();
+		divider = get_divider();
+	} while (counter != get_counter());
+
+	// elapsed part of second: PSC .. 0 -> 0 .. PSC
+	const uint32_t ticks = (divider <= prescaler) ? prescaler - divider : 0;
+	ts->sec = counter;
+	ts->us  = ((uint64_t)ticks * 1000000) / (prescaler + 1);
+}
+
+static AlarmCallback alarm_callback;
+
+// alarm flag is set when CNT reaches ALRM, it goes also to EXTI line 17 and
+// wakes the core from deep sleep
+void set_alarm(uint32_t counter, AlarmCallback callback)
+{
+	alarm_callback = callback;
+
+	wait_for(Flag::LWOFF);
+	RTC->CTL |= (1 << (uint8_t)Flag::CMF);
+	RTC->ALRMH = counter >> 16;
+	RTC->ALRML = counter & 0xFFFF;
+	RTC->CTL &= ~(1 << (uint8_t)Flag::CMF);
+	wait_for(Flag::LWOFF);
+
+	clear_flag(Flag::ALRMIF);
+	exti::interrupt_flag_clear(exti::Source::RTC);
+	exti::init(exti::Source::RTC, exti::Mode::Interrupt, exti::Edge::Rising);
+	set_interrupt(Interrupt::Alarm, 1);
+	eclic_irq_enable(RTC_ALARM_IRQn, 1, 0);
+}
+
+void disable_alarm(void)
+{
+	set_interrupt(Interrupt::Alarm, 0);
+	alarm_callback = NULL;
+}
+
+uint64_t now_us(void)
+{
+	Timestamp ts;
+	now(&ts);
+	return (uint64_t)ts.sec * 1000000 + ts.us;
 }
 
 // ----------------------------------------------------------------------------
@@ -153,6 +246,7 @@ void init(void)
 
 	wait_for(Flag::RSYNF);
 	wait_for(Flag::LWOFF);
+	set_prescaler(RTC_PRESCALER);	// 1 s from 32768 Hz
 }
 
 void write(uint32_t counter)
@@ -168,6 +262,7 @@ void write(uint32_t counter)
 	RTC->CNTL = low;
 	RTC->CTL &= ~(1 << (uint8_t)Flag::CMF);	// 	rtc_configuration_mode_exit();
 	wait_for(Flag::LWOFF);
+	clock_cal::restart();	// window across the write is wrong
 
 	dprintf("new counterL: %d\r\n", RTC->CNTL);
 }
@@ -246,6 +341,7 @@ void RTC_IRQHandler(void)
 {
 	clear_flag(rtc::Flag::SCIF);
 	// dprintf("Here is %s()\r\n", __func__);
+	date::tick();
 	gpio_toggle(LEDR);
 
 	static uint8_t counter = 0;
@@ -261,5 +357,12 @@ void RTC_IRQHandler(void)
 void RTC_Alarm_IRQHandler(void)
 {
 	// dprintf("Here is %s()\r\n", __func__);
+	clear_flag(rtc::Flag::ALRMIF);
+	exti::interrupt_flag_clear(exti::Source::RTC);
+
+	if (rtc::alarm_callback != NULL)
+	{
+		rtc::alarm_callback();
+	}
 }
 }	// extern "C"	// don't mangle
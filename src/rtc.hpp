@@ -7,6 +7,9 @@
 #include "debug.h"
 #include "gpio.hpp"
 
+#define RTC_CLOCK_HZ		32768	// LXTAL
+#define RTC_PRESCALER		(RTC_CLOCK_HZ - 1)	// CNT += 1 every PSC + 1 clocks
+
 namespace rtc
 {
 
@@ -18,9 +21,22 @@ enum class Interrupt
 	Second = 0,		// SCIE
 };
 
+typedef struct
+{
+	uint32_t	sec;	// RTC counter
+	uint32_t	us;		// part of second from DIV, resolution 1 / RTC_CLOCK_HZ (30.5 us)
+} Timestamp;
+
+typedef void (*AlarmCallback)(void);	// called from interrupt
+
 void test(void);
 uint32_t get_counter(void);
+uint32_t get_divider(void);
 void write(uint32_t counter);
+void now(Timestamp* ts);		// coherent CNT and DIV
+uint64_t now_us(void);			// monotonic, same as now()
+void set_alarm(uint32_t counter, AlarmCallback callback);	// also wakes from deep sleep
+void disable_alarm(void);
 
 void example(void);
 uint8_t cmd(char *argv[]);
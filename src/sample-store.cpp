@@ -0,0 +1,256 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200216
+
+// #define DEBUG_SAMPLE_STORE
+#ifndef DEBUG_SAMPLE_STORE
+#undef DEBUG
+#endif // DEBUG_SAMPLE_STORE
+
+#include "sample-store.hpp"
+#include "crc.h"
+#include "debug.h"
+#include "delay.h"		// delay_get_timer_hz()
+
+namespace sample_store
+{
+
+// rings																	{{{
+// ----------------------------------------------------------------------------
+static void ring_init(Ring* ring, Record* records, uint16_t size)
+{
+	ring->records = records;
+	ring->size    = size;
+	ring->head    = 0;
+	ring->count   = 0;
+}
+
+// the oldest record is overwritten when ring is full
+static void ring_push(Ring* ring, const Record* record)
+{
+	if (ring->size == 0)
+	{
+		return;
+	}
+
+	ring->records[ring->head] = *record;
+	ring->head = (ring->head + 1) % ring->size;
+	if (ring->count < ring->size)
+	{
+		ring->count++;
+	}
+}
+
+static const Record* ring_get(const Ring* ring, uint16_t i)
+{
+	const uint16_t oldest = (ring->head + ring->size - ring->count) % ring->size;
+	return &ring->records[(oldest + i) % ring->size];
+}
+// ------------------------------------------------------------------------ }}}
+// decimation																{{{
+// ----------------------------------------------------------------------------
+// in calibrated mtime ticks, it can change while store is running
+static uint64_t interval_ticks(Rate rate)
+{
+	const uint64_t hz = delay_get_timer_hz();
+	return (rate == Rate::Second) ? hz : hz * 60;
+}
+
+// closed interval goes to its ring, time of record is start of interval
+static void average_flush(Store* store, Rate rate)
+{
+	Average* avg = &store->averages[(uint8_t)rate - 1];
+	if (avg->n == 0)
+	{
+		return;
+	}
+
+	Record record = {};
+	record.time = avg->start;
+	for (uint8_t i = 0; i < store->nvalues; i++)
+	{
+		// rounded to nearest, also for negative values
+		const int64_t sum = avg->sum[i];
+		const int64_t half = avg->n / 2;
+		record.value[i] = (sum >= 0) ? (sum + half) / avg->n : (sum - half) / avg->n;
+		avg->sum[i] = 0;
+	}
+	avg->n = 0;
+
+	ring_push(&store->rings[(uint8_t)rate], &record);
+}
+
+static void average_add(Store* store, Rate rate, uint64_t time, const int32_t* values)
+{
+	Average* avg = &store->averages[(uint8_t)rate - 1];
+
+	if ((avg->n != 0) && (time >= avg->end))
+	{
+		average_flush(store, rate);
+	}
+
+	// aligned to interval length, but never before end of the previous one:
+	// when calibration shortens intervals, record times stay increasing
+	if (avg->n == 0)
+	{
+		const uint64_t length = interval_ticks(rate);
+		uint64_t start = time - time % length;
+		if (start < avg->end)
+		{
+			start = avg->end;
+		}
+		avg->start = start;
+		avg->end   = start + length;
+	}
+	for (uint8_t i = 0; i < store->nvalues; i++)
+	{
+		avg->sum[i] += values[i];
+	}
+	avg->n++;
+}
+// ------------------------------------------------------------------------ }}}
+
+void init(Store* store, uint8_t id, uint8_t nvalues,
+		Record* raw, uint16_t nraw, Record* second, uint16_t nsecond, Record* minute, uint16_t nminute)
+{
+	ASSERT((nvalues != 0) && (nvalues <= SAMPLE_STORE_VALUES));
+
+	store->id      = id;
+	store->nvalues = nvalues;
+	ring_init(&store->rings[(uint8_t)Rate::Raw],    raw,    nraw);
+	ring_init(&store->rings[(uint8_t)Rate::Second], second, nsecond);
+	ring_init(&store->rings[(uint8_t)Rate::Minute], minute, nminute);
+	clear(store);
+}
+
+void clear(Store* store)
+{
+	for (uint8_t i = 0; i < SAMPLE_STORE_RATES; i++)
+	{
+		store->rings[i].head  = 0;
+		store->rings[i].count = 0;
+	}
+	for (uint8_t i = 0; i < SAMPLE_STORE_RATES - 1; i++)
+	{
+		store->averages[i] = {};
+	}
+}
+
+void add(Store* store, uint64_t time, const int32_t* values)
+{
+	Record record = {};
+	record.time = time;
+	for (uint8_t i = 0; i < store->nvalues; i++)
+	{
+		record.value[i] = values[i];
+	}
+
+	ring_push(&store->rings[(uint8_t)Rate::Raw], &record);
+	average_add(store, Rate::Second, time, values);
+	average_add(store, Rate::Minute, time, values);
+}
+
+uint16_t count(const Store* store, Rate rate)
+{
+	return store->rings[(uint8_t)rate].count;
+}
+
+bool get(const Store* store, Rate rate, uint16_t i, Record* record)
+{
+	const Ring* ring = &store->rings[(uint8_t)rate];
+	if (i >= ring->count)
+	{
+		return 0;
+	}
+
+	*record = *ring_get(ring, i);
+	return 1;
+}
+
+// export																	{{{
+// ----------------------------------------------------------------------------
+typedef struct
+{
+	PutByte		put;
+	uint16_t	crc;
+	uint32_t	n;
+} Writer;
+
+static void write_byte(Writer* w, uint8_t byte)
+{
+	w->crc = crc16(w->crc, &byte, 1);
+	w->put(byte);
+	w->n++;
+}
+
+static void write_le(Writer* w, uint64_t value, uint8_t n)
+{
+	while (n--)
+	{
+		write_byte(w, value);
+		value >>= 8;
+	}
+}
+
+// 7 bits per byte, bit 7 = more bytes follow
+static void write_uleb(Writer* w, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		write_byte(w, (value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	write_byte(w, value);
+}
+
+// small negative numbers are small too: 0, -1, 1, -2 ... = 0, 1, 2, 3 ...
+static void write_sleb(Writer* w, int64_t value)
+{
+	write_uleb(w, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+uint32_t export_block(const Store* store, Rate rate, uint64_t since, PutByte put)
+{
+	const Ring* ring = &store->rings[(uint8_t)rate];
+
+	// records are in time order: skip the old ones
+	uint16_t first = 0;
+	while ((first < ring->count) && (ring_get(ring, first)->time < since))
+	{
+		first++;
+	}
+	const uint16_t n = ring->count - first;
+	const uint64_t first_time = (n != 0) ? ring_get(ring, first)->time : 0;
+
+	Writer w = {put, CRC16_INIT, 0};
+	write_byte(&w, 'S');
+	write_byte(&w, 'S');
+	write_byte(&w, SAMPLE_STORE_VERSION);
+	write_byte(&w, store->id);
+	write_byte(&w, (uint8_t)rate);
+	write_byte(&w, store->nvalues);
+	write_le(&w, n, 2);
+	write_le(&w, delay_get_timer_hz(), 4);
+	write_le(&w, first_time, 8);
+
+	Record prev = {};
+	prev.time = first_time;
+	for (uint16_t i = first; i < ring->count; i++)
+	{
+		const Record* r = ring_get(ring, i);
+		write_uleb(&w, r->time - prev.time);
+		for (uint8_t v = 0; v < store->nvalues; v++)
+		{
+			write_sleb(&w, (int64_t)r->value[v] - prev.value[v]);
+		}
+		prev = *r;
+	}
+
+	const uint16_t crc = w.crc;
+	write_le(&w, crc, 2);
+
+	dprintf("exported %d records, %d bytes\r\n", n, w.n);
+	return w.n;
+}
+// ------------------------------------------------------------------------ }}}
+
+} // namespace
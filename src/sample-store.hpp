@@ -0,0 +1,86 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200216
+// timestamped sensor samples: RAM rings of raw samples and of 1 s and
+// 1 min averages, read out as one binary block
+//
+// every sensor has its own store, buffers are given by the caller so size
+// of each ring can be chosen per sensor (e.g. 1 min ring of 240 records =
+// 4 hours of history)
+//
+// export block, little endian:
+// header:	magic "SS" (2B), version (1B), id (1B), rate (1B), nvalues (1B),
+//			count (2B), mtime frequency in Hz (4B, calibrated), time of first
+//			record (8B)
+// records:	time - time of previous record (ULEB128, mtime ticks),
+//			each value - value of previous record (zigzag + ULEB128)
+// end:		CRC16 (crc.h) of everything before it
+// slowly changing values need 1 - 2 bytes per value instead of 4
+
+#ifndef SAMPLE_STORE_H
+#define SAMPLE_STORE_H
+
+#include <stdint.h>
+
+#ifndef SAMPLE_STORE_VALUES
+#define SAMPLE_STORE_VALUES		2		// max values per record
+#endif
+#define SAMPLE_STORE_VERSION	1
+
+namespace sample_store
+{
+
+enum class Rate: uint8_t
+{
+	Raw = 0,
+	Second,		// average of raw samples in each second
+	Minute,		// average of raw samples in each minute
+};
+#define SAMPLE_STORE_RATES		3
+
+typedef struct
+{
+	uint64_t	time;		// mtime, start of interval for averages
+	int32_t		value[SAMPLE_STORE_VALUES];
+} Record;
+
+typedef struct
+{
+	Record*		records;
+	uint16_t	size;
+	uint16_t	head;		// next record is written here
+	uint16_t	count;
+} Ring;
+
+typedef struct
+{
+	int64_t		sum[SAMPLE_STORE_VALUES];
+	uint32_t	n;
+	uint64_t	start;		// mtime, interval being averaged
+	uint64_t	end;
+} Average;
+
+typedef struct
+{
+	uint8_t		id;			// sensor id in export block
+	uint8_t		nvalues;
+	Ring		rings[SAMPLE_STORE_RATES];
+	Average		averages[SAMPLE_STORE_RATES - 1];	// Second, Minute
+} Store;
+
+typedef void (*PutByte)(uint8_t byte);
+
+// size of any ring can be 0, rate is not stored then
+void init(Store* store, uint8_t id, uint8_t nvalues,
+		Record* raw, uint16_t nraw, Record* second, uint16_t nsecond, Record* minute, uint16_t nminute);
+void clear(Store* store);
+void add(Store* store, uint64_t time, const int32_t* values);
+
+uint16_t count(const Store* store, Rate rate);
+bool get(const Store* store, Rate rate, uint16_t i, Record* record);	// i = 0 is the oldest
+
+// records with time >= since, returns number of bytes written by put()
+uint32_t export_block(const Store* store, Rate rate, uint64_t since, PutByte put);
+
+} // namespace
+
+#endif	// SAMPLE_STORE_H
@@ -0,0 +1,223 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+
+// #define DEBUG_SCHEDULER
+#ifndef DEBUG_SCHEDULER
+#undef DEBUG
+#endif // DEBUG_SCHEDULER
+
+#include "scheduler.hpp"
+#include "swtimer.hpp"
+#include "delay.h"
+#include "debug.h"
+#include "n200_func.h"		// get_timer_value()
+
+namespace scheduler
+{
+
+static_assert(SCHEDULER_TASKS <= 32, "one bit per task");
+
+// private types:
+typedef struct
+{
+	Task				task;
+	void*				arg;
+	const char*			name;
+	volatile uint32_t	events;
+	volatile uint32_t	posted;		// mtime low word of first post
+	Stats				stats;
+} TaskControl;
+
+static TaskControl tasks[SCHEDULER_TASKS];
+static volatile uint32_t ready;		// bit per priority
+static Idle idle_hook;
+static uint64_t idle_time;
+
+void init(Idle idle)
+{
+	for (uint8_t i = 0; i < SCHEDULER_TASKS; i++)
+	{
+		tasks[i] = {};
+	}
+	ready     = 0;
+	idle_hook = (idle != NULL) ? idle : sleep;
+	idle_time = 0;
+}
+
+bool add(uint8_t priority, const char* name, Task task, void* arg)
+{
+	if ((priority >= SCHEDULER_TASKS) || (tasks[priority].task != NULL))
+	{
+		eprintf("scheduler: priority %d is not free\r\n", priority);
+		return 0;
+	}
+
+	tasks[priority].name = name;
+	tasks[priority].arg  = arg;
+	tasks[priority].task = task;
+	return 1;
+}
+
+void post(uint8_t priority, uint32_t events)
+{
+	TaskControl* t = &tasks[priority];
+	const uint32_t bit = 1UL << priority;
+
+	__atomic_fetch_or(&t->events, events, __ATOMIC_RELAXED);
+	if ((__atomic_fetch_or(&ready, bit, __ATOMIC_RELEASE) & bit) == 0)
+	{
+		t->posted = get_timer_value();
+	}
+	delay_wake();
+}
+
+bool dispatch(void)
+{
+	const uint32_t r = ready;
+	if (r == 0)
+	{
+		return 0;
+	}
+
+	const uint8_t priority = __builtin_ctz(r);
+	TaskControl* t = &tasks[priority];
+	const uint32_t posted = t->posted;
+
+	// ready bit first: post in between sets it again, at worst one empty pass
+	__atomic_fetch_and(&ready, ~(1UL << priority), __ATOMIC_ACQUIRE);
+	const uint32_t events = __atomic_exchange_n(&t->events, 0, __ATOMIC_ACQUIRE);
+	if ((events == 0) || (t->task == NULL))
+	{
+		return 1;
+	}
+
+	const uint64_t start = get_timer_value();
+	t->task(events, t->arg);
+	const uint32_t run_time = get_timer_value() - start;
+
+	Stats* st = &t->stats;
+	const uint32_t latency = (uint32_t)start - posted;
+	st->runs++;
+	st->run_time += run_time;
+	if (run_time > st->max_run_time)
+	{
+		st->max_run_time = run_time;
+	}
+	if (latency > st->max_latency)
+	{
+		st->max_latency = latency;
+	}
+	return 1;
+}
+
+// same wake flag as swtimer alarm and UART: post() or expired timer after the
+// last check doesn't leave the core sleeping
+void sleep(void)
+{
+	delay_idle();
+}
+
+void run(void)
+{
+	while (1)
+	{
+		if (!dispatch())
+		{
+			const uint64_t start = get_timer_value();
+			idle_hook();
+			idle_time += get_timer_value() - start;
+		}
+	}
+}
+
+const Stats* get_stats(uint8_t priority)
+{
+	return &tasks[priority].stats;
+}
+
+uint64_t get_idle_time(void)
+{
+	return idle_time;
+}
+
+void clear_stats(void)
+{
+	for (uint8_t i = 0; i < SCHEDULER_TASKS; i++)
+	{
+		tasks[i].stats = {};
+	}
+	idle_time = 0;
+}
+
+void print_stats(void)
+{
+	const uint32_t ticks_per_us = delay_get_timer_hz() / 1000000;
+
+	printf("prio name         runs   time [us]  max [us] latency [us]\r\n");
+	for (uint8_t i = 0; i < SCHEDULER_TASKS; i++)
+	{
+		const TaskControl* t = &tasks[i];
+		if (t->task == NULL)
+		{
+			continue;
+		}
+		printf("%4d %-12s %6d %10d %9d %12d\r\n", i, t->name, t->stats.runs,
+			(uint32_t)(t->stats.run_time / ticks_per_us), t->stats.max_run_time / ticks_per_us,
+			t->stats.max_latency / ticks_per_us);
+	}
+	printf("idle %d ms\r\n", (uint32_t)(idle_time / (ticks_per_us * 1000)));
+}
+
+// example: 50 Hz sensor task, background logger once per second, timers
+// post events and are processed in idle hook
+enum
+{
+	PRIO_SENSOR = 0,
+	PRIO_LOG    = 7,
+};
+
+enum
+{
+	EVENT_TICK = 1 << 0,
+};
+
+static void sensor_task(uint32_t events, void* arg)
+{
+	(void)arg;
+	(void)events;
+	// read sensor, filter ...
+}
+
+static void log_task(uint32_t events, void* arg)
+{
+	(void)arg;
+	(void)events;
+	print_stats();
+}
+
+static void post_tick(void* arg)
+{
+	post((uintptr_t)arg, EVENT_TICK);
+}
+
+static void idle(void)
+{
+	swtimer::process();
+	sleep();			// skipped if alarm fired or something was posted since
+}
+
+void example(void)
+{
+	static swtimer::Timer sensor_timer, log_timer;
+
+	swtimer::init();
+	init(idle);
+	add(PRIO_SENSOR, "sensor", sensor_task, NULL);
+	add(PRIO_LOG, "log", log_task, NULL);
+	swtimer::start(&sensor_timer, 0, 20, post_tick, (void*)PRIO_SENSOR);
+	swtimer::start(&log_timer, 1000, 1000, post_tick, (void*)PRIO_LOG);
+
+	run();
+}
+
+} // namespace
@@ -0,0 +1,54 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+// cooperative run to completion scheduler
+//
+// one task per priority, 0 is the highest. Ready tasks are bits of one word,
+// the highest one is found with count trailing zeros. Interrupts (or tasks)
+// post event bits to a task, the task is called once with all bits posted
+// since its last run and returns: no stacks, a high priority task waits at
+// most for the task which is running to finish.
+// Bitmap and events are updated with atomic instructions (RV32 A), post()
+// doesn't disable interrupts.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#ifndef SCHEDULER_TASKS
+#define SCHEDULER_TASKS		8		// up to 32
+#endif
+
+namespace scheduler
+{
+
+typedef void (*Task)(uint32_t events, void* arg);
+typedef void (*Idle)(void);
+
+// mtime ticks
+typedef struct
+{
+	uint32_t	runs;
+	uint64_t	run_time;
+	uint32_t	max_run_time;
+	uint32_t	max_latency;	// first post to start of run
+} Stats;
+
+void init(Idle idle);			// NULL = sleep()
+bool add(uint8_t priority, const char* name, Task task, void* arg);
+void post(uint8_t priority, uint32_t events);	// also from interrupt, events != 0
+
+bool dispatch(void);			// runs the highest ready task, 0 if there was none
+void run(void);					// dispatch forever, idle hook when nothing is ready
+void sleep(void);				// delay_idle(): WFI unless posted or woken since
+
+const Stats* get_stats(uint8_t priority);
+uint64_t get_idle_time(void);
+void print_stats(void);
+void clear_stats(void);
+
+void example(void);
+
+} // namespace
+
+#endif	// SCHEDULER_H
@@ -0,0 +1,359 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+
+// #define DEBUG_SWTIMER
+#ifndef DEBUG_SWTIMER
+#undef DEBUG
+#endif // DEBUG_SWTIMER
+
+#include "swtimer.hpp"
+#include "delay.h"
+#include "debug.h"
+#include "n200_func.h"		// get_timer_value()
+
+namespace swtimer
+{
+
+#define BITS		5
+#define SLOTS		(1 << BITS)
+#define MASK		(SLOTS - 1)
+#define RANGE		(1UL << (BITS * SWTIMER_LEVELS))	// ticks
+
+static_assert(BITS * SWTIMER_LEVELS < 32, "SWTIMER_LEVELS too large");
+
+static Timer* wheel[SWTIMER_LEVELS][SLOTS];
+static uint32_t occupied[SWTIMER_LEVELS];	// bit per slot
+static uint64_t current;		// tick wheel has been processed to
+static uint64_t alarm_tick = UINT64_MAX;
+static uint32_t timer_hz;		// calibrated mtime frequency of ticks
+static uint64_t base_mtime;		// where base_tick starts
+static uint64_t base_tick;
+static volatile bool due;
+static Stats stats;
+
+static uint64_t now_ticks(void)
+{
+	return base_tick + (get_timer_value() - base_mtime) * 1000 / timer_hz;
+}
+
+// rounded up: alarm never comes before its tick
+static uint64_t tick_to_mtime(uint64_t tick)
+{
+	if (tick <= base_tick)
+	{
+		return base_mtime;
+	}
+	return base_mtime + ((tick - base_tick) * timer_hz + 999) / 1000;
+}
+
+uint32_t now(void)
+{
+	return now_ticks();
+}
+
+// wheel																	{{{
+// ----------------------------------------------------------------------------
+static void link(Timer* timer)
+{
+	uint32_t delta = timer->expires - (uint32_t)current;
+	if ((int32_t)delta < 0)
+	{
+		delta = 0;		// already late
+	}
+	else if (delta >= RANGE)
+	{
+		delta = RANGE - 1;	// beyond the wheel: cascaded from top level again
+	}
+
+	uint8_t level = 0;
+	while (delta >= (1UL << (BITS * (level + 1))))
+	{
+		level++;
+	}
+	const uint8_t slot = ((current + delta) >> (BITS * level)) & MASK;
+
+	Timer** head = &wheel[level][slot];
+	timer->prev = NULL;
+	timer->next = *head;
+	if (*head != NULL)
+	{
+		(*head)->prev = timer;
+	}
+	*head = timer;
+	occupied[level] |= 1UL << slot;
+
+	timer->level  = level;
+	timer->slot   = slot;
+	timer->active = 1;
+}
+
+static void unlink(Timer* timer)
+{
+	if (timer->prev != NULL)
+	{
+		timer->prev->next = timer->next;
+	}
+	else
+	{
+		wheel[timer->level][timer->slot] = timer->next;
+		if (timer->next == NULL)
+		{
+			occupied[timer->level] &= ~(1UL << timer->slot);
+		}
+	}
+	if (timer->next != NULL)
+	{
+		timer->next->prev = timer->prev;
+	}
+	timer->active = 0;
+}
+
+// first set bit at or after bit 'from', counting around: 0 .. 31
+static uint8_t distance(uint32_t bitmap, uint8_t from)
+{
+	const uint32_t rotated = (bitmap >> from) | (bitmap << ((SLOTS - from) & MASK));
+	return __builtin_ctz(rotated);
+}
+
+// tick of the earliest expiry on level 0 or cascade on higher levels
+static uint64_t next_event(void)
+{
+	uint64_t next = UINT64_MAX;
+
+	if (occupied[0] != 0)
+	{
+		next = current + distance(occupied[0], current & MASK);
+	}
+	for (uint8_t level = 1; level < SWTIMER_LEVELS; level++)
+	{
+		if (occupied[level] == 0)
+		{
+			continue;
+		}
+		// slot starts when lower bits are 0, current slot only in next round
+		const uint8_t shift = BITS * level;
+		const uint64_t window = current >> shift;
+		const uint64_t tick = (window + 1 + distance(occupied[level], (window + 1) & MASK)) << shift;
+		if (tick < next)
+		{
+			next = tick;
+		}
+	}
+
+	return next;
+}
+
+// moves timers from slots which start at current tick, top level first: a
+// timer can fall through more levels at the same tick
+static void cascade(void)
+{
+	for (uint8_t level = SWTIMER_LEVELS - 1; level > 0; level--)
+	{
+		const uint8_t shift = BITS * level;
+		if ((current & ((1UL << shift) - 1)) != 0)
+		{
+			continue;
+		}
+
+		const uint8_t slot = (current >> shift) & MASK;
+		Timer* timer = wheel[level][slot];
+		wheel[level][slot] = NULL;
+		occupied[level] &= ~(1UL << slot);
+		while (timer != NULL)
+		{
+			Timer* next = timer->next;
+			link(timer);
+			stats.cascaded++;
+			timer = next;
+		}
+	}
+}
+
+// callback can start and stop any timer: slot is emptied one by one
+static uint32_t expire(void)
+{
+	uint32_t n = 0;
+	Timer** head = &wheel[0][current & MASK];
+
+	while (*head != NULL)
+	{
+		Timer* timer = *head;
+		unlink(timer);
+
+		if (timer->period != 0)
+		{
+			timer->expires += timer->period;
+			if ((int32_t)(timer->expires - (uint32_t)current) <= 0)
+			{
+				timer->expires = current + timer->period;	// skip missed periods
+				stats.late++;
+			}
+			link(timer);
+		}
+
+		timer->callback(timer->arg);
+		n++;
+	}
+
+	stats.expired += n;
+	return n;
+}
+// ------------------------------------------------------------------------ }}}
+
+static void on_alarm(void)
+{
+	due = 1;
+	delay_wake();	// main loop can be in delay_idle()
+}
+
+static void program_alarm(void)
+{
+	alarm_tick = next_event();
+	if (alarm_tick == UINT64_MAX)
+	{
+		delay_set_alarm(DELAY_ALARM_SWTIMER, UINT64_MAX, NULL);
+	}
+	else
+	{
+		delay_set_alarm(DELAY_ALARM_SWTIMER, tick_to_mtime(alarm_tick), on_alarm);
+	}
+}
+
+// when calibration changes mtime frequency, ticks go on from the current
+// one at the new rate: no jump of time, pending alarm is programmed again
+static void check_rate(void)
+{
+	const uint32_t hz = delay_get_timer_hz();
+	if (hz == timer_hz)
+	{
+		return;
+	}
+
+	const uint64_t tick = now_ticks();
+	base_mtime = tick_to_mtime(tick);	// start of current tick
+	base_tick  = tick;
+	timer_hz   = hz;
+	if (alarm_tick != UINT64_MAX)
+	{
+		program_alarm();
+	}
+}
+
+void init(void)
+{
+	timer_hz   = delay_get_timer_hz();
+	base_mtime = get_timer_value();
+	base_tick  = base_mtime * 1000 / timer_hz;
+	current = now_ticks();
+	for (uint8_t level = 0; level < SWTIMER_LEVELS; level++)
+	{
+		for (uint8_t slot = 0; slot < SLOTS; slot++)
+		{
+			wheel[level][slot] = NULL;
+		}
+		occupied[level] = 0;
+	}
+	stats = {};
+	due = 0;
+	program_alarm();
+}
+
+void start(Timer* timer, uint32_t delay_ms, uint32_t period_ms, Callback callback, void* arg)
+{
+	ASSERT(callback != NULL);
+
+	if (timer->active)
+	{
+		unlink(timer);
+	}
+	check_rate();
+	if (alarm_tick == UINT64_MAX)
+	{
+		current = now_ticks();	// wheel is empty, it could be far behind
+	}
+	timer->expires  = now_ticks() + delay_ms;
+	timer->period   = period_ms;
+	timer->callback = callback;
+	timer->arg      = arg;
+	link(timer);
+	program_alarm();
+	dprintf("swtimer %p: %d ms, period %d ms\r\n", timer, delay_ms, period_ms);
+}
+
+// alarm is left as it is, it only ends up in an empty process()
+void stop(Timer* timer)
+{
+	if (timer->active)
+	{
+		unlink(timer);
+	}
+}
+
+bool is_active(const Timer* timer)
+{
+	return timer->active;
+}
+
+uint32_t process(void)
+{
+	check_rate();
+	if (!due)
+	{
+		return 0;
+	}
+	due = 0;
+
+	uint32_t n = 0;
+	const uint64_t now = now_ticks();
+	while (1)
+	{
+		const uint64_t tick = next_event();
+		if (tick > now)
+		{
+			break;
+		}
+		if (tick != current)
+		{
+			current = tick;
+			cascade();
+		}
+		n += expire();
+	}
+	current = now;		// nothing is due in between
+
+	program_alarm();
+	return n;
+}
+
+uint64_t next_mtime(void)
+{
+	return (alarm_tick != UINT64_MAX) ? tick_to_mtime(alarm_tick) : UINT64_MAX;
+}
+
+const Stats* get_stats(void)
+{
+	return &stats;
+}
+
+static void print(void* arg)
+{
+	printf("swtimer: %s at %d ms\r\n", (const char*)arg, now());
+}
+
+void example(void)
+{
+	static Timer fast, slow, once;
+
+	init();
+	start(&fast, 100, 250, print, (void*)"250 ms");
+	start(&slow, 0, 60000, print, (void*)"minute");
+	start(&once, 5000, 0, print, (void*)"once after 5 s");
+
+	while (1)
+	{
+		process();
+		delay_until(next_mtime());	// sleeps, other interrupts are serviced
+	}
+}
+
+} // namespace
@@ -0,0 +1,66 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200219
+// software timers: hierarchical timing wheel on one mtime alarm
+//
+// 1 ms tick of calibrated mtime (delay_get_timer_hz()), SWTIMER_LEVELS
+// levels of 32 slots, level n slot is 32^n ticks wide. Timer goes to the
+// level of its distance and moves to lower level when its slot is reached
+// (cascade). Occupied slots are marked in a bitmap
+// per level, so the next event is found without scanning ticks: mtimecmp
+// is programmed for it and there is no periodic tick interrupt.
+// start() and stop() are O(1); callbacks are called from process() in main
+// loop, interrupt only marks that something is due.
+
+#ifndef SWTIMER_H
+#define SWTIMER_H
+
+#include <stdint.h>
+
+#ifndef SWTIMER_LEVELS
+#define SWTIMER_LEVELS		5		// 32^5 ms = 9.3 h, longer timers cascade again
+#endif
+
+namespace swtimer
+{
+
+typedef void (*Callback)(void* arg);
+
+// owned by caller, must stay valid while it is active; zero initialized
+// (static or = {}) before the first start()
+typedef struct Timer
+{
+	struct Timer*	next;
+	struct Timer*	prev;
+	uint32_t		expires;	// tick
+	uint32_t		period;		// ticks, 0 = one shot
+	Callback		callback;
+	void*			arg;
+	uint8_t			level;
+	uint8_t			slot;
+	bool			active;
+} Timer;
+
+typedef struct
+{
+	uint32_t	expired;		// callbacks called
+	uint32_t	cascaded;		// timers moved to lower level
+	uint32_t	late;			// periodic timers which missed a period
+} Stats;
+
+void init(void);				// after clock calibration: tick length is fixed here
+uint32_t now(void);				// ms
+
+// period_ms 0 = one shot; timer which is active is started again
+void start(Timer* timer, uint32_t delay_ms, uint32_t period_ms, Callback callback, void* arg);
+void stop(Timer* timer);
+bool is_active(const Timer* timer);
+
+uint32_t process(void);			// from main loop, returns number of callbacks called
+uint64_t next_mtime(void);		// when process() has work next, e.g. for delay_until()
+const Stats* get_stats(void);
+
+void example(void);
+
+} // namespace
+
+#endif	// SWTIMER_H
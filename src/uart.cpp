@@ -2,6 +2,7 @@
 #include "uart.hpp"
 #include "libc-bits.h"	// memset()
 #include "exti.hpp"
+#include "delay.h"		// delay_wake()
 #include "gd32vf103_rcu.h"	// for clocks, for now
 
 namespace uart
@@ -232,17 +233,35 @@ static void set_mode(Uart uart, Mode mode)
 	reg->CTL1 |=  stop_bits;
 }
 
+static int32_t clock_ppm;			// measured error of bus clock
+static uint32_t speeds[5];			// 0 = UART is not initialized
+
 static void set_baudrate(Uart uart, Speed speed)
 {
 	volatile UartReg* reg = UartMaps[(uint8_t)uart].reg;
 	uint32_t baud       = (uint32_t)speed;
 	uint32_t bus_clk = get_uart_clock(uart);
+	bus_clk += (int64_t)bus_clk * clock_ppm / 1000000;
 	uint16_t intdiv =     bus_clk / (16 * baud);
 	uint16_t fradiv = 16*(bus_clk % (16 * baud)) / (16 * baud);
 	uint16_t regvalue = (intdiv << 4) | fradiv;
 
-	reg->BAUD &= ~regvalue;
-	reg->BAUD |=  regvalue;
+	reg->BAUD = regvalue;
+	speeds[(uint8_t)uart] = baud;
+}
+
+// baud rate of initialized UARTs is calculated again, after last byte is sent
+void set_clock_ppm(int32_t ppm)
+{
+	clock_ppm = ppm;
+	for (uint8_t i = 0; i < 5; i++)
+	{
+		if (speeds[i] != 0)
+		{
+			while (get_flag((Uart)i, Flag::TxComplete) != 1);
+			set_baudrate((Uart)i, (Speed)speeds[i]);
+		}
+	}
 }
 
 static void enable(Uart uart, bool state)
@@ -419,6 +438,7 @@ void USART0_IRQHandler(void)
 		if (current_buffer_position < UART1_RX_BUFFER_SIZE)
 		{
 			UART1_RX_buffer[current_buffer_position++] = recv;
+			delay_wake();
 		}
 		else
 		{
@@ -39,6 +39,7 @@ namespace uart
 	};
 
 void init2(Uart uart, Speed speed, Mode mode);
+void set_clock_ppm(int32_t ppm);	// error of bus clock, from clock calibration
 void clear(void);
 void clear_rx_buffer(void);
 void test(void);
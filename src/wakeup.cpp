@@ -0,0 +1,184 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200217
+
+// #define DEBUG_WAKEUP
+#ifndef DEBUG_WAKEUP
+#undef DEBUG
+#endif // DEBUG_WAKEUP
+
+#include "wakeup.hpp"
+#include "rtc.hpp"
+#include "clock-cal.hpp"
+#include "debug.h"
+#include "gd32vf103.h"
+#include "gd32vf103_pmu.h"
+#include "gd32vf103_eclic.h"
+#include "n200_func.h"
+
+namespace wakeup
+{
+
+// private types:
+typedef struct
+{
+	uint32_t	time;
+	Callback	callback;
+	void*		arg;
+} Alarm;
+
+// sorted by time, [0] is the earliest
+static Alarm alarms[WAKEUP_MAX_ALARMS];
+static uint8_t nalarms;
+static volatile bool alarm_fired;
+
+static void on_alarm(void)
+{
+	alarm_fired = 1;
+}
+
+bool add(uint32_t time, Callback callback, void* arg)
+{
+	if (nalarms >= WAKEUP_MAX_ALARMS)
+	{
+		eprintf("wakeup list is full\r\n");
+		return 0;
+	}
+
+	// after the last one with the same or earlier time
+	uint8_t i = nalarms;
+	while ((i > 0) && (alarms[i - 1].time > time))
+	{
+		alarms[i] = alarms[i - 1];
+		i--;
+	}
+	alarms[i].time     = time;
+	alarms[i].callback = callback;
+	alarms[i].arg      = arg;
+	nalarms++;
+
+	dprintf("wakeup at %d (%d pending)\r\n", time, nalarms);
+	return 1;
+}
+
+bool add_in(uint32_t seconds, Callback callback, void* arg)
+{
+	return add(rtc::get_counter() + seconds, callback, arg);
+}
+
+bool cancel(Callback callback, void* arg)
+{
+	for (uint8_t i = 0; i < nalarms; i++)
+	{
+		if ((alarms[i].callback == callback) && (alarms[i].arg == arg))
+		{
+			for (; i < nalarms - 1; i++)
+			{
+				alarms[i] = alarms[i + 1];
+			}
+			nalarms--;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+uint8_t pending(void)
+{
+	return nalarms;
+}
+
+uint32_t next(void)
+{
+	return alarms[0].time;
+}
+
+uint8_t dispatch(void)
+{
+	uint8_t n = 0;
+
+	// entry is removed before its callback is called, so it can add itself
+	while ((nalarms != 0) && (alarms[0].time <= rtc::get_counter()))
+	{
+		const Alarm alarm = alarms[0];
+		for (uint8_t i = 0; i < nalarms - 1; i++)
+		{
+			alarms[i] = alarms[i + 1];
+		}
+		nalarms--;
+
+		alarm.callback(alarm.arg);
+		n++;
+	}
+
+	return n;
+}
+
+void sleep(Mode mode)
+{
+	dispatch();
+	if (nalarms == 0)
+	{
+		return;		// nothing would wake us up
+	}
+
+	alarm_fired = 0;
+	rtc::set_alarm(alarms[0].time, on_alarm);
+
+	// alarm could be missed if CNT reached it while it was written: don't
+	// sleep then. Interrupts are disabled between the check and WFI, pending
+	// alarm still wakes the core, it is handled after they are enabled again
+	eclic_global_interrupt_disable();
+	if (rtc::get_counter() < alarms[0].time)
+	{
+		switch (mode)
+		{
+			case Mode::Sleep:
+				pmu_to_sleepmode(WFI_CMD);
+				break;
+			case Mode::DeepSleep:
+				pmu_to_deepsleepmode(PMU_LDO_LOWPOWER, WFI_CMD);
+				SystemInit();	// IRC8M after deep sleep: PLL again
+				clock_cal::restart();	// mtime was stopped, RTC was not
+				break;
+			case Mode::Standby:
+				pmu_to_standbymode(WFI_CMD);	// wakes up through reset
+				break;
+		}
+	}
+	eclic_global_interrupt_enable();
+
+	// other interrupt can wake up core from Sleep before alarm
+	if (alarm_fired)
+	{
+		rtc::disable_alarm();
+	}
+	dispatch();
+}
+
+// message every 10 s and every 60 s, deep sleep between
+static void blink(void* arg)
+{
+	(void)arg;
+	printf("wakeup: blink at %d\r\n", rtc::get_counter());
+	add_in(10, blink, NULL);
+}
+
+static void minute(void* arg)
+{
+	(void)arg;
+	printf("wakeup: minute at %d\r\n", rtc::get_counter());
+	add_in(60, minute, NULL);
+}
+
+void example(void)
+{
+	add_in(10, blink, NULL);
+	add_in(60, minute, NULL);
+
+	while (1)
+	{
+		sleep(Mode::DeepSleep);
+	}
+}
+
+} // namespace
@@ -0,0 +1,48 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200217
+// wake up scheduler: sorted list of future RTC times with callbacks
+//
+// RTC alarm is programmed for the earliest entry and MCU sleeps until then,
+// callbacks are called from sleep() after wake up, not from interrupt.
+// - DeepSleep: clocks are stopped, RAM and registers are kept, system
+//   clock is configured again after wake up
+// - Standby: lowest current, RAM is lost and MCU starts from reset at the
+//   alarm, so the list has to be built again at boot
+
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include <stdint.h>
+
+#ifndef WAKEUP_MAX_ALARMS
+#define WAKEUP_MAX_ALARMS	8
+#endif
+
+namespace wakeup
+{
+
+enum class Mode: uint8_t
+{
+	Sleep = 0,	// core only, any interrupt wakes it up
+	DeepSleep,
+	Standby,
+};
+
+typedef void (*Callback)(void* arg);
+
+// time is RTC counter (seconds), entries with the same time are called in
+// order they were added; callback can add itself again (periodic)
+bool add(uint32_t time, Callback callback, void* arg);	// 0 if list is full
+bool add_in(uint32_t seconds, Callback callback, void* arg);
+bool cancel(Callback callback, void* arg);
+uint8_t pending(void);
+uint32_t next(void);			// time of the earliest entry, valid if pending() != 0
+
+uint8_t dispatch(void);			// calls callbacks which are due, returns their number
+void sleep(Mode mode);			// dispatch, sleep until the earliest entry, dispatch
+
+void example(void);
+
+} // namespace
+
+#endif	// WAKEUP_H
@@ -2,148 +2,50 @@
 // 200111 - C+ GD32V
 
 #include "wii-nunchuck.hpp"
+#include "i2c-bus.hpp"
 #include "debug.h"
 #include "libc-bits.h"	// abs()
-
-#define Timed(x) Timeout = 0xFFFF; while (x) { if (Timeout-- == 0) printf("timeout: line: %d\r\n", __LINE__);}
+#include "n200_func.h"	// get_timer_value()
+#include "delay.h"
 
 namespace wii_nunchuck
 {
 	using namespace i2c;
 #define DEV		i2c::Device::myI2C0
-	static void write(Device dev, const uint8_t* data, uint32_t nbyte, uint8_t address);
-
-typedef struct
-{
-	uint8_t		joystick_x;
-	uint8_t		joystick_y;
-	uint16_t	accel_x: 10;
-	uint16_t	accel_y: 10;
-	uint16_t	accel_z: 10;
-	uint8_t		buttonZ: 1;
-	uint8_t		buttonC: 1;
-} wii_data_t;
 
 static uint8_t id[6] = {};
-static uint8_t data[6] = {};
 static uint8_t calibration[16];
-static wii_data_t wii_data;
-static wii_data_t old_wii_data;
 
 static const uint8_t reg_id = 0xFA;
 static const uint8_t reg_calib = 0x20;
 
-void init(void)
-{
-	// GPIO init
-	using namespace gpio;
-	rcu_periph_clock_enable(RCU_GPIOB);
-	rcu_periph_clock_enable(RCU_AF);
-	rcu_periph_clock_enable(RCU_I2C0);
-	gpio_init2(PB6, AfioOD, Speed50MHz);	// SCL
-	gpio_init2(PB7, AfioOD, Speed50MHz);	// SDA
+static const i2c_bus::Client client = {DEV, ADDR, i2c::Speed::Speed400kHz, i2c::DutyCycle::Duty2};
 
-	init(i2c::Device::myI2C0, i2c::Speed::Speed400kHz, i2c::DutyCycle::Duty2);
-
-	const uint8_t buf_init [] = {0xf0 , 0x55 };
-	const uint8_t buf2_init [] = {0xfb , 0x00 };
-	write(DEV, buf_init, 2, ADDR );
-	write(DEV, buf2_init, 2, ADDR );
+static void write(const uint8_t* data, uint32_t nbyte)
+{
+	i2c_bus::write(&client, NULL, 0, data, nbyte);
 }
 
-using namespace i2c;
-
-static void write(Device dev, const uint8_t* data, uint32_t nbyte, uint8_t address)
+static void read(uint8_t *data, uint32_t n)
 {
-	__IO uint32_t Timeout = 0;
-
-	if (nbyte)
-	{
-		wait_until_flag(dev, Flag::BSY, 1);
-
-		start(dev);
-		Timed(!check_event(Event::MasterModeSelected));
-
-		send_addr(dev, address, Mode::Write);
-		i2c::write(dev, *data++);
-
-		while (--nbyte)
-		{
-			wait_until_flag(dev, Flag::BTC, 0);
-			i2c::write(dev, *data++);
-		}
-
-		wait_until_flag(dev, Flag::BTC, 0);
-
-		stop(dev);
-		wait_until_flag(dev, Flag::STPDET, 1);
-	}
+	i2c_bus::read(&client, NULL, 0, data, n);
 }
 
-bool read(Device dev, uint8_t *data, uint32_t n, uint8_t address)
+void init(void)
 {
-	__IO uint32_t Timeout = 0;
-
-	if (!n)
-		return 1;
-
-	wait_until_flag(dev, Flag::BSY, 1);
-	ack(dev);
-	nack_position(dev, NackPosition::Current);
-
-	start(dev);
-	Timed(!check_event(Event::MasterModeSelected));
-
-	send_addr(dev, address, Mode::Read);
-
-	if (n == 1)
-	{
-		nack(dev);
-
-		clear_flag(dev, Flag::ADDSEND);
-		stop(dev);
-
-		wait_until_flag(dev, Flag::RBNE, 0);
-		*data++ = read(dev);
-	}
-	else if (n == 2)
-	{
-		nack_position(dev, NackPosition::Next);
-		clear_flag(dev, Flag::ADDSEND);
-
-		nack(dev);
-		wait_until_flag(dev, Flag::BTC, 0);
-
-		stop(dev);
-		*data++ = read(dev);
-		*data++ = read(dev);
-	}
-	else
-	{
-		clear_flag(dev, Flag::ADDSEND);
-		while (n-- != 3)
-		{
-			wait_until_flag(dev, Flag::BTC, 0);
-			*data++ = read(dev);
-		}
+	i2c_bus::init(DEV);
 
-		wait_until_flag(dev, Flag::BTC, 0);
-
-		nack(dev);
-		*data++ = read(dev);	// receive byte N-2
-		stop(dev);
-
-		*data++ = read(dev);	// receive byte N-1
-
-		Timed(!check_event(Event::MasterByteReceived));
-		*data++ = read(dev);
-
-		n = 0;
-	}
-
-	wait_until_flag(dev, Flag::STPDET, 1);
+	const uint8_t buf_init [] = {0xf0 , 0x55 };
+	const uint8_t buf2_init [] = {0xfb , 0x00 };
+	write(buf_init, 2);
+	write(buf2_init, 2);
+}
 
-	return 1;
+Error read_raw(uint8_t raw[6])
+{
+	const uint8_t reg_report = 0x00;
+	I2C_CHECK(i2c_bus::write(&client, NULL, 0, &reg_report, 1));
+	return i2c_bus::read(&client, NULL, 0, raw, 6);
 }
 
 void read_id(void)
@@ -152,8 +54,8 @@ void read_id(void)
 	// 0x00, 0x00, 0xa4, 0x20, 0x00, 0x00
 	uint8_t bufread [] = {0};
 	bufread[0] = reg_id;
-	write(DEV, bufread, 1, ADDR);
-	read(DEV, id, 6, ADDR);
+	write(bufread, 1);
+	read(id, 6);
 
 	printf("ID: ");
 	for (uint8_t i = 0; i <6 ; i++)
@@ -165,8 +67,8 @@ void read_id(void)
 
 uint8_t *get_calibration(void)
 {
-	write(DEV, &reg_calib, 1, ADDR);
-	read(DEV, calibration, 16, ADDR);
+	write(&reg_calib, 1);
+	read(calibration, 16);
 
 	for (uint8_t i=0; i<16; i++)
 	{
@@ -175,7 +77,7 @@ uint8_t *get_calibration(void)
 	return calibration;
 }
 
-wii_data_t* raw_to_struct(uint8_t raw[])
+void decode(const uint8_t raw[6], wii_data_t* data)
 {
 	// [0] joystick X
 	// [1] joystick Y
@@ -183,118 +85,236 @@ wii_data_t* raw_to_struct(uint8_t raw[])
 	// [3] accelerometer Y [9:2]
 	// [4] accelerometer Z [9:2]
 
-	// [5] b7b6: accelerometer X [1:0]
+	// [5] b7b6: accelerometer Z [1:0]
 	// [5] b5b4: accelerometer Y [1:0]
-	// [5] b3b2: accelerometer Z [1:0]
-	// [5] b1: button C
-	// [5] b0: button Z
-	wii_data.joystick_x = data[0];
-	wii_data.joystick_y = data[1];
-	wii_data.accel_x    = data[2] << 2 | (data[5] & 0b11000000);	// b7 b6
-	wii_data.accel_y    = data[3] << 2 | (data[5] & 0b00110000);	// b5 b4
-	wii_data.accel_z    = data[4] << 2 | (data[5] & 0b00001100);	// b3 b2
-	wii_data.buttonZ    = ~((data[5] & (1 << 0)) >> 0);	// b1
-	wii_data.buttonC    = ~((data[5] & (1 << 1)) >> 1);	// b0
-
-	return &wii_data;
+	// [5] b3b2: accelerometer X [1:0]
+	// [5] b1: button C, 0 = pressed
+	// [5] b0: button Z, 0 = pressed
+	data->joystick_x = raw[0];
+	data->joystick_y = raw[1];
+	data->accel_x    = (raw[2] << 2) | ((raw[5] >> 2) & 0b11);
+	data->accel_y    = (raw[3] << 2) | ((raw[5] >> 4) & 0b11);
+	data->accel_z    = (raw[4] << 2) | ((raw[5] >> 6) & 0b11);
+	data->buttonC    = ((raw[5] & (1 << 1)) == 0);
+	data->buttonZ    = ((raw[5] & (1 << 0)) == 0);
+}
+
+// poller																	{{{
+// ----------------------------------------------------------------------------
+typedef struct
+{
+	bool					running;
+	uint16_t				period_ms;	// also I2C timeout: next poll replaces late one
+	uint64_t				period;		// in mtime ticks
+	uint64_t				next;		// mtime of next poll
+	Thresholds				thresholds;
+	EventCallback			callback;
+	void*					arg;
+
+	i2c_bus::Transaction	read;		// report requested by previous poll
+	i2c_bus::Transaction	request;	// pointer to 0: nunchuck latches new report
+	uint8_t					raw[6];
+	bool					have_data;
+	wii_data_t				data;		// latest
+	wii_data_t				emitted;	// in last event
+	PollerStats				stats;
+} Poller;
+
+static Poller poller;
+static const uint8_t reg_report = 0x00;
+
+static void poller_submit(i2c_bus::Transaction* t, const uint8_t* tx, uint8_t ntx, uint8_t* rx, uint8_t nrx,
+		i2c_bus::Callback callback)
+{
+	t->client     = &client;
+	t->ncmd       = 0;
+	t->tx         = tx;
+	t->ntx        = ntx;
+	t->rx         = rx;
+	t->nrx        = nrx;
+	t->priority   = i2c_bus::Priority::Low;	// input device can wait for sensors
+	t->timeout_ms = poller.period_ms;
+	t->callback   = callback;
+	t->arg        = NULL;
+	i2c_bus::submit(t);
 }
 
-void print_accel(wii_data_t* p, wii_data_t* o)
+static bool moved(uint16_t a, uint16_t b, uint16_t threshold)
 {
-	// print only changes when nothing is pressed:
-#define CHANGE 50
-	if ((o->accel_x - p->accel_x) >= CHANGE)
+	return ((a > b) ? (a - b) : (b - a)) >= threshold;
+}
+
+static uint8_t find_changes(const wii_data_t* now, const wii_data_t* last, const Thresholds* th)
+{
+	uint8_t changes = 0;
+
+	if (moved(now->joystick_x, last->joystick_x, th->joystick) ||
+		moved(now->joystick_y, last->joystick_y, th->joystick))
+	{
+		changes |= ChangeJoystick;
+	}
+	if (moved(now->accel_x, last->accel_x, th->accel) ||
+		moved(now->accel_y, last->accel_y, th->accel) ||
+		moved(now->accel_z, last->accel_z, th->accel))
+	{
+		changes |= ChangeAccel;
+	}
+	if (now->buttonC != last->buttonC)
 	{
-		rprintf("X- %d -> %d\r\n", o->accel_x, p->accel_x);
+		changes |= ChangeButtonC;
 	}
-	else if ((p->accel_x - o->accel_x) >= CHANGE)
+	if (now->buttonZ != last->buttonZ)
 	{
-		gprintf("X+ %d -> %d\r\n", o->accel_x, p->accel_x);
+		changes |= ChangeButtonZ;
 	}
-	if ((o->accel_y - p->accel_y) >= CHANGE)
+
+	return changes;
+}
+
+// called by bus manager when report is read
+static void on_report(void* arg, i2c_bus::Status status)
+{
+	(void)arg;
+	if (status != i2c_bus::Status::Done)
 	{
-		yprintf("Y- %d -> %d\r\n", o->accel_y, p->accel_y);
+		poller.stats.errors++;
+		return;
 	}
-	else if ((p->accel_y - o->accel_y) >= CHANGE)
+
+	decode(poller.raw, &poller.data);
+	poller.stats.polls++;
+
+	// first report is always emitted, it is a reference for next ones
+	Event event;
+	event.changes = find_changes(&poller.data, &poller.emitted, &poller.thresholds);
+	if (poller.have_data == 0)
 	{
-		bprintf("Y+ %d -> %d\r\n", o->accel_y, p->accel_y);
+		event.changes = ChangeJoystick | ChangeAccel | ChangeButtonC | ChangeButtonZ;
 	}
-	if ((o->accel_z - p->accel_z) >= CHANGE)
+	poller.have_data = 1;
+
+	if (event.changes != 0)
 	{
-		mprintf("Z- %d -> %d\r\n", o->accel_z, p->accel_z);
+		poller.emitted = poller.data;
+		poller.stats.events++;
+		if (poller.callback != NULL)
+		{
+			event.time = get_timer_value();
+			event.data = poller.data;
+			poller.callback(&event, poller.arg);
+		}
 	}
-	else if ((p->accel_z - o->accel_z) >= CHANGE)
+}
+
+static void on_request(void* arg, i2c_bus::Status status)
+{
+	(void)arg;
+	if (status != i2c_bus::Status::Done)
 	{
-		yprintf("Z+ %d -> %d\r\n", o->accel_z, p->accel_z);
+		poller.stats.errors++;
 	}
 }
 
-void print_joystick(wii_data_t* p)
+static bool is_queued(const i2c_bus::Transaction* t)
 {
-	printf("Joystick: %d %d\r\n", p->joystick_x, p->joystick_y);
+	return (t->status == i2c_bus::Status::Queued);
 }
 
-void wiiread(void)
+void poller_start(uint16_t period_ms, const Thresholds* thresholds, EventCallback callback, void* arg)
 {
-	uint8_t bufread [] = {0};
+	poller_stop();
+	poller = {};
+	poller.period_ms  = period_ms;
+	poller.period     = delay_ms_to_ticks(period_ms);
+	poller.thresholds = *thresholds;
+	poller.callback   = callback;
+	poller.arg        = arg;
+	poller.running    = 1;
+
+	// first report is requested now and read on first poll
+	poller.next = get_timer_value() + poller.period;
+	poller_submit(&poller.request, &reg_report, 1, NULL, 0, on_request);
+}
 
-	while(1)
+void poller_stop(void)
+{
+	// queued transactions point to poller, they are finished first
+	while (is_queued(&poller.read) || is_queued(&poller.request))
 	{
-		write(DEV, bufread, 1, ADDR);
-		read(DEV, data, 6, ADDR);
-		// read(data, 6, ADDR);
-		wii_data_t* p = raw_to_struct(data);
-		wii_data_t* o = &old_wii_data;
-
-		static bool printed  = 0;
-		static bool printedZ = 0;
-		static bool printedC = 0;
-		static bool printed_raw = 0;
+		i2c_bus::process(DEV);
+	}
+	poller.running = 0;
+}
 
-		print_accel(p, o);
-		print_joystick(p);
+void poller_process(void)
+{
+	if (poller.running == 0)
+	{
+		return;
+	}
 
-		old_wii_data.accel_x = wii_data.accel_x;
-		old_wii_data.accel_y = wii_data.accel_y;
-		old_wii_data.accel_z = wii_data.accel_z;
+	const uint64_t now = get_timer_value();
+	if ((now >= poller.next) && !is_queued(&poller.read) && !is_queued(&poller.request))
+	{
+		poller_submit(&poller.read, NULL, 0, poller.raw, 6, on_report);
+		poller_submit(&poller.request, &reg_report, 1, NULL, 0, on_request);
 
-		if (printed == 0)
+		// fixed rate, polls missed while CPU was busy are skipped
+		poller.next += poller.period;
+		if (poller.next <= now)
 		{
-			printed = 1;
-			printf("print button C to print raw data\r\n");
+			poller.next = now + poller.period;
 		}
+	}
 
-		if ((p->buttonZ == 1) && (printedZ == 0))
-		{
-			printedZ = 1;
-			printf("Release button Z for some action\r\n");
-		}
-		else if ((p->buttonZ == 1) && (printedZ == 1))
-		{
-			// do nothing
-		}
-		else if ((p->buttonC == 1) && (printedC == 0))
-		{
-			printedC = 1;
-
-			if (printed_raw == 0)
-			{
-				printed_raw = 1;
-				printf("Accel X: %4d Y: %4d Z: %4d\t", p->accel_x, p->accel_y, p->accel_z);
-				printf("Joystick X: %3d Y: %3d\t", p->joystick_x, p->joystick_y);
-				printf("buttons: C: %d Z: %d\r\n", p->buttonC, p->buttonZ);
-			}
-		}
-		else if (p->buttonC == 0)
-		{
-			// buttonC released after raw stats are printed, reset that flag:
-			printed_raw = 0;
-		}
-		else
-		{
-			printedZ = 0;
-			printedC = 0;
-		}
+	// bus is polled, not interrupt driven
+	if (is_queued(&poller.read) || is_queued(&poller.request))
+	{
+		i2c_bus::process(DEV);
+	}
+}
+
+uint64_t poller_next_mtime(void)
+{
+	if (poller.running == 0)
+	{
+		return UINT64_MAX;
+	}
+	if (is_queued(&poller.read) || is_queued(&poller.request))
+	{
+		return 0;	// bus is polled
+	}
+	return poller.next;
+}
+
+bool get_data(wii_data_t* data)
+{
+	*data = poller.data;
+	return poller.have_data;
+}
+
+const PollerStats* get_poller_stats(void)
+{
+	return &poller.stats;
+}
+// ------------------------------------------------------------------------ }}}
+
+static void print_event(const Event* e, void* arg)
+{
+	(void)arg;
+	const wii_data_t* p = &e->data;
+
+	if (e->changes & (ChangeButtonC | ChangeButtonZ))
+	{
+		printf("buttons: C: %d Z: %d\r\n", p->buttonC, p->buttonZ);
+	}
+	if (e->changes & ChangeJoystick)
+	{
+		printf("Joystick X: %3d Y: %3d\r\n", p->joystick_x, p->joystick_y);
+	}
+	if (e->changes & ChangeAccel)
+	{
+		printf("Accel X: %4d Y: %4d Z: %4d\r\n", p->accel_x, p->accel_y, p->accel_z);
 	}
 }
 
@@ -305,7 +325,13 @@ void example(void)
 	// (void)get_calibration();
 	read_id();
 
-	wiiread();
+	const Thresholds thresholds = {8, 50};
+	poller_start(WII_POLL_PERIOD_MS, &thresholds, print_event, NULL);
+	while (1)
+	{
+		poller_process();
+		delay_until(poller_next_mtime());	// sleeps, other interrupts are serviced
+	}
 }
 
 } // namespace
@@ -6,13 +6,74 @@
 
 #include "i2c.hpp"
 
+#ifndef WII_POLL_PERIOD_MS
+#define WII_POLL_PERIOD_MS		20		// 50 Hz
+#endif
+
 namespace wii_nunchuck
 {
 // #define ADDR	0x52	// 1010010
 #define ADDR	0xA4	// 10100100
 
+typedef struct
+{
+	uint8_t		joystick_x;
+	uint8_t		joystick_y;
+	uint16_t	accel_x: 10;
+	uint16_t	accel_y: 10;
+	uint16_t	accel_z: 10;
+	uint8_t		buttonZ: 1;		// 1 = pressed
+	uint8_t		buttonC: 1;
+} wii_data_t;
+
+void init(void);
+i2c::Error read_raw(uint8_t raw[6]);	// 6 byte report, not decoded
+void decode(const uint8_t raw[6], wii_data_t* data);
 void example(void);
 
+// poller																	{{{
+// ----------------------------------------------------------------------------
+// report is read every period with queued I2C transactions, next report is
+// requested right after it, so nothing waits for the nunchuck. Event is
+// emitted only when state moves from the last emitted one by threshold.
+enum Change: uint8_t
+{
+	ChangeJoystick	= (1 << 0),
+	ChangeAccel		= (1 << 1),
+	ChangeButtonC	= (1 << 2),
+	ChangeButtonZ	= (1 << 3),
+};
+
+typedef struct
+{
+	uint8_t		joystick;	// min change of X or Y
+	uint16_t	accel;		// min change of any axis
+} Thresholds;
+
+typedef struct
+{
+	uint64_t	time;		// mtime when report was read
+	uint8_t		changes;	// Change bits
+	wii_data_t	data;
+} Event;
+
+typedef struct
+{
+	uint32_t	polls;
+	uint32_t	events;
+	uint32_t	errors;
+} PollerStats;
+
+typedef void (*EventCallback)(const Event* event, void* arg);
+
+void poller_start(uint16_t period_ms, const Thresholds* thresholds, EventCallback callback, void* arg);
+void poller_stop(void);
+void poller_process(void);		// from main loop or timer, never waits
+uint64_t poller_next_mtime(void);	// when process() has work, 0 = now, UINT64_MAX = stopped
+bool get_data(wii_data_t* data);	// latest report, 0 if there is none yet
+const PollerStats* get_poller_stats(void);
+// ------------------------------------------------------------------------ }}}
+
 } // namespace
 
 #endif //  WII_NUNCHUCK_H
@@ -0,0 +1,152 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200210
+// PC_RUN replacements for MCU only functions: mtime, delay, printf output
+
+#include <stdio.h>
+#include "i2c-sim.hpp"
+#include "rtc.hpp"
+#include "delay.h"
+#include "debug.h"
+
+extern "C"	// don't mangle
+{
+uint32_t SystemCoreClock = 108000000;
+
+// mtime runs at SystemCoreClock / 4
+uint64_t get_timer_value(void)
+{
+	return i2c_sim::now_us() * (SystemCoreClock / 4 / 1000000);
+}
+
+// core runs at SystemCoreClock, one instruction per two cycles
+uint64_t get_cycle_value(void)
+{
+	return get_timer_value() * 4;
+}
+
+uint64_t get_instret_value(void)
+{
+	return get_cycle_value() / 2;
+}
+
+void counters_enable(void)
+{
+}
+
+void counters_disable(void)
+{
+}
+
+// mtime alarm: called when delays pass it, instead of from interrupt
+static uint64_t alarm_mtime = UINT64_MAX;
+static DelayAlarmCallback alarm_callback;
+
+static void check_alarm(void)
+{
+	if (get_timer_value() >= alarm_mtime)
+	{
+		alarm_mtime = UINT64_MAX;
+		alarm_callback();
+	}
+}
+
+void delay_ms(uint32_t count)
+{
+	i2c_sim::advance_us((uint64_t)count * 1000);
+	check_alarm();
+}
+
+void delay_until(uint64_t mtime)
+{
+	const uint64_t now = get_timer_value();
+	if (mtime > now)
+	{
+		i2c_sim::advance_us((mtime - now + (SystemCoreClock / 4 / 1000000) - 1) / (SystemCoreClock / 4 / 1000000));
+	}
+	check_alarm();
+}
+
+void delay_wfi(volatile const uint32_t* pending)
+{
+	(void)pending;
+}
+
+// no interrupts in host build: a sleep without pending wake up is counted,
+// it would be lost (or waiting for an unrelated interrupt) on MCU
+static bool wake_pending;
+static uint32_t idle_sleeps;
+
+void delay_wake(void)
+{
+	wake_pending = 1;
+}
+
+void delay_idle(void)
+{
+	if (!wake_pending)
+	{
+		idle_sleeps++;
+	}
+	wake_pending = 0;
+}
+
+// calibrated mtime frequency, mtime itself keeps running at nominal rate
+static uint32_t timer_hz;
+
+void delay_set_timer_hz(uint32_t hz)
+{
+	timer_hz = hz;
+}
+
+uint32_t delay_get_timer_hz(void)
+{
+	return (timer_hz != 0) ? timer_hz : SystemCoreClock / 4;
+}
+
+uint64_t delay_ms_to_ticks(uint32_t ms)
+{
+	return (uint64_t)ms * delay_get_timer_hz() / 1000;
+}
+
+uint64_t delay_us_to_ticks(uint32_t us)
+{
+	return (uint64_t)us * delay_get_timer_hz() / 1000000;
+}
+
+void delay_set_alarm(uint8_t alarm, uint64_t mtime, DelayAlarmCallback callback)
+{
+	ASSERT(alarm == DELAY_ALARM_SWTIMER);	// the only user in host build
+	alarm_mtime    = (callback != NULL) ? mtime : UINT64_MAX;
+	alarm_callback = callback;
+}
+
+// 191226 3rd party printf:
+void _putchar(char ch)
+{
+	putchar(ch);
+}
+}	// extern "C"	// don't mangle
+
+namespace i2c_sim
+{
+uint32_t sleeps(void)
+{
+	return idle_sleeps;
+}
+} // namespace
+
+// RTC counter, set directly by tests
+namespace rtc
+{
+static uint32_t counter;
+
+uint32_t get_counter(void)
+{
+	return counter;
+}
+
+void write(uint32_t arg_counter)
+{
+	counter = arg_counter;
+}
+} // namespace
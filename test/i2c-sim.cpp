@@ -0,0 +1,317 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200210
+// PC_RUN replacement for src/i2c.cpp: same API, no registers
+
+#include <stdio.h>
+#include "i2c-sim.hpp"
+#include "debug.h"
+
+namespace i2c_sim
+{
+	using namespace i2c;
+
+// private types:
+typedef struct
+{
+	Model*		models[4];
+	uint8_t		nmodels;
+	Model*		current;	// addressed slave, NULL if none or NACK
+	uint32_t	scl_hz;
+	bool		in_transaction;
+} Bus;
+
+static Bus buses[2];
+static Stats stats;
+static uint64_t time_us;
+
+uint64_t now_us(void)
+{
+	return time_us;
+}
+
+void advance_us(uint64_t us)
+{
+	time_us += us;
+}
+
+// SCL periods on the bus
+static void advance_bits(Bus* bus, uint32_t bits)
+{
+	const uint32_t hz = (bus->scl_hz != 0) ? bus->scl_hz : 100000;
+	const uint64_t us = ((uint64_t)bits * 1000000 + hz - 1) / hz;
+	stats.bus_time_us += us;
+	advance_us(us);
+}
+
+static Bus* get_bus(Device dev)
+{
+	ASSERT(dev != Device::wrong);
+	return &buses[(uint8_t)dev];
+}
+
+void attach(Device dev, Model* model)
+{
+	Bus* bus = get_bus(dev);
+	ASSERT(bus->nmodels < sizeof(bus->models) / sizeof(bus->models[0]));
+	bus->models[bus->nmodels++] = model;
+}
+
+void detach_all(void)
+{
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		buses[i].nmodels = 0;
+		buses[i].current = NULL;
+		buses[i].in_transaction = 0;
+	}
+}
+
+const Stats* get_stats(void)
+{
+	return &stats;
+}
+
+void reset_stats(void)
+{
+	stats = {};
+}
+
+void print_stats(const char* what)
+{
+	printf("%-28s transactions: %3d restarts: %3d bytes: %5d nacks: %3d bus time: %6d us\r\n",
+			what, stats.transactions, stats.restarts, stats.bytes, stats.nacks,
+			(uint32_t)stats.bus_time_us);
+}
+
+// one byte with ACK bit, returns ACK
+static bool bus_address(Bus* bus, uint8_t address, Mode mode)
+{
+	const bool is_read = (mode == Mode::Read);
+
+	stats.bytes++;
+	advance_bits(bus, 9);
+
+	bus->current = NULL;
+	for (uint8_t i = 0; i < bus->nmodels; i++)
+	{
+		Model* m = bus->models[i];
+		if ((m->address == (address & 0xFE)) && m->start(m->self, is_read))
+		{
+			bus->current = m;
+			return 1;
+		}
+	}
+
+	stats.nacks++;
+	return 0;
+}
+
+} // namespace i2c_sim
+
+// i2c:: API																{{{
+// ----------------------------------------------------------------------------
+namespace i2c
+{
+	using namespace i2c_sim;
+
+static Bus* bus_of(Device dev)
+{
+	ASSERT(dev != Device::wrong);
+	return &buses[(uint8_t)dev];
+}
+
+void test(void)
+{
+}
+
+Error init(Device dev, Speed speed, DutyCycle duty)
+{
+	if (dev == Device::wrong)
+	{
+		return Error::WrongArgument;
+	}
+	return set_speed(dev, speed, duty);
+}
+
+Error set_clock(Device dev, uint32_t scl_hz, DutyCycle duty, uint32_t* achieved_hz)
+{
+	(void)duty;
+	if ((dev == Device::wrong) || (scl_hz == 0) || (scl_hz > 1000000))
+	{
+		return Error::WrongArgument;
+	}
+	bus_of(dev)->scl_hz = scl_hz;
+	if (achieved_hz != NULL)
+	{
+		*achieved_hz = scl_hz;
+	}
+	return Error::Ok;
+}
+
+uint32_t get_clock(Device dev)
+{
+	return bus_of(dev)->scl_hz;
+}
+
+Error set_speed(Device dev, Speed speed, DutyCycle duty)
+{
+	return set_clock(dev, (uint32_t)speed, duty, NULL);
+}
+
+void set_timeout(Device dev, uint32_t us)
+{
+	(void)dev;
+	(void)us;
+}
+
+Error start(Device dev)
+{
+	Bus* bus = bus_of(dev);
+
+	if (bus->in_transaction)
+	{
+		stats.restarts++;
+	}
+	else
+	{
+		stats.transactions++;
+	}
+	bus->in_transaction = 1;
+	advance_bits(bus, 1);
+	return Error::Ok;
+}
+
+Error restart(Device dev)
+{
+	return start(dev);
+}
+
+Error stop(Device dev)
+{
+	Bus* bus = bus_of(dev);
+
+	if (bus->current != NULL)
+	{
+		bus->current->stop(bus->current->self);
+	}
+	bus->current = NULL;
+	bus->in_transaction = 0;
+	advance_bits(bus, 1);
+	return Error::Ok;
+}
+
+Error enable(Device dev)
+{
+	(void)dev;
+	return Error::Ok;
+}
+
+Error disable(Device dev)
+{
+	(void)dev;
+	return Error::Ok;
+}
+
+Error send_addr(Device dev, uint8_t address, Mode mode)
+{
+	return bus_address(bus_of(dev), address, mode) ? Error::Ok : Error::Nack;
+}
+
+Error recover(Device dev)
+{
+	Bus* bus = bus_of(dev);
+	bus->current = NULL;
+	bus->in_transaction = 0;
+	return Error::Ok;
+}
+
+Error read(Device dev, uint8_t* data)
+{
+	Bus* bus = bus_of(dev);
+
+	if (bus->current == NULL)
+	{
+		*data = 0xFF;	// nobody drives SDA
+	}
+	else
+	{
+		*data = bus->current->read(bus->current->self);
+	}
+	stats.bytes++;
+	advance_bits(bus, 9);
+	return Error::Ok;
+}
+
+Error write(Device dev, uint8_t data)
+{
+	Bus* bus = bus_of(dev);
+
+	stats.bytes++;
+	advance_bits(bus, 9);
+	if ((bus->current == NULL) || (bus->current->write(bus->current->self, data) == 0))
+	{
+		stats.nacks++;
+		return Error::Nack;
+	}
+	return Error::Ok;
+}
+
+Error receive(Device dev, uint8_t address, uint8_t* data, uint16_t n)
+{
+	if (n == 0)
+	{
+		return Error::Ok;
+	}
+	I2C_CHECK(send_addr(dev, address, Mode::Read));
+	for (uint16_t i = 0; i < n; i++)
+	{
+		read(dev, &data[i]);
+	}
+	return stop(dev);
+}
+
+Error ack(Device dev)
+{
+	(void)dev;
+	return Error::Ok;
+}
+
+Error nack(Device dev)
+{
+	(void)dev;
+	return Error::Ok;
+}
+
+Error nack_position(Device dev, NackPosition pos)
+{
+	(void)dev;
+	(void)pos;
+	return Error::Ok;
+}
+
+Error _wait_until_flag(Device dev, Flag flag, uint8_t condition, const char* fn_name, const char* file, uint32_t line)
+{
+	(void)dev;
+	(void)flag;
+	(void)condition;
+	(void)fn_name;
+	(void)file;
+	(void)line;
+	return Error::Ok;
+}
+
+Error clear_flag(Device dev, Flag flag)
+{
+	(void)dev;
+	(void)flag;
+	return Error::Ok;
+}
+
+bool check_event(Event event)
+{
+	(void)event;
+	return 1;
+}
+
+} // namespace i2c
+// ------------------------------------------------------------------------ }}}
@@ -0,0 +1,84 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200210
+// PC_RUN: simulated I2C bus behind i2c:: API, drivers run unchanged on PC
+//
+// every slave model is a set of callbacks, called at the same points where
+// real slave would see START, a byte or STOP on the bus. Virtual time
+// (get_timer_value(), delay_ms()) is advanced by bus traffic and delays, so
+// time depending behavior (conversion time, EEPROM write cycle) is modeled
+// without waiting
+
+#ifndef I2C_SIM_H
+#define I2C_SIM_H
+
+#include <stdint.h>
+#include "i2c.hpp"
+
+namespace i2c_sim
+{
+
+typedef struct
+{
+	const char*	name;
+	uint8_t		address;					// 8 bit address, R/W bit = 0
+	bool	(*start)(void* self, bool read);	// return 0 to NACK address
+	bool	(*write)(void* self, uint8_t byte);	// return 0 to NACK byte
+	uint8_t	(*read)(void* self);
+	void	(*stop)(void* self);				// not called on RESTART
+	void*		self;
+} Model;
+
+// bus traffic, to compare number of transactions between driver versions
+typedef struct
+{
+	uint32_t	transactions;	// START without RESTART
+	uint32_t	restarts;
+	uint32_t	bytes;			// address bytes included
+	uint32_t	nacks;
+	uint64_t	bus_time_us;	// time spent on SCL
+} Stats;
+
+void attach(i2c::Device dev, Model* model);
+void detach_all(void);
+const Stats* get_stats(void);
+void reset_stats(void);
+void print_stats(const char* what);
+
+// virtual time, in us
+uint64_t now_us(void);
+void advance_us(uint64_t us);
+uint32_t sleeps(void);			// delay_idle() calls without pending wake up, in host.cpp
+
+// models																	{{{
+// ----------------------------------------------------------------------------
+namespace bmp180
+{
+Model* model(void);
+void reset(void);
+void set_raw(uint16_t ut, uint32_t up);		// UP for OSS = 0
+}
+
+namespace eeprom24c256
+{
+#define SIM_EEPROM_SIZE			32768
+#define SIM_EEPROM_PAGE			64
+#define SIM_EEPROM_WRITE_US		5000	// tWR
+Model* model(void);
+void reset(void);
+uint8_t* memory(void);
+uint32_t write_cycles(void);
+uint32_t page_write_cycles(uint16_t page);
+}
+
+namespace nunchuck
+{
+Model* model(void);
+void reset(void);
+bool is_initialized(void);
+void set_state(uint8_t jx, uint8_t jy, uint16_t ax, uint16_t ay, uint16_t az, bool c, bool z);
+}
+// ------------------------------------------------------------------------ }}}
+
+} // namespace
+
+#endif // I2C_SIM_H
@@ -0,0 +1,974 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200210
+// PC_RUN: drivers on top of simulated I2C bus, see i2c-sim.hpp
+// any failed ASSERT ends the run with exit code 1
+
+#include "i2c-sim.hpp"
+#include "i2c-bus.hpp"
+#include "baro.hpp"
+#include "altitude.hpp"
+#include "sample-store.hpp"
+#include "crc.h"
+#include "eeprom.hpp"
+#include "eeprom-cache.hpp"
+#include "kv-store.hpp"
+#include "wii-nunchuck.hpp"
+#include "date.hpp"
+#include "swtimer.hpp"
+#include "scheduler.hpp"
+#include "profiler.h"
+#include "delay.h"
+#include "n200_func.h"
+#include "rtc.hpp"
+#include "debug.h"
+#include <math.h>
+#include <string.h>
+
+using namespace i2c_sim;
+
+#define DEV		i2c::Device::myI2C0
+
+static void setup(void)
+{
+	detach_all();
+	bmp180::reset();
+	eeprom24c256::reset();
+	nunchuck::reset();
+	attach(DEV, bmp180::model());
+	attach(DEV, eeprom24c256::model());
+	attach(DEV, nunchuck::model());
+	reset_stats();
+}
+
+// baro																		{{{
+// ----------------------------------------------------------------------------
+static void test_baro(void)
+{
+	setup();
+	baro::init(DEV);
+	print_stats("baro::init()");
+	ASSERT_EQ(get_stats()->transactions, 1);	// calibration in one burst
+
+	reset_stats();
+	ASSERT_EQ(baro::get_id(), 0x55);
+
+	// datasheet example
+	reset_stats();
+	ASSERT_EQ(baro::get_temperature(), 150);
+	print_stats("baro::get_temperature()");
+
+	reset_stats();
+	ASSERT_EQ(baro::get_pressure(), 69964);
+	print_stats("baro::get_pressure()");
+
+	// sampler: 1 s of polling every 100 us, temperature every 100 ms
+	reset_stats();
+	baro::sampler_start(100);
+	uint32_t polls = 0;
+	uint32_t samples = 0;
+	const uint64_t end = now_us() + 1000000;
+	while (now_us() < end)
+	{
+		samples += baro::sampler_process();
+		polls++;
+		advance_us(100);
+	}
+	baro::sampler_stop();
+	print_stats("baro::sampler, 1 s");
+
+	baro::Sample sample;
+	const baro::SamplerStats* st = baro::get_sampler_stats();
+	ASSERT_EQ(baro::get_sample(&sample), 1);
+	ASSERT_EQ(sample.temperature, 150);
+	ASSERT_EQ(sample.pressure, 69964);
+	ASSERT_EQ(sample.seq, samples);
+	ASSERT_EQ(st->pressures, samples);
+	ASSERT_EQ(st->errors, 0);
+	ASSERT(sample.time >= sample.temp_time);
+	ASSERT(samples > 150);						// OSS 0: 4.5 ms per conversion
+	ASSERT(st->temperatures <= 11);				// not one per pressure
+	printf("baro sampler: %d samples, %d temperatures in %d polls\r\n", samples, st->temperatures, polls);
+
+	// woken only when it has work, like from one shot swtimer in firmware
+	baro::sampler_start(100);
+	uint32_t wakes = 0;
+	samples = 0;
+	const uint64_t end2 = now_us() + 1000000;
+	while (now_us() < end2)
+	{
+		samples += baro::sampler_process();
+		wakes++;
+		const uint64_t next = baro::sampler_next_mtime();
+		ASSERT(next != UINT64_MAX);
+		delay_until(next);
+	}
+	baro::sampler_stop();
+	ASSERT(samples > 150);
+	ASSERT(wakes <= samples + st->temperatures + 1);
+	ASSERT(baro::sampler_next_mtime() == UINT64_MAX);
+	printf("baro sampler: %d samples in %d wake ups\r\n", samples, wakes);
+
+	// OSS 3: 19 bit UP, same pressure within rounding
+	baro::set_oss(3);
+	const int32_t p3 = baro::get_pressure();
+	ASSERT((p3 >= 69964 - 2) && (p3 <= 69964 + 2));
+
+	// decimating average: 1 sample per 4 conversions of 25.5 ms
+	baro::set_filter(baro::Filter::Average, 4);
+	baro::sampler_start(BARO_TEMP_PERIOD_MS);
+	samples = 0;
+	const uint64_t end3 = now_us() + 1000000;
+	while (now_us() < end3)
+	{
+		samples += baro::sampler_process();
+		advance_us(100);
+	}
+	baro::sampler_stop();
+	ASSERT_EQ(baro::get_sample(&sample), 1);
+	ASSERT_EQ(sample.pressure, p3);
+	ASSERT_EQ(samples, st->pressures / 4);
+	ASSERT((st->pressures >= 35) && (st->pressures <= 39));
+	printf("baro OSS 3, average of 4: %d samples from %d conversions\r\n", samples, st->pressures);
+
+	// IIR follows step of pressure
+	baro::set_oss(0);
+	baro::set_filter(baro::Filter::Iir, 2);
+	baro::sampler_start(BARO_TEMP_PERIOD_MS);
+	while (baro::sampler_process() == 0)
+	{
+		advance_us(100);
+	}
+	bmp180::set_raw(27898, 23843 + 100);
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		while (baro::sampler_process() == 0)
+		{
+			advance_us(100);
+		}
+	}
+	baro::sampler_stop();
+	const int32_t p_step = baro::get_pressure();
+	bmp180::set_raw(27898, 23843);
+	baro::get_sample(&sample);
+	ASSERT(p_step > 69964 + 100);
+	ASSERT((sample.pressure >= p_step - 1) && (sample.pressure <= p_step + 1));
+	baro::set_filter(baro::Filter::None, 1);
+}
+// ------------------------------------------------------------------------ }}}
+// altitude																	{{{
+// ----------------------------------------------------------------------------
+static double ref_altitude_mm(double p, double p0)
+{
+	return 44330.0 * (1.0 - pow(p / p0, 1.0 / 5.255)) * 1000.0;
+}
+
+static void test_altitude(void)
+{
+	static const int32_t sea_levels[] = {95000, ALTITUDE_SEA_LEVEL_PA, 105000};
+	int32_t max_error = 0;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		const int32_t p0 = sea_levels[i];
+		for (int32_t p = 30000; p <= 110000; p += 7)
+		{
+			const double ref = ref_altitude_mm(p, p0);
+			const int32_t h  = altitude::altitude(p, p0);
+			const int32_t error = (int32_t)fabs(h - ref);
+			max_error = (error > max_error) ? error : max_error;
+			ASSERT(error <= 100);
+
+			// inverse, 1 Pa of p0 is about 8 cm at sea level
+			const int32_t p0_calc = altitude::sea_level(p, (int32_t)lround(ref));
+			ASSERT((p0_calc >= p0 - 1) && (p0_calc <= p0 + 1));
+		}
+	}
+	ASSERT_EQ(altitude::altitude(ALTITUDE_SEA_LEVEL_PA, ALTITUDE_SEA_LEVEL_PA), 0);
+	ASSERT_EQ(altitude::altitude(ALTITUDE_SEA_LEVEL_PA, 0), ALTITUDE_ERROR);
+	ASSERT_EQ(altitude::altitude(-1, ALTITUDE_SEA_LEVEL_PA), ALTITUDE_ERROR);
+	printf("altitude: max error %d mm\r\n", max_error);
+}
+// ------------------------------------------------------------------------ }}}
+// sample store																{{{
+// ----------------------------------------------------------------------------
+static uint8_t export_buf[4096];
+static uint32_t export_n;
+
+static void export_put(uint8_t byte)
+{
+	ASSERT(export_n < sizeof(export_buf));
+	export_buf[export_n++] = byte;
+}
+
+static uint64_t read_uleb(const uint8_t** p)
+{
+	uint64_t value = 0;
+	uint8_t shift = 0;
+	uint8_t byte;
+	do
+	{
+		byte = *(*p)++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return value;
+}
+
+static void test_sample_store(void)
+{
+	using namespace sample_store;
+	static Record raw[32];
+	static Record second[60];
+	static Record minute[240];
+	static Store store;
+	const uint64_t tick_hz = SystemCoreClock / 4;
+
+	init(&store, 7, 2, raw, 32, second, 60, minute, 240);
+
+	// 10 Hz for 10 minutes: pressure ramp, temperature alternating +-1
+	for (uint32_t i = 0; i < 6000; i++)
+	{
+		const int32_t values[2] = {(int32_t)(100000 + i / 10), (i & 1) ? 201 : 199};
+		add(&store, i * tick_hz / 10, values);
+	}
+	ASSERT_EQ(count(&store, Rate::Raw), 32);
+	ASSERT_EQ(count(&store, Rate::Second), 60);		// last second is still open
+	ASSERT_EQ(count(&store, Rate::Minute), 9);
+
+	Record r;
+	ASSERT_EQ(get(&store, Rate::Minute, 0, &r), 1);
+	ASSERT_EQ(r.time, 0);
+	ASSERT_EQ(r.value[0], 100030);					// mean of 100000 .. 100059
+	ASSERT_EQ(r.value[1], 200);
+	ASSERT_EQ(get(&store, Rate::Minute, 9, &r), 0);
+	ASSERT_EQ(get(&store, Rate::Second, 59, &r), 1);
+	ASSERT(r.time == 598 * tick_hz);
+	ASSERT_EQ(r.value[0], 100598);
+
+	// export of minute averages and decode
+	export_n = 0;
+	const uint32_t n = export_block(&store, Rate::Minute, 0, export_put);
+	ASSERT_EQ(n, export_n);
+	ASSERT_EQ(crc16(CRC16_INIT, export_buf, n - 2), export_buf[n - 2] | (export_buf[n - 1] << 8));
+	ASSERT_EQ(export_buf[0], 'S');
+	ASSERT_EQ(export_buf[3], 7);
+	ASSERT_EQ(export_buf[6] | (export_buf[7] << 8), 9);
+
+	const uint8_t* p = &export_buf[20];
+	uint64_t time = 0;
+	int32_t values[2] = {0, 0};
+	for (uint8_t i = 0; i < 9; i++)
+	{
+		time += read_uleb(&p);
+		for (uint8_t v = 0; v < 2; v++)
+		{
+			const uint64_t zz = read_uleb(&p);
+			values[v] += (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+		}
+		get(&store, Rate::Minute, i, &r);
+		ASSERT(time == r.time);
+		ASSERT_EQ(values[0], r.value[0]);
+		ASSERT_EQ(values[1], r.value[1]);
+	}
+	ASSERT(p == &export_buf[n - 2]);
+
+	// only new records
+	export_n = 0;
+	export_block(&store, Rate::Second, 590 * tick_hz, export_put);
+	ASSERT_EQ(export_buf[6], 9);						// 590 .. 598
+	printf("sample_store: 9 minute averages in %d bytes (%d bytes as records)\r\n", n, 9 * (int)sizeof(Record));
+
+	// calibration shortens the second in the middle: record times stay
+	// increasing, interval after the change starts at the end of previous one
+	clear(&store);
+	for (uint32_t i = 0; i < 100; i++)
+	{
+		if (i == 55)
+		{
+			delay_set_timer_hz(tick_hz - tick_hz / 100);
+		}
+		const int32_t values[2] = {(int32_t)i, 0};
+		add(&store, i * tick_hz / 10, values);
+	}
+	delay_set_timer_hz(0);
+	ASSERT_EQ(count(&store, Rate::Second), 9);
+	get(&store, Rate::Second, 6, &r);
+	ASSERT(r.time == 6 * tick_hz);
+	for (uint8_t i = 1; i < 9; i++)
+	{
+		Record prev;
+		get(&store, Rate::Second, i - 1, &prev);
+		get(&store, Rate::Second, i, &r);
+		ASSERT(r.time > prev.time);
+	}
+}
+// ------------------------------------------------------------------------ }}}
+// eeprom																	{{{
+// ----------------------------------------------------------------------------
+static void test_eeprom(void)
+{
+	const uint8_t* mem = eeprom24c256::memory();
+
+	setup();
+	eeprom::init(DEV);
+
+	eeprom::write(0x1234, 0xA5);
+	ASSERT_EQ(mem[0x1234], 0xA5);
+	ASSERT_EQ(eeprom::read(0x1234), 0xA5);
+
+	// inside one page
+	const uint8_t data[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+	reset_stats();
+	eeprom::write_many(0x0100, data, sizeof(data));
+	print_stats("eeprom::write_many(16)");
+	ASSERT_EQ(eeprom24c256::write_cycles(), 2);
+	ASSERT_EQ(mem[0x010F], 15);
+
+	uint8_t buf[16] = {};
+	reset_stats();
+	eeprom::read_many(0x0100, buf, sizeof(buf));
+	print_stats("eeprom::read_many(16)");
+	for (uint8_t i = 0; i < sizeof(buf); i++)
+	{
+		ASSERT_EQ(buf[i], data[i]);
+	}
+
+	// crossing page boundary, more than 255 bytes
+	static uint8_t big[300];
+	for (uint16_t i = 0; i < sizeof(big); i++)
+	{
+		big[i] = i * 7;
+	}
+	reset_stats();
+	ASSERT(eeprom::write_many(0x0230, big, sizeof(big)) == i2c::Error::Ok);
+	print_stats("eeprom::write_many(300)");
+	for (uint16_t i = 0; i < sizeof(big); i++)
+	{
+		ASSERT_EQ(mem[0x0230 + i], (uint8_t)(i * 7));
+	}
+	ASSERT(eeprom::erase_many(0x0230, sizeof(big)) == i2c::Error::Ok);
+	ASSERT_EQ(mem[0x0230], 0xFF);
+	ASSERT_EQ(mem[0x0230 + sizeof(big) - 1], 0xFF);
+	ASSERT(eeprom::write_many(EEPROM_SIZE - 1, big, 2) == i2c::Error::WrongArgument);
+
+	// whole memory: one write cycle per page
+	static uint8_t all[EEPROM_SIZE];
+	const uint32_t cycles = eeprom24c256::write_cycles();
+	const uint64_t start = now_us();
+	reset_stats();
+	ASSERT(eeprom::write_many(0, all, sizeof(all)) == i2c::Error::Ok);
+	print_stats("eeprom::write_many(32 kB)");
+	printf("  32 kB written in %d ms\r\n", (uint32_t)((now_us() - start) / 1000));
+	ASSERT_EQ(eeprom24c256::write_cycles() - cycles, EEPROM_SIZE / EEPROM_PAGE_SIZE);
+	ASSERT_EQ(mem[EEPROM_SIZE - 1], 0x00);
+
+	// no ACK during write cycle
+	const i2c_bus::Client client = {DEV, EEPROM_ADDR, i2c::Speed::Speed400kHz, i2c::DutyCycle::Duty2};
+	const uint8_t addr[2] = {0x00, 0x00};
+	const uint8_t value = 0x11;
+	ASSERT(i2c_bus::write(&client, addr, 2, &value, 1) == i2c::Error::Ok);
+	ASSERT(i2c_bus::write(&client, addr, 2, &value, 1) == i2c::Error::Nack);
+	ASSERT(i2c_bus::probe(&client) == i2c::Error::Nack);
+	advance_us(SIM_EEPROM_WRITE_US);
+	ASSERT(i2c_bus::write(&client, addr, 2, &value, 1) == i2c::Error::Ok);
+	ASSERT_EQ(mem[0x0000], 0x11);
+}
+// ------------------------------------------------------------------------ }}}
+// eeprom cache																{{{
+// ----------------------------------------------------------------------------
+static void test_eeprom_cache(void)
+{
+	const uint8_t* mem = eeprom24c256::memory();
+	const eeprom_cache::Stats* cs = eeprom_cache::get_stats();
+
+	setup();
+	eeprom_cache::init(DEV);
+
+	// many small writes to one page: one write cycle on flush
+	reset_stats();
+	for (uint8_t i = 0; i < 10; i++)
+	{
+		eeprom_cache::write(0x0400 + i, i);
+	}
+	ASSERT_EQ(eeprom24c256::write_cycles(), 0);
+	ASSERT_EQ(mem[0x0400], 0xFF);
+	ASSERT_EQ(eeprom_cache::read(0x0405), 5);
+	ASSERT_EQ(eeprom_cache::dirty_pages(), 1);
+	ASSERT(eeprom_cache::flush() == i2c::Error::Ok);
+	print_stats("eeprom_cache 10x write+flush");
+	ASSERT_EQ(eeprom24c256::write_cycles(), 1);
+	ASSERT_EQ(mem[0x0409], 9);
+	ASSERT_EQ(eeprom_cache::dirty_pages(), 0);
+
+	// cached page is read from RAM
+	reset_stats();
+	ASSERT_EQ(eeprom_cache::read(0x0401), 1);
+	ASSERT_EQ(get_stats()->transactions, 0);
+
+	// large read through cache sees dirty data of cached pages
+	eeprom_cache::write(0x0440, 0xAB);
+	uint8_t buf[256];
+	ASSERT(eeprom_cache::read_many(0x0400, buf, sizeof(buf)) == i2c::Error::Ok);
+	ASSERT_EQ(buf[0x09], 9);
+	ASSERT_EQ(buf[0x40], 0xAB);
+	ASSERT_EQ(buf[0x80], 0xFF);
+	ASSERT(cs->bypass >= 2);
+	ASSERT_EQ(mem[0x0440], 0xFF);
+
+	// LRU eviction writes dirty page back
+	for (uint8_t i = 0; i < EEPROM_CACHE_PAGES; i++)
+	{
+		eeprom_cache::read(0x1000 + i * EEPROM_PAGE_SIZE);
+	}
+	ASSERT_EQ(mem[0x0440], 0xAB);
+
+	// timed flush
+	eeprom_cache::write(0x2000, 0x42);
+	ASSERT(eeprom_cache::process() == i2c::Error::Ok);
+	ASSERT_EQ(mem[0x2000], 0xFF);
+	advance_us(EEPROM_CACHE_FLUSH_MS * 1000);
+	ASSERT(eeprom_cache::process() == i2c::Error::Ok);
+	ASSERT_EQ(mem[0x2000], 0x42);
+}
+// ------------------------------------------------------------------------ }}}
+// kv store																	{{{
+// ----------------------------------------------------------------------------
+static void test_kv_store(void)
+{
+	using kv_store::Status;
+	const kv_store::Stats* st = kv_store::get_stats();
+	uint8_t value[KV_MAX_VALUE];
+	uint8_t len;
+
+	setup();
+	ASSERT(kv_store::init(DEV) == Status::Ok);
+	ASSERT(kv_store::get(1, value, sizeof(value), &len) == Status::NotFound);
+
+	const uint8_t calib[6] = {1, 2, 3, 4, 5, 6};
+	ASSERT(kv_store::put(1, calib, sizeof(calib)) == Status::Ok);
+	ASSERT(kv_store::get(1, value, sizeof(value), &len) == Status::Ok);
+	ASSERT_EQ(len, 6);
+	ASSERT_EQ(value[5], 6);
+	ASSERT(kv_store::get(1, value, 2, &len) == Status::WrongLength);
+	ASSERT(kv_store::put(KV_MAX_KEYS, calib, 1) == Status::WrongKey);
+
+	// same value is not written again
+	const uint32_t appends = st->appends;
+	ASSERT(kv_store::put(1, calib, sizeof(calib)) == Status::Ok);
+	ASSERT_EQ(kv_store::get_stats()->appends, appends);
+
+	// counter: one write cycle per update
+	uint32_t cycles = eeprom24c256::write_cycles();
+	for (uint32_t i = 0; i < 100; i++)
+	{
+		ASSERT(kv_store::put(2, (const uint8_t*)&i, sizeof(i)) == Status::Ok);
+	}
+	ASSERT_EQ(eeprom24c256::write_cycles() - cycles, 100);
+
+	ASSERT(kv_store::put(3, calib, 1) == Status::Ok);
+	ASSERT(kv_store::remove(3) == Status::Ok);
+	ASSERT(kv_store::exists(3) == 0);
+
+	// reboot: index is built from the log
+	ASSERT(kv_store::init(DEV) == Status::Ok);
+	ASSERT(kv_store::get(2, value, sizeof(value), &len) == Status::Ok);
+	ASSERT_EQ(len, 4);
+	ASSERT_EQ(value[0], 99);
+	ASSERT(kv_store::exists(3) == 0);
+	ASSERT(kv_store::get(1, value, sizeof(value), &len) == Status::Ok);
+
+	// torn write at the end of log is ignored
+	uint32_t v = 12345;
+	ASSERT(kv_store::put(2, (const uint8_t*)&v, sizeof(v)) == Status::Ok);
+	uint8_t* mem = eeprom24c256::memory();
+	const uint32_t last = KV_BASE + st->region * KV_REGION_SIZE + kv_store::get_stats()->used - 1;
+	mem[last] ^= 0xFF;
+	ASSERT(kv_store::init(DEV) == Status::Ok);
+	ASSERT(kv_store::get(2, value, sizeof(value), &len) == Status::Ok);
+	ASSERT_EQ(value[0], 99);
+	mem[last] ^= 0xFF;
+
+	// many updates: regions are swapped, writes spread over all pages
+	reset_stats();
+	for (uint32_t i = 0; i < 5000; i++)
+	{
+		ASSERT(kv_store::put(2 + (i % 4), (const uint8_t*)&i, sizeof(i)) == Status::Ok);
+	}
+	print_stats("kv_store 5000x put");
+	printf("  compactions: %d\r\n", kv_store::get_stats()->compactions);
+	ASSERT(kv_store::get_stats()->compactions >= 2);
+
+	uint32_t max_cycles = 0;
+	for (uint16_t page = 0; page < EEPROM_SIZE / EEPROM_PAGE_SIZE; page++)
+	{
+		const uint32_t c = eeprom24c256::page_write_cycles(page);
+		max_cycles = (c > max_cycles) ? c : max_cycles;
+	}
+	printf("  max write cycles of one page: %d\r\n", max_cycles);
+	ASSERT(max_cycles < 50);
+
+	ASSERT(kv_store::init(DEV) == Status::Ok);
+	ASSERT(kv_store::get(5, value, sizeof(value), &len) == Status::Ok);
+	ASSERT_EQ(value[0] | (value[1] << 8), 4999);
+	ASSERT(kv_store::get(1, value, sizeof(value), &len) == Status::Ok);
+	ASSERT_EQ(value[0], 1);
+}
+// ------------------------------------------------------------------------ }}}
+// nunchuck																	{{{
+// ----------------------------------------------------------------------------
+static uint32_t nunchuck_events;
+static wii_nunchuck::Event last_nunchuck_event;
+
+static void on_nunchuck_event(const wii_nunchuck::Event* event, void* arg)
+{
+	(void)arg;
+	nunchuck_events++;
+	last_nunchuck_event = *event;
+}
+
+static uint32_t nunchuck_wakeups;
+
+// sleeps until the next poll like firmware does
+static void run_nunchuck(uint32_t ms)
+{
+	const uint64_t end = get_timer_value() + (uint64_t)ms * (SystemCoreClock / 4 / 1000);
+	while (1)
+	{
+		wii_nunchuck::poller_process();
+		nunchuck_wakeups++;
+		const uint64_t next = wii_nunchuck::poller_next_mtime();
+		if (next >= end)
+		{
+			delay_until(end);
+			return;
+		}
+		delay_until(next);
+	}
+}
+
+static void test_nunchuck(void)
+{
+	uint8_t raw[6] = {};
+
+	setup();
+	wii_nunchuck::init();
+	ASSERT(nunchuck::is_initialized());
+
+	nunchuck::set_state(10, 250, 0x3FF, 0x001, 0x202, 1, 0);
+	reset_stats();
+	ASSERT(wii_nunchuck::read_raw(raw) == i2c::Error::Ok);
+	print_stats("wii_nunchuck::read_raw()");
+	ASSERT_EQ(raw[0], 10);
+	ASSERT_EQ(raw[1], 250);
+	ASSERT_EQ(raw[2], 0xFF);
+	ASSERT_EQ(raw[3], 0x00);
+	ASSERT_EQ(raw[4], 0x80);
+	ASSERT_EQ(raw[5], (2 << 6) | (1 << 4) | (3 << 2) | (0 << 1) | 1);
+
+	wii_nunchuck::wii_data_t data;
+	wii_nunchuck::decode(raw, &data);
+	ASSERT_EQ(data.accel_x, 0x3FF);
+	ASSERT_EQ(data.accel_y, 0x001);
+	ASSERT_EQ(data.accel_z, 0x202);
+	ASSERT_EQ(data.buttonC, 1);
+	ASSERT_EQ(data.buttonZ, 0);
+
+	// poller: 100 Hz, events only on threshold
+	nunchuck::set_state(128, 128, 512, 512, 512, 0, 0);
+	const wii_nunchuck::Thresholds thresholds = {8, 50};
+	reset_stats();
+	nunchuck_events = 0;
+	nunchuck_wakeups = 0;
+	wii_nunchuck::poller_start(10, &thresholds, on_nunchuck_event, NULL);
+	run_nunchuck(1000);
+	const wii_nunchuck::PollerStats* st = wii_nunchuck::get_poller_stats();
+	ASSERT((st->polls >= 99) && (st->polls <= 101));
+	ASSERT(nunchuck_wakeups <= 2 * st->polls + 1);		// 2 transactions per poll, no busy polling
+	ASSERT_EQ(nunchuck_events, 1);					// first report only
+	ASSERT_EQ(st->errors, 0);
+	printf("wii poller: %d polls in 1 s, bus busy %d us (%d.%d %%)\r\n", st->polls,
+		(uint32_t)get_stats()->bus_time_us, (uint32_t)get_stats()->bus_time_us / 10000, (uint32_t)(get_stats()->bus_time_us / 1000) % 10);
+
+	nunchuck::set_state(133, 128, 530, 512, 512, 0, 0);	// below thresholds
+	run_nunchuck(100);
+	ASSERT_EQ(nunchuck_events, 1);
+
+	nunchuck::set_state(137, 128, 530, 512, 512, 0, 0);	// 9 from last event
+	run_nunchuck(100);
+	ASSERT_EQ(nunchuck_events, 2);
+	ASSERT_EQ(last_nunchuck_event.changes, wii_nunchuck::ChangeJoystick);
+	ASSERT_EQ(last_nunchuck_event.data.joystick_x, 137);
+
+	nunchuck::set_state(137, 128, 530, 512, 512, 1, 0);
+	run_nunchuck(100);
+	ASSERT_EQ(nunchuck_events, 3);
+	ASSERT_EQ(last_nunchuck_event.changes, wii_nunchuck::ChangeButtonC);
+	ASSERT_EQ(last_nunchuck_event.data.buttonC, 1);
+
+	nunchuck::set_state(137, 128, 530, 600, 512, 1, 0);
+	run_nunchuck(100);
+	ASSERT_EQ(nunchuck_events, 4);
+	ASSERT_EQ(last_nunchuck_event.changes, wii_nunchuck::ChangeAccel);
+	ASSERT_EQ(last_nunchuck_event.data.accel_y, 600);
+	wii_nunchuck::poller_stop();
+	ASSERT(wii_nunchuck::poller_next_mtime() == UINT64_MAX);
+}
+// ------------------------------------------------------------------------ }}}
+
+// date																		{{{
+// ----------------------------------------------------------------------------
+static void test_date(void)
+{
+	using namespace date;
+	Time t;
+
+	from_epoch(0, &t);
+	ASSERT_EQ(t.year, 1970);
+	ASSERT_EQ(t.month, 1);
+	ASSERT_EQ(t.day, 1);
+	ASSERT_EQ(t.weekday, 4);					// Thursday
+
+	from_epoch(951825599, &t);					// Tue 29.2.2000 11:59:59
+	ASSERT_EQ(t.year, 2000);
+	ASSERT_EQ(t.month, 2);
+	ASSERT_EQ(t.day, 29);
+	ASSERT_EQ(t.hour, 11);
+	ASSERT_EQ(t.min, 59);
+	ASSERT_EQ(t.sec, 59);
+	ASSERT_EQ(t.weekday, 2);
+	ASSERT_EQ(to_epoch(&t), 951825599);
+
+	from_epoch(0xFFFFFFFF, &t);					// Sun 7.2.2106 6:28:15
+	ASSERT_EQ(t.year, 2106);
+	ASSERT_EQ(t.month, 2);
+	ASSERT_EQ(t.day, 7);
+	ASSERT_EQ(t.weekday, 7);
+
+	// every day of RTC range against day by day walk
+	uint16_t year = 1970;
+	uint8_t month = 1;
+	uint8_t day = 1;
+	for (uint32_t days = 0; days < 0xFFFFFFFF / 86400; days++)
+	{
+		uint16_t y;
+		uint8_t m;
+		uint8_t d;
+		civil_from_days(days, &y, &m, &d);
+		ASSERT((y == year) && (m == month) && (d == day));
+		ASSERT_EQ(days_from_civil(y, m, d), days);
+
+		static const uint8_t mdays[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+		const bool leap = ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0));
+		if (++day > mdays[month - 1] + ((month == 2) && leap))
+		{
+			day = 1;
+			if (++month > 12)
+			{
+				month = 1;
+				year++;
+			}
+		}
+	}
+
+	// cached time updated by ticks over end of leap February and of year
+	static const uint32_t starts[] = {951782400, 978220800, 4107456000u};
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		rtc::write(starts[i]);
+		init();
+		for (uint32_t s = 0; s < 4 * 86400; s++)
+		{
+			rtc::write(rtc::get_counter() + 1);
+			tick();
+			Time ref;
+			get(&t);
+			from_epoch(rtc::get_counter(), &ref);
+			ASSERT((t.epoch == ref.epoch) && (t.year == ref.year) && (t.month == ref.month) && (t.day == ref.day) &&
+				(t.hour == ref.hour) && (t.min == ref.min) && (t.sec == ref.sec) && (t.weekday == ref.weekday));
+		}
+	}
+
+	// missed second
+	rtc::write(rtc::get_counter() + 5);
+	tick();
+	get(&t);
+	ASSERT(t.epoch == rtc::get_counter());
+
+	t.year = 2020;
+	t.month = 2;
+	t.day = 17;
+	t.hour = 12;
+	t.min = 0;
+	t.sec = 0;
+	set(&t);
+	ASSERT(rtc::get_counter() == 1581940800);
+	ASSERT_EQ(get_hour(), 12);
+}
+// ------------------------------------------------------------------------ }}}
+
+// swtimer																	{{{
+// ----------------------------------------------------------------------------
+typedef struct
+{
+	swtimer::Timer	timer;
+	uint32_t		period;
+	uint32_t		expected;	// tick of next call
+	uint32_t		calls;
+	uint32_t		errors;		// called at other tick
+} TestTimer;
+
+static void on_test_timer(void* arg)
+{
+	TestTimer* t = (TestTimer*)arg;
+	if (swtimer::now() != t->expected)
+	{
+		t->errors++;
+	}
+	t->expected += t->period;
+	t->calls++;
+}
+
+static uint32_t wakeups;
+
+// sleeps from event to event like firmware does
+static void run_swtimer(uint32_t ms)
+{
+	const uint64_t end = get_timer_value() + (uint64_t)ms * (SystemCoreClock / 4 / 1000);
+	while (1)
+	{
+		const uint64_t next = swtimer::next_mtime();
+		if (next > end)
+		{
+			delay_until(end);
+			swtimer::process();
+			return;
+		}
+		delay_until(next);
+		swtimer::process();
+		wakeups++;
+	}
+}
+
+static void test_swtimer(void)
+{
+	static TestTimer timers[40];
+	static const uint32_t RUN_MS = 100000;
+
+	swtimer::init();
+	ASSERT(swtimer::next_mtime() == UINT64_MAX);
+
+	// periods from 3 ms over all levels to 40 s
+	uint32_t calls = 0;
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		TestTimer* t = &timers[i];
+		t->period = (i < 36) ? 3 + i * i * 7 : 10000 * (i - 35);
+		t->expected = swtimer::now() + t->period;
+		swtimer::start(&t->timer, t->period, t->period, on_test_timer, t);
+		calls += RUN_MS / t->period;
+	}
+	wakeups = 0;
+	run_swtimer(RUN_MS);
+
+	uint32_t n = 0;
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		ASSERT_EQ(timers[i].calls, RUN_MS / timers[i].period);
+		ASSERT_EQ(timers[i].errors, 0);
+		n += timers[i].calls;
+	}
+	ASSERT_EQ(swtimer::get_stats()->expired, calls);
+	ASSERT(wakeups <= n);						// one per due tick at most, no 1 ms tick
+	printf("swtimer: %d timers, %d calls and %d cascades in %d s, %d wake ups\r\n", 40, n,
+		swtimer::get_stats()->cascaded, RUN_MS / 1000, wakeups);
+
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		swtimer::stop(&timers[i].timer);
+		ASSERT(!swtimer::is_active(&timers[i].timer));
+	}
+	run_swtimer(1000);
+	ASSERT_EQ(swtimer::get_stats()->expired, calls);
+
+	// one shot beyond the wheel (9.3 h) and one stopped before expiry
+	TestTimer* t = &timers[0];
+	t->period = 10 * 3600 * 1000;
+	t->expected = swtimer::now() + t->period;
+	t->calls = 0;
+	swtimer::start(&t->timer, t->period, 0, on_test_timer, t);
+	TestTimer* s = &timers[1];
+	s->calls = 0;
+	swtimer::start(&s->timer, 5000, 0, on_test_timer, s);
+	run_swtimer(4000);
+	swtimer::stop(&s->timer);
+	wakeups = 0;
+	run_swtimer(11 * 3600 * 1000);
+	ASSERT_EQ(t->calls, 1);
+	ASSERT_EQ(t->errors, 0);
+	ASSERT_EQ(s->calls, 0);
+	ASSERT(!swtimer::is_active(&t->timer));
+	ASSERT(wakeups < 10);
+
+	// calibrated mtime is 1 % slower than nominal: 1000 ticks pass in 990 ms
+	// of nominal mtime, now() goes on without a jump
+	const uint32_t before = swtimer::now();
+	delay_set_timer_hz(SystemCoreClock / 4 - SystemCoreClock / 400);
+	swtimer::process();		// sees new frequency
+	t->period = 1000;
+	t->expected = swtimer::now() + t->period;
+	t->calls = 0;
+	ASSERT(t->expected - before <= 1001);
+	swtimer::start(&t->timer, t->period, 0, on_test_timer, t);
+	run_swtimer(992);
+	ASSERT_EQ(t->calls, 1);
+	ASSERT_EQ(t->errors, 0);
+	delay_set_timer_hz(0);
+}
+// ------------------------------------------------------------------------ }}}
+
+// scheduler																{{{
+// ----------------------------------------------------------------------------
+static uint8_t sched_order[8];
+static uint32_t sched_events[8];
+static uint8_t sched_n;
+
+static void sched_task(uint32_t events, void* arg)
+{
+	const uint8_t priority = (uintptr_t)arg;
+	sched_order[sched_n++] = priority;
+	sched_events[priority] = events;
+
+	if (priority == 7)
+	{
+		scheduler::post(0, 0x10);		// low priority wakes up high priority
+		delay_ms(2);
+	}
+}
+
+static void sched_post_tick(void* arg)
+{
+	scheduler::post((uintptr_t)arg, 1);
+}
+
+static void test_scheduler(void)
+{
+	scheduler::init(NULL);
+	ASSERT(scheduler::add(0, "high", sched_task, (void*)0));
+	ASSERT(scheduler::add(3, "mid", sched_task, (void*)3));
+	ASSERT(scheduler::add(7, "low", sched_task, (void*)7));
+	ASSERT(!scheduler::add(3, "again", sched_task, NULL));
+	ASSERT(!scheduler::dispatch());
+
+	// priority order, events merged into one run
+	scheduler::post(7, 1);
+	scheduler::post(3, 1);
+	scheduler::post(3, 4);
+	scheduler::post(0, 2);
+	sched_n = 0;
+	while (scheduler::dispatch());
+	ASSERT_EQ(sched_n, 4);
+	ASSERT_EQ(sched_order[0], 0);
+	ASSERT_EQ(sched_order[1], 3);
+	ASSERT_EQ(sched_order[2], 7);
+	ASSERT_EQ(sched_order[3], 0);		// posted by low one
+	ASSERT_EQ(sched_events[3], 5);
+	ASSERT_EQ(sched_events[0], 0x10);
+
+	const scheduler::Stats* st = scheduler::get_stats(7);
+	ASSERT_EQ(st->runs, 1);
+	ASSERT(st->max_run_time >= 2 * (SystemCoreClock / 4 / 1000));
+	ASSERT_EQ(scheduler::get_stats(0)->runs, 2);
+	ASSERT_EQ(scheduler::get_stats(3)->runs, 1);
+	scheduler::print_stats();
+
+	scheduler::clear_stats();
+	ASSERT_EQ(scheduler::get_stats(7)->runs, 0);
+
+	// alarm fires between swtimer::process() and sleep(): no sleep until its
+	// callback posted and the task ran
+	static swtimer::Timer timer;
+	swtimer::start(&timer, 10, 0, sched_post_tick, (void*)3);
+	swtimer::process();
+	scheduler::sleep();						// wake up from posts above
+	const uint32_t slept = i2c_sim::sleeps();
+	delay_until(swtimer::next_mtime());
+	scheduler::sleep();
+	ASSERT_EQ(i2c_sim::sleeps(), slept);
+	swtimer::process();
+	scheduler::sleep();
+	ASSERT_EQ(i2c_sim::sleeps(), slept);
+	sched_n = 0;
+	while (scheduler::dispatch());
+	ASSERT_EQ(sched_n, 1);
+	ASSERT_EQ(sched_order[0], 3);
+	scheduler::sleep();
+	ASSERT_EQ(i2c_sim::sleeps(), slept + 1);
+}
+// ------------------------------------------------------------------------ }}}
+
+// profiler		{{{
+// ----------------------------------------------------------------------------
+static void profiled(uint32_t ms)
+{
+	PROFILE_SCOPE("profiled");
+	delay_ms(ms);
+}
+
+static void test_profiler(void)
+{
+	profiler_init();
+	const uint32_t cycles_ms = SystemCoreClock / 1000;
+
+	for (uint32_t ms = 1; ms <= 4; ms++)
+	{
+		profiled(ms);
+	}
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		PROFILE_BEGIN(c_probe);
+		delay_ms(10);
+		PROFILE_END(c_probe);
+	}
+
+	ASSERT_EQ(profiler_count(), 2);
+	const ProfilerProbe* p = profiler_get(0);
+	ASSERT(strcmp(p->name, "profiled") == 0);
+	ASSERT_EQ(p->count, 4);
+	ASSERT_EQ(p->min, 1 * cycles_ms);
+	ASSERT_EQ(p->max, 4 * cycles_ms);
+	ASSERT_EQ(p->cycles / p->count, 2 * cycles_ms + cycles_ms / 2);
+	ASSERT_EQ(p->instret * 2, p->cycles);
+
+	p = profiler_get(1);
+	ASSERT(strcmp(p->name, "c_probe") == 0);
+	ASSERT_EQ(p->count, 3);
+	ASSERT_EQ(p->min, 10 * cycles_ms);
+	profiler_report();		// c_probe first, it takes more
+
+	profiler_reset();
+	ASSERT_EQ(profiler_count(), 2);
+	ASSERT_EQ(profiler_get(0)->count, 0);
+	profiled(1);
+	ASSERT_EQ(profiler_get(0)->count, 1);
+	profiler_stop();
+}
+// ------------------------------------------------------------------------ }}}
+
+int main(void)
+{
+	i2c_bus::test();
+	test_baro();
+	test_altitude();
+	test_sample_store();
+	test_eeprom();
+	test_eeprom_cache();
+	test_kv_store();
+	test_nunchuck();
+	test_date();
+	test_swtimer();
+	test_scheduler();
+	test_profiler();
+
+	printf("all host tests passed\r\n");
+	return 0;
+}
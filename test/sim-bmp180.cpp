@@ -0,0 +1,154 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200210
+// BMP180 model: calibration EEPROM, ID, conversion with real conversion time
+// default values are example from datasheet (page 15): T = 15.0 °C, p = 69964 Pa
+
+#include "i2c-sim.hpp"
+#include "debug.h"
+
+namespace i2c_sim
+{
+namespace bmp180
+{
+
+#define BMP_ADDR		0xEE
+#define REG_CALIB		0xAA	// 22 bytes, AC1..MD, MSB first
+#define REG_ID			0xD0
+#define REG_RESET		0xE0
+#define REG_CONTROL		0xF4
+#define REG_OUT_MSB		0xF6
+#define REG_OUT_LSB		0xF7
+#define REG_OUT_XLSB	0xF8
+#define CONTROL_SCO		(1 << 5)	// conversion running
+
+typedef struct
+{
+	uint8_t		regs[256];
+	uint8_t		pointer;
+	bool		pointer_set;	// first byte of write is register
+	uint64_t	done_us;		// conversion is finished at this time
+	uint32_t	result;			// 24 bits, goes to OUT_* when done
+	uint16_t	ut;
+	uint32_t	up;
+} Bmp;
+
+static Bmp bmp;
+
+static const int16_t calib[11] = {
+	408, -72, -14383, (int16_t)32741, (int16_t)32757, 23153,	// AC1..AC6
+	6190, 4, -32768, -8711, 2868,							// B1, B2, MB, MC, MD
+};
+
+// conversion ends: result is visible, SCO goes to 0
+static void update(void)
+{
+	if ((bmp.regs[REG_CONTROL] & CONTROL_SCO) && (now_us() >= bmp.done_us))
+	{
+		bmp.regs[REG_OUT_MSB]  = bmp.result >> 16;
+		bmp.regs[REG_OUT_LSB]  = bmp.result >> 8;
+		bmp.regs[REG_OUT_XLSB] = bmp.result;
+		bmp.regs[REG_CONTROL] &= ~CONTROL_SCO;
+	}
+}
+
+static void start_conversion(uint8_t cmd)
+{
+	const uint8_t oss = cmd >> 6;
+	// max conversion times from datasheet, in us
+	static const uint32_t pressure_us[4] = {4500, 7500, 13500, 25500};
+
+	if ((cmd & 0x3F) == 0x2E)
+	{
+		bmp.result  = (uint32_t)bmp.ut << 8;
+		bmp.done_us = now_us() + 4500;
+	}
+	else if ((cmd & 0x3F) == 0x34)
+	{
+		// UP is 19 bits, aligned to MSB of 3 registers: up << (8 - oss)
+		bmp.result  = (bmp.up << oss) << (8 - oss);
+		bmp.done_us = now_us() + pressure_us[oss];
+	}
+	else
+	{
+		return;
+	}
+	bmp.regs[REG_CONTROL] = cmd | CONTROL_SCO;
+}
+
+static bool on_start(void* self, bool is_read)
+{
+	(void)self;
+	bmp.pointer_set = is_read;
+	return 1;
+}
+
+static bool on_write(void* self, uint8_t byte)
+{
+	(void)self;
+	if (bmp.pointer_set == 0)
+	{
+		bmp.pointer = byte;
+		bmp.pointer_set = 1;
+		return 1;
+	}
+
+	switch (bmp.pointer)
+	{
+		case REG_CONTROL:
+			start_conversion(byte);
+			break;
+		case REG_RESET:
+			if (byte == 0xB6)
+			{
+				reset();
+			}
+			break;
+		default:
+			break;	// calibration and ID are read only
+	}
+	bmp.pointer++;
+	return 1;
+}
+
+static uint8_t on_read(void* self)
+{
+	(void)self;
+	update();
+	return bmp.regs[bmp.pointer++];
+}
+
+static void on_stop(void* self)
+{
+	(void)self;
+}
+
+static Model bmp_model = {"BMP180", BMP_ADDR, on_start, on_write, on_read, on_stop, NULL};
+
+Model* model(void)
+{
+	return &bmp_model;
+}
+
+void reset(void)
+{
+	const uint16_t ut = (bmp.ut != 0) ? bmp.ut : 27898;
+	const uint32_t up = (bmp.up != 0) ? bmp.up : 23843;
+
+	bmp = {};
+	for (uint8_t i = 0; i < 11; i++)
+	{
+		bmp.regs[REG_CALIB + 2 * i]     = (uint16_t)calib[i] >> 8;
+		bmp.regs[REG_CALIB + 2 * i + 1] = (uint16_t)calib[i];
+	}
+	bmp.regs[REG_ID] = 0x55;
+	set_raw(ut, up);
+}
+
+void set_raw(uint16_t ut, uint32_t up)
+{
+	bmp.ut = ut;
+	bmp.up = up;
+}
+
+} // namespace bmp180
+} // namespace i2c_sim
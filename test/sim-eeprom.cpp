@@ -0,0 +1,134 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200210
+// 24C256 model: 2 byte address, 64 byte pages, write cycle time
+// - write past the end of page wraps to start of the same page
+// - read past the end of memory wraps to address 0
+// - during write cycle device doesn't ACK its address (ACK polling)
+
+#include "i2c-sim.hpp"
+#include "debug.h"
+
+namespace i2c_sim
+{
+namespace eeprom24c256
+{
+
+#define EEPROM_ADDR_SIM		0xA0
+
+typedef struct
+{
+	uint8_t		mem[SIM_EEPROM_SIZE];
+	uint8_t		page[SIM_EEPROM_PAGE];		// written at STOP
+	bool		page_used[SIM_EEPROM_PAGE];
+	uint16_t	address;
+	uint8_t		naddress;	// address bytes received in this write
+	bool		writing;	// data bytes received
+	uint64_t	busy_until;
+	uint32_t	cycles;
+	uint32_t	page_cycles[SIM_EEPROM_SIZE / SIM_EEPROM_PAGE];	// wear
+} Eeprom;
+
+static Eeprom e;
+
+static bool on_start(void* self, bool is_read)
+{
+	(void)self;
+	if (now_us() < e.busy_until)
+	{
+		return 0;	// internal write cycle
+	}
+	if (is_read == 0)
+	{
+		e.naddress = 0;
+		e.writing  = 0;
+		for (uint8_t i = 0; i < SIM_EEPROM_PAGE; i++)
+		{
+			e.page_used[i] = 0;
+		}
+	}
+	return 1;
+}
+
+static bool on_write(void* self, uint8_t byte)
+{
+	(void)self;
+	if (e.naddress < 2)
+	{
+		e.address = (e.address << 8) | byte;
+		e.address &= (SIM_EEPROM_SIZE - 1);
+		e.naddress++;
+		return 1;
+	}
+
+	// buffered in page latch, only lower 6 bits of address are incremented
+	const uint8_t offset = e.address % SIM_EEPROM_PAGE;
+	e.page[offset] = byte;
+	e.page_used[offset] = 1;
+	e.address = (e.address & ~(SIM_EEPROM_PAGE - 1)) | ((offset + 1) % SIM_EEPROM_PAGE);
+	e.writing = 1;
+	return 1;
+}
+
+static uint8_t on_read(void* self)
+{
+	(void)self;
+	const uint8_t data = e.mem[e.address];
+	e.address = (e.address + 1) % SIM_EEPROM_SIZE;
+	return data;
+}
+
+static void on_stop(void* self)
+{
+	(void)self;
+	if (e.writing == 0)
+	{
+		return;		// only address was written (random read)
+	}
+
+	const uint16_t page_start = e.address & ~(SIM_EEPROM_PAGE - 1);
+	for (uint8_t i = 0; i < SIM_EEPROM_PAGE; i++)
+	{
+		if (e.page_used[i])
+		{
+			e.mem[page_start + i] = e.page[i];
+		}
+	}
+	e.writing    = 0;
+	e.busy_until = now_us() + SIM_EEPROM_WRITE_US;
+	e.cycles++;
+	e.page_cycles[page_start / SIM_EEPROM_PAGE]++;
+}
+
+static Model eeprom_model = {"24C256", EEPROM_ADDR_SIM, on_start, on_write, on_read, on_stop, NULL};
+
+Model* model(void)
+{
+	return &eeprom_model;
+}
+
+void reset(void)
+{
+	e = {};
+	for (uint32_t i = 0; i < SIM_EEPROM_SIZE; i++)
+	{
+		e.mem[i] = 0xFF;
+	}
+}
+
+uint8_t* memory(void)
+{
+	return e.mem;
+}
+
+uint32_t write_cycles(void)
+{
+	return e.cycles;
+}
+
+uint32_t page_write_cycles(uint16_t page)
+{
+	return e.page_cycles[page];
+}
+
+} // namespace eeprom24c256
+} // namespace i2c_sim
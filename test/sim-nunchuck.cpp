@@ -0,0 +1,110 @@
+// Copyright © 2020 by P.Orsolic. All right reserved
+// Created 200210
+// Wii nunchuck model, "new" unencrypted init: 0x55 -> 0xF0, 0x00 -> 0xFB
+// report layout (wiibrew.org):
+// [0] joystick X, [1] joystick Y, [2..4] accel X, Y, Z [9:2]
+// [5] b7b6 accel Z [1:0], b5b4 accel Y [1:0], b3b2 accel X [1:0],
+//     b1 button C, b0 button Z (buttons: 0 = pressed)
+
+#include "i2c-sim.hpp"
+#include "debug.h"
+
+namespace i2c_sim
+{
+namespace nunchuck
+{
+
+#define NUNCHUCK_ADDR	0xA4
+#define REG_REPORT		0x00
+#define REG_CALIB		0x20
+#define REG_INIT1		0xF0
+#define REG_INIT2		0xFB
+#define REG_ID			0xFA
+
+typedef struct
+{
+	uint8_t		regs[256];
+	uint8_t		pointer;
+	bool		pointer_set;
+	uint8_t		report[6];	// current state, latched to regs on pointer write
+} Nunchuck;
+
+static Nunchuck n;
+
+static bool on_start(void* self, bool is_read)
+{
+	(void)self;
+	n.pointer_set = is_read;
+	return 1;
+}
+
+static bool on_write(void* self, uint8_t byte)
+{
+	(void)self;
+	if (n.pointer_set == 0)
+	{
+		n.pointer = byte;
+		n.pointer_set = 1;
+		if ((byte == REG_REPORT) && is_initialized())
+		{
+			for (uint8_t i = 0; i < 6; i++)
+			{
+				n.regs[REG_REPORT + i] = n.report[i];
+			}
+		}
+		return 1;
+	}
+	n.regs[n.pointer++] = byte;
+	return 1;
+}
+
+static uint8_t on_read(void* self)
+{
+	(void)self;
+	return n.regs[n.pointer++];
+}
+
+static void on_stop(void* self)
+{
+	(void)self;
+}
+
+static Model nunchuck_model = {"nunchuck", NUNCHUCK_ADDR, on_start, on_write, on_read, on_stop, NULL};
+
+Model* model(void)
+{
+	return &nunchuck_model;
+}
+
+bool is_initialized(void)
+{
+	return (n.regs[REG_INIT1] == 0x55) && (n.regs[REG_INIT2] == 0x00);
+}
+
+void reset(void)
+{
+	static const uint8_t id[6] = {0x00, 0x00, 0xA4, 0x20, 0x00, 0x00};
+
+	n = {};
+	for (uint8_t i = 0; i < 6; i++)
+	{
+		n.regs[REG_REPORT + i] = 0xFF;	// not initialized: no valid report
+		n.regs[REG_ID + i] = id[i];
+	}
+	n.regs[REG_INIT2] = 0xFF;
+	set_state(128, 128, 512, 512, 512, 0, 0);
+}
+
+void set_state(uint8_t jx, uint8_t jy, uint16_t ax, uint16_t ay, uint16_t az, bool c, bool z)
+{
+	n.report[0] = jx;
+	n.report[1] = jy;
+	n.report[2] = ax >> 2;
+	n.report[3] = ay >> 2;
+	n.report[4] = az >> 2;
+	n.report[5] = ((az & 3) << 6) | ((ay & 3) << 4) | ((ax & 3) << 2) |
+		((c ? 0 : 1) << 1) | (z ? 0 : 1);
+}
+
+} // namespace nunchuck
+} // namespace i2c_sim